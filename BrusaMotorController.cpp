@@ -64,7 +64,7 @@ void BrusaMotorController::setup() {
     canHandlerEv.attach(this, CAN_MASKED_ID_1, CAN_MASK_1, false);
     canHandlerEv.attach(this, CAN_MASKED_ID_2, CAN_MASK_2, false);
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER_BRUSA);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_MOTOR_CONTROLLER_BRUSA), TICK_PRIORITY_CONTROL);
 }
 
 /*
@@ -131,7 +131,7 @@ void BrusaMotorController::sendControl() {
     if (Logger::isDebug())
         Logger::debug(BRUSA_DMC5, "requested Speed: %l rpm, requested Torque: %f Nm", speedRequested, (float)torqueRequested/10.0F);
 
-    canHandlerEv.sendFrame(outputFrame);
+    canHandlerEv.sendFrame(outputFrame, CAN_TX_PRIORITY_HIGH);
 }
 
 /*
@@ -202,7 +202,7 @@ void BrusaMotorController::prepareOutputFrame(uint32_t id) {
  * this method is called. Depending on the ID of the CAN message, the data of
  * the incoming message is processed.
  */
-void BrusaMotorController::handleCanFrame( CAN_FRAME *frame) {
+void BrusaMotorController::handleCanFrame(const CAN_FRAME *frame) {
     switch (frame->id) {
     case CAN_ID_STATUS:
         processStatus(frame->data.bytes);
@@ -230,7 +230,7 @@ void BrusaMotorController::handleCanFrame( CAN_FRAME *frame) {
  * This message provides the general status of the controller as well as
  * available and current torque and speed.
  */
-void BrusaMotorController::processStatus(uint8_t data[]) {
+void BrusaMotorController::processStatus(const uint8_t data[]) {
     statusBitfield1 = (uint32_t)(data[1] | (data[0] << 8));
     torqueAvailable = (int16_t)(data[3] | (data[2] << 8)) / 10;
     torqueActual = (int16_t)(data[5] | (data[4] << 8)) / 10;
@@ -251,7 +251,7 @@ void BrusaMotorController::processStatus(uint8_t data[]) {
  * This message provides information about current electrical conditions and
  * applied mechanical power.
  */
-void BrusaMotorController::processActualValues(uint8_t data[]) {
+void BrusaMotorController::processActualValues(const uint8_t data[]) {
     dcVoltage = (uint16_t)(data[1] | (data[0] << 8));
     dcCurrent = (int16_t)(data[3] | (data[2] << 8));
     acCurrent = (uint16_t)(data[5] | (data[4] << 8)) / 2.5;
@@ -268,7 +268,7 @@ void BrusaMotorController::processActualValues(uint8_t data[]) {
  * The bitfield is not processed here but it is made available for other components
  * (e.g. the webserver to display the various status flags)
  */
-void BrusaMotorController::processErrors(uint8_t data[]) {
+void BrusaMotorController::processErrors(const uint8_t data[]) {
     statusBitfield3 = (uint32_t)(data[1] | (data[0] << 8) | (data[5] << 16) | (data[4] << 24));
     statusBitfield2 = (uint32_t)(data[7] | (data[6] << 8));
 
@@ -281,7 +281,7 @@ void BrusaMotorController::processErrors(uint8_t data[]) {
  *
  * This message provides information about available torque.
  */
-void BrusaMotorController::processTorqueLimit(uint8_t data[]) {
+void BrusaMotorController::processTorqueLimit(const uint8_t data[]) {
     maxPositiveTorque = (int16_t)(data[1] | (data[0] << 8)) / 10;
     minNegativeTorque = (int16_t)(data[3] | (data[2] << 8)) / 10;
     limiterStateNumber = (uint8_t)data[4];
@@ -295,7 +295,7 @@ void BrusaMotorController::processTorqueLimit(uint8_t data[]) {
  *
  * This message provides information about motor and inverter temperatures.
  */
-void BrusaMotorController::processTemperature(uint8_t data[]) {
+void BrusaMotorController::processTemperature(const uint8_t data[]) {
     temperatureInverter = (int16_t)(data[1] | (data[0] << 8)) * 5;
     temperatureMotor = (int16_t)(data[3] | (data[2] << 8)) * 5;
     temperatureSystem = (int16_t)(data[4] - 50) * 10;
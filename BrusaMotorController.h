@@ -161,7 +161,7 @@ public:
 
     BrusaMotorController();
     void handleTick();
-    void handleCanFrame(CAN_FRAME *frame);
+    void handleCanFrame(const CAN_FRAME *frame);
     void setup();
     DeviceId getId();
     uint32_t getTickInterval();
@@ -184,11 +184,11 @@ private:
     void sendControl2();
     void sendLimits();
     void prepareOutputFrame(uint32_t);
-    void processStatus(uint8_t data[]);
-    void processActualValues(uint8_t data[]);
-    void processErrors(uint8_t data[]);
-    void processTorqueLimit(uint8_t data[]);
-    void processTemperature(uint8_t data[]);
+    void processStatus(const uint8_t data[]);
+    void processActualValues(const uint8_t data[]);
+    void processErrors(const uint8_t data[]);
+    void processTorqueLimit(const uint8_t data[]);
+    void processTemperature(const uint8_t data[]);
 };
 
 #endif /* BRUSAMOTORCONTROLLER_H_ */
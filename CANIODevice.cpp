@@ -24,7 +24,7 @@ DeviceType CANIODevice::getType()
 	return DEVICE_IO;
 }
 
-void CANIODevice::handleCanFrame(CAN_FRAME *frame)
+void CANIODevice::handleCanFrame(const CAN_FRAME *frame)
 {
 }
 
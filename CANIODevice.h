@@ -57,7 +57,7 @@ public:
 
 	void setup();
     void tearDown();
-    void handleCanFrame(CAN_FRAME *);
+    void handleCanFrame(const CAN_FRAME *);
     void handleMessage(uint32_t, void*);
     DeviceType getType();    
 
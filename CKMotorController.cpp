@@ -30,15 +30,13 @@
 
 #include "CKMotorController.h"
 
-uint32_t CK_milli;
-
 CKMotorController::CKMotorController() : MotorController() {
     prefsHandler = new PrefHandler(CKINVERTER);
 
     selectedGear = NEUTRAL;
     operationState = DISABLED;
     actualState = DISABLED;
-    online = 0;
+    rxWatch = -1;
 	aliveCounter = 0;
     commonName = "CK Inverter Ctrl Board";
 }
@@ -53,13 +51,28 @@ void CKMotorController::setup() {
 
     // register ourselves as observer of 0x23x and 0x65x can frames
     canHandlerEv.attach(this, 0x410, 0x7f0, false);
+    canHandlerEv.unwatchFrames(rxWatch);
+    rxWatch = canHandlerEv.watchFrames(0x410, 0x7f0, false, CFG_MOTORCTRL_RX_TIMEOUT, 0, this);
 
     running = false;
     setSelectedGear(NEUTRAL);
     setOpState(ENABLE);
-    CK_milli = millis();
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC), TICK_PRIORITY_CONTROL);
+}
+
+/*
+ * No frame was received from the inverter for CFG_MOTORCTRL_RX_TIMEOUT
+ */
+void CKMotorController::handleCanTimeout(int8_t watch) {
+    running = false;
+}
+
+/*
+ * Frames are received from the inverter (again)
+ */
+void CKMotorController::handleCanRecovery(int8_t watch) {
+    running = true;
 }
 
 /*
@@ -69,10 +82,9 @@ void CKMotorController::setup() {
  and also the checksum must match the one we calculate. Right now we'll just assume
  everything has gone according to plan.
  */
-void CKMotorController::handleCanFrame(CAN_FRAME *frame) {
+void CKMotorController::handleCanFrame(const CAN_FRAME *frame) {
     int RotorTemp, invTemp, StatorTemp;
     int temp;
-    online = true; //if a frame got to here then it passed the filter and must have been from the DMOC
 
     //Logger::debug("CKInverter CAN received: %X  %X  %X  %X  %X  %X  %X  %X  %X", frame->id,frame->data.bytes[0] ,frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],frame->data.bytes[5],frame->data.bytes[6],frame->data.bytes[7]);
 
@@ -110,18 +122,6 @@ void CKMotorController::handleTick() {
         setSelectedGear(NEUTRAL); //We will stay in NEUTRAL until we get at least 40 frames ahead indicating continous communications.
     }
 
-
-    if(!online)  //This routine checks to see if we have received any frames from the inverter.  If so, ONLINE would be true and
-    {   //we set the RUNNING light on.  If no frames are received for 2 seconds, we set running OFF.
-        if ((millis()-CK_milli)>2000)
-        {
-            running=false; // We haven't received any frames for over 2 seconds.  Otherwise online would be true.
-            CK_milli=millis();   //Reset our 2 second timer
-        }
-    }
-    else running=true;
-    online=false;//This flag will be set to 1 by received frames.
-
     sendPowerCmd();
 }
 
@@ -186,7 +186,7 @@ void CKMotorController::sendPowerCmd() {
 	
 	Logger::debug("CKInverter Sent Frame: %X  %X  %X  %X  %X  %X  %X  %X  %X", output.id, output.data.bytes[0] , output.data.bytes[1], output.data.bytes[2], output.data.bytes[3], output.data.bytes[4], output.data.bytes[5], output.data.bytes[6]);
 
-    canHandlerEv.sendFrame(output);
+    canHandlerEv.sendFrame(output, CAN_TX_PRIORITY_HIGH);
 }
 
 //just a bog standard CRC8 calculation with custom generator byte. Good enough.
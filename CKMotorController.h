@@ -50,7 +50,9 @@ public:
 
 public:
     virtual void handleTick();
-    virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanFrame(const CAN_FRAME *frame);
+    virtual void handleCanTimeout(int8_t watch);
+    virtual void handleCanRecovery(int8_t watch);
     virtual void setup();
     void setGear(Gears gear);
 
@@ -64,7 +66,7 @@ public:
 private:
 
     OperationState actualState; //what the controller is reporting it is    
-    byte online; //counter for whether controller appears to be operating
+    int8_t rxWatch; // handle of the watch on the frames from the inverter
     int activityCount;
 	uint8_t aliveCounter;
     void timestamp();
@@ -77,7 +77,7 @@ void CanBrake::setup() {
     }
 
     canHandlerCar.attach(this, responseId, responseMask, responseExtended);
-    tickHandler.attach(this, CFG_TICK_INTERVAL_CAN_THROTTLE);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_CAN_THROTTLE), TICK_PRIORITY_CONTROL);
 }
 
 /*
@@ -97,7 +97,7 @@ void CanBrake::handleTick() {
  * Handle the response of the ECU and calculate the throttle value
  *
  */
-void CanBrake::handleCanFrame(CAN_FRAME *frame) {
+void CanBrake::handleCanFrame(const CAN_FRAME *frame) {
     CanBrakeConfiguration *config = (CanBrakeConfiguration *)getConfiguration();
 
     if (frame->id == responseId) {
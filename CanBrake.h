@@ -46,7 +46,7 @@ public:
     CanBrake();
     void setup();
     void handleTick();
-    void handleCanFrame(CAN_FRAME *frame);
+    void handleCanFrame(const CAN_FRAME *frame);
     DeviceId getId();
     DeviceType getType();
 
@@ -28,301 +28,1541 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
 #include "CanHandler.h"
+#include "LoadMonitor.h"
+#include "InputTrace.h"
+#include "PrefHandler.h"
+
+extern PrefHandler *sysPrefs;
 
 CanHandler canHandlerEv = CanHandler(CanHandler::CAN_BUS_EV);
 CanHandler canHandlerCar = CanHandler(CanHandler::CAN_BUS_CAR);
 
 /*
- * Constructor of the can handler
+ * Constructor of the can handler
+ */
+CanHandler::CanHandler(CanBusNode canBusNode)
+{
+    this->canBusNode = canBusNode;
+
+    // assign the correct bus instance to the pointer
+    if (canBusNode == CAN_BUS_CAR) {
+        bus = &CAN2;
+    } else {
+        bus = &CAN;
+    }
+
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        observerData[i].observer = NULL;
+    }
+    numRxMailboxes = (canBusNode == CAN_BUS_EV ? CFG_CAN0_NUM_RX_MAILBOXES : CFG_CAN1_NUM_RX_MAILBOXES);
+    numFilters = 0;
+    busInitialized = false;
+    buildDispatchIndex();
+    rxHead = rxTail = 0;
+    txQueueSize = 0;
+    txSequence = 0;
+    for (int i = 0; i < CFG_CAN_NUM_CYCLIC_MESSAGES; i++) {
+        cyclicMessages[i].canHandler = this;
+    }
+    for (int i = 0; i < CFG_CAN_GATEWAY_RULES; i++) {
+        gatewayRules[i].active = false;
+    }
+    numGatewayRules = 0;
+    for (int i = 0; i < CFG_CAN_NUM_WATCHES; i++) {
+        watches[i].active = false;
+    }
+    numWatches = 0;
+    watchTicker.canHandler = this;
+    monitorTicker.canHandler = this;
+    setBusSpeed(canBusNode == CAN_BUS_EV ? CFG_CAN0_SPEED : CFG_CAN1_SPEED);
+    resetRxStatistics();
+    resetTxStatistics();
+    resetBusStatistics();
+    masterID = 0x05;
+}
+
+/*
+ * Initialization of the CAN bus
+ */
+void CanHandler::setup()
+{
+    uint8_t busNumber = (canBusNode == CAN_BUS_EV ? 0 : 1);
+    uint16_t baud;
+
+    tickHandler.detach(&monitorTicker);
+
+    // the bit rate is configured in kbit/s in the system EEPROM, 0 disables the bus
+    sysPrefs->read(canBusNode == CAN_BUS_EV ? EESYS_CAN0_BAUD : EESYS_CAN1_BAUD, &baud);
+    if (baud == 0) {
+        if (busInitialized) {
+            bus->disable();
+            busInitialized = false;
+        }
+        Logger::info("CAN%d disabled", busNumber);
+        return;
+    }
+    if (baud > CAN_MAX_SPEED_KBPS) {
+        Logger::warn("CAN%d: invalid bit rate %dk in EEPROM, using %lk", busNumber, baud, (canBusNode == CAN_BUS_EV ? CFG_CAN0_SPEED : CFG_CAN1_SPEED) / 1000);
+        setBusSpeed(canBusNode == CAN_BUS_EV ? CFG_CAN0_SPEED : CFG_CAN1_SPEED);
+    } else {
+        setBusSpeed(baud * 1000ul);
+    }
+
+    // Initialize the canbus at the specified baudrate (this also resets the mailboxes, so a running bus is re-initialized)
+    busInitialized = false;
+    if (!bus->begin(busSpeed, 255)) {
+        Logger::error("CAN%d: no bit timing for %l bit/s", busNumber, busSpeed);
+        return;
+    }
+    bus->setNumTXBoxes(CANMB_NUMBER - numRxMailboxes);
+    bus->setGeneralCallback(canBusNode == CAN_BUS_EV ? canRxInterruptEv : canRxInterruptCar);
+
+    // the receive mailboxes are only enabled when the filter planner assigns them a filter
+    for (uint8_t i = 0; i < numRxMailboxes; i++) {
+        bus->mailbox_set_mode(i, CAN_MB_DISABLE_MODE);
+    }
+    numFilters = 0;
+    busInitialized = true;
+    updateFilters();
+    tickHandler.attach(&monitorTicker, CFG_TICK_INTERVAL_CAN_MONITOR, TICK_PRIORITY_BACKGROUND);
+
+    BitTiming timing;
+    getBitTiming(timing);
+    Logger::info("CAN%d init ok, %l bit/s (%d tq of %d clocks, sample point %f%%)", busNumber, timing.bitRate,
+            timing.quanta, timing.prescaler, (float) timing.samplePoint / 10.0f);
+    if (timing.bitRate != busSpeed) {
+        Logger::warn("CAN%d: bit rate differs from the configured %l bit/s", busNumber, busSpeed);
+    }
+}
+
+/*
+ * Set the bit rate and the values which depend on it. Takes effect with the next setup().
+ */
+void CanHandler::setBusSpeed(uint32_t speed)
+{
+    busSpeed = speed;
+    bitTimeNs = 1000000000ul / busSpeed;
+    hwTimestampRange = (uint32_t) (32768ull * 1000000 / busSpeed); // half the range of the 16 bit timer
+}
+
+/*
+ * Attach a CanObserver. Can frames which match the id/mask will be forwarded to the observer
+ * via the method handleCanFrame(RX_CAN_FRAME).
+ * The hardware filters of the receive mailboxes are re-planned to cover the new subscription.
+ * CANopen observers must set their node id and CANopen mode before attaching.
+ *
+ *  \param observer - the observer object to register (must implement CanObserver class)
+ *  \param id - the id of the can frame to listen to
+ *  \param mask - the mask to be applied to the frames
+ *  \param extended - set if extended frames must be supported
+ *  \param onChange - if set, a frame is only delivered if its payload differs from the previous
+ *         frame with the same id (the frames still feed the statistics and watches)
+ */
+void CanHandler::attach(CanObserver* observer, uint32_t id, uint32_t mask, bool extended, bool onChange)
+{
+    int8_t pos = findFreeObserverData();
+
+    if (pos == -1) {
+        Logger::error("no free space in CanHandler::observerData, increase its size via CFG_CAN_NUM_OBSERVERS");
+        return;
+    }
+
+    observerData[pos].id = id;
+    observerData[pos].mask = mask;
+    observerData[pos].extended = extended;
+    observerData[pos].canOpen = observer->isCANOpen();
+    observerData[pos].nodeID = observer->getNodeID();
+    observerData[pos].onChange = onChange;
+    observerData[pos].observer = observer;
+    buildDispatchIndex();
+    updateFilters();
+    if (onChange) {
+        invalidatePayloads(); // the new observer must get the current payload
+    }
+
+    Logger::debug("attached CanObserver (%X) for id=%X, mask=%X, mailbox=%d", observer, id, mask, observerData[pos].mailbox);
+}
+
+/*
+ * Detaches a previously attached observer from this handler.
+ *
+ * \param observer - observer object to detach
+ * \param id - id of the observer to detach (required as one CanObserver may register itself several times)
+ * \param mask - mask of the observer to detach (dito)
+ */
+void CanHandler::detach(CanObserver* observer, uint32_t id, uint32_t mask)
+{
+    bool removed = false;
+
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        if (observerData[i].observer == observer &&
+                observerData[i].id == id &&
+                observerData[i].mask == mask) {
+            observerData[i].observer = NULL;
+            removed = true;
+        }
+    }
+    if (removed) {
+        buildDispatchIndex();
+        updateFilters();
+    }
+}
+
+/*
+ * Logs the content of a received can frame
+ *
+ * \param frame - the received can frame to log
+ */
+void CanHandler::logFrame(const CAN_FRAME& frame)
+{
+    if (Logger::isDebug()) {
+        Logger::debug("CAN: dlc=%X fid=%X id=%X ide=%X rtr=%X data=%X,%X,%X,%X,%X,%X,%X,%X",
+                      frame.length, frame.fid, frame.id, frame.extended, frame.rtr,
+                      frame.data.bytes[0], frame.data.bytes[1], frame.data.bytes[2], frame.data.bytes[3],
+                      frame.data.bytes[4], frame.data.bytes[5], frame.data.bytes[6], frame.data.bytes[7]);
+    }
+}
+
+/*
+ * Find a observerData entry which is not in use.
+ *
+ * \retval array index of the next unused entry in observerData[]
+ */
+int8_t CanHandler::findFreeObserverData()
+{
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        if (observerData[i].observer == NULL) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Remove all filters of a plan which are covered by another filter of the plan
+ * (same frame type, the other filter compares a subset of the bits and these agree).
+ */
+void CanHandler::removeCoveredFilters(HardwareFilter *plan, uint8_t &count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        for (uint8_t j = 0; j < count; j++) {
+            if (i != j && plan[i].extended == plan[j].extended && (plan[i].mask & ~plan[j].mask) == 0
+                    && (plan[j].id & plan[i].mask) == plan[i].id) {
+                plan[j] = plan[--count]; // j is covered by i
+                if (i == count) {
+                    i = j;
+                }
+                j--;
+            }
+        }
+    }
+}
+
+/*
+ * Calculate the smallest set of hardware filters which covers the subscriptions of
+ * all attached observers and fits into the receive mailboxes.
+ * Covered subscriptions are dropped, pairs which differ in a single id bit are merged
+ * without accepting additional ids. If there are still more filters than mailboxes,
+ * the pair whose merged filter compares the most bits (i.e. lets the fewest unwanted
+ * ids pass) is merged until they fit. The exact matching is left to the software dispatch.
+ *
+ * \retval the number of filters in plan
+ */
+uint8_t CanHandler::planFilters(HardwareFilter *plan)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        if (observerData[i].observer != NULL) {
+            HardwareFilter *filter = &plan[count++];
+            filter->extended = observerData[i].extended;
+            filter->mask = observerData[i].mask & (filter->extended ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK);
+            filter->id = observerData[i].id & filter->mask;
+        }
+    }
+    for (uint8_t i = 0; i < CFG_CAN_GATEWAY_RULES; i++) {
+        if (gatewayRules[i].active) {
+            HardwareFilter *filter = &plan[count++];
+            filter->extended = gatewayRules[i].rule.extended;
+            filter->mask = gatewayRules[i].rule.mask & (filter->extended ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK);
+            filter->id = gatewayRules[i].rule.id & filter->mask;
+        }
+    }
+    removeCoveredFilters(plan, count);
+
+    while (true) {
+        int8_t bestA = -1, bestB = -1;
+        int8_t bestBits = -1;
+        bool lossless = false;
+
+        for (uint8_t a = 0; a < count && !lossless; a++) {
+            for (uint8_t b = a + 1; b < count; b++) {
+                if (plan[a].extended != plan[b].extended) {
+                    continue;
+                }
+                uint32_t mask = plan[a].mask & plan[b].mask & ~(plan[a].id ^ plan[b].id);
+                if (plan[a].mask == plan[b].mask && __builtin_popcount(plan[a].mask & ~mask) == 1) {
+                    bestA = a; // the union of both is exactly the merged filter
+                    bestB = b;
+                    lossless = true;
+                    break;
+                }
+                int8_t bits = __builtin_popcount(mask);
+                if (bits > bestBits) {
+                    bestA = a;
+                    bestB = b;
+                    bestBits = bits;
+                }
+            }
+        }
+        if (bestA == -1 || (!lossless && count <= numRxMailboxes)) {
+            break;
+        }
+        plan[bestA].mask &= plan[bestB].mask & ~(plan[bestA].id ^ plan[bestB].id);
+        plan[bestA].id &= plan[bestA].mask;
+        plan[bestB] = plan[--count];
+        removeCoveredFilters(plan, count);
+    }
+    return count;
+}
+
+/*
+ * Re-plan the hardware filters and re-program the receive mailboxes which changed.
+ * Unused mailboxes are disabled so they don't interrupt the CPU.
+ */
+void CanHandler::updateFilters()
+{
+    HardwareFilter plan[CFG_CAN_NUM_OBSERVERS + CFG_CAN_GATEWAY_RULES];
+    uint8_t count = planFilters(plan);
+
+    if (count > numRxMailboxes) {
+        Logger::error("CAN%d: not enough mailboxes for the %d filters (standard and extended frames can't share one)",
+                (canBusNode == CAN_BUS_EV ? 0 : 1), count);
+        count = numRxMailboxes;
+    }
+
+    for (uint8_t i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        observerData[i].mailbox = 0xFF;
+        for (uint8_t j = 0; j < count && observerData[i].observer != NULL; j++) {
+            if (plan[j].extended == observerData[i].extended && (observerData[i].id & plan[j].mask) == plan[j].id
+                    && (plan[j].mask & ~observerData[i].mask) == 0) {
+                observerData[i].mailbox = j;
+                break;
+            }
+        }
+    }
+
+    if (!busInitialized) {
+        return;
+    }
+    for (uint8_t i = 0; i < numRxMailboxes; i++) {
+        if (i < count) {
+            if (i < numFilters && filters[i].id == plan[i].id && filters[i].mask == plan[i].mask && filters[i].extended == plan[i].extended) {
+                continue;
+            }
+            bus->mailbox_set_mode(i, CAN_MB_DISABLE_MODE);
+            bus->setRXFilter(i, plan[i].id, plan[i].mask, plan[i].extended);
+            bus->mailbox_set_mode(i, CAN_MB_RX_MODE);
+            filters[i] = plan[i];
+            Logger::debug("CAN%d mailbox %d: id=%X, mask=%X, extended=%d", (canBusNode == CAN_BUS_EV ? 0 : 1), i, plan[i].id,
+                    plan[i].mask, plan[i].extended);
+        } else if (i < numFilters) {
+            bus->mailbox_set_mode(i, CAN_MB_DISABLE_MODE);
+        }
+    }
+    numFilters = count;
+}
+
+/*
+ * Check if an observerData entry wants to receive a frame with the given id.
+ * Raw observers match if the masked ids are equal, CANopen observers receive
+ * all PDO's and the SDO requests/responses of their node id.
+ */
+bool CanHandler::matches(uint8_t entry, uint32_t id, bool extended)
+{
+    CanObserverData *data = &observerData[entry];
+
+    if (data->observer == NULL) {
+        return false;
+    }
+    if (data->canOpen) {
+        return !extended && ((id > 0x17F && id < 0x580) || id == 0x600 + (uint32_t) data->nodeID || id == 0x580 + (uint32_t) data->nodeID);
+    }
+    return data->extended == extended && (id & data->mask) == (data->id & data->mask);
+}
+
+/*
+ * Return a bit mask of all observerData entries which match the id.
+ */
+uint32_t CanHandler::scanObservers(uint32_t id, bool extended)
+{
+    uint32_t observers = 0;
+
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        if (matches(i, id, extended)) {
+            observers |= (1UL << i);
+        }
+    }
+    return observers;
+}
+
+/*
+ * Find the index of a set of observers in observerSets, add it if it's new.
+ *
+ * \retval the index or CAN_OBSERVER_SET_SCAN if the table is full
+ */
+uint8_t CanHandler::findObserverSet(uint32_t observers)
+{
+    for (uint8_t i = 0; i < numObserverSets; i++) {
+        if (observerSets[i] == observers) {
+            return i;
+        }
+    }
+    if (numObserverSets >= CAN_MAX_OBSERVER_SETS) {
+        return CAN_OBSERVER_SET_SCAN;
+    }
+    observerSets[numObserverSets] = observers;
+    return numObserverSets++;
+}
+
+/*
+ * Re-build the dispatch index after an observer was attached or detached.
+ * Every 11-bit id gets the index of the set of observers it must be forwarded to,
+ * the cache for extended ids is cleared.
+ */
+void CanHandler::buildDispatchIndex()
+{
+    bool overflow = false;
+
+    observerSets[0] = 0;
+    numObserverSets = 1;
+    onChangeObservers = 0;
+    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
+        if (observerData[i].observer != NULL && observerData[i].onChange) {
+            onChangeObservers |= 1 << i;
+        }
+    }
+    for (uint32_t id = 0; id < CAN_NUM_STD_IDS; id++) {
+        stdIdIndex[id] = findObserverSet(scanObservers(id, false));
+        if (stdIdIndex[id] == CAN_OBSERVER_SET_SCAN) {
+            overflow = true;
+        }
+    }
+    for (int i = 0; i < CAN_EXT_CACHE_SIZE; i++) {
+        extendedCache[i].valid = false;
+    }
+    if (overflow) {
+        Logger::warn("CAN%d dispatch index full, some ids are dispatched by scanning", (canBusNode == CAN_BUS_EV ? 0 : 1));
+    }
+}
+
+/*
+ * Look up the observers of a received frame: a direct table access for
+ * standard frames, a small direct mapped cache for extended frames.
+ */
+uint32_t CanHandler::findObservers(const CAN_FRAME &frame)
+{
+    if (!frame.extended) {
+        uint8_t set = stdIdIndex[frame.id & (CAN_NUM_STD_IDS - 1)];
+        return (set == CAN_OBSERVER_SET_SCAN ? scanObservers(frame.id, false) : observerSets[set]);
+    }
+
+    ExtendedCacheEntry *entry = &extendedCache[(frame.id ^ (frame.id >> 11) ^ (frame.id >> 22)) & (CAN_EXT_CACHE_SIZE - 1)];
+    if (!entry->valid || entry->id != frame.id) {
+        entry->id = frame.id;
+        entry->observers = scanObservers(frame.id, true);
+        entry->valid = true;
+    }
+    return entry->observers;
+}
+
+/*
+ * Process up to CFG_CAN_RX_BATCH received frames of this bus.
+ */
+void CanHandler::process()
+{
+    for (int i = 0; i < CFG_CAN_RX_BATCH && processFrame(); i++);
+}
+
+/*
+ * Process the received frames of both buses, alternating between them so a
+ * busy bus can't starve the other one. Up to CFG_CAN_RX_BATCH frames per bus
+ * are processed, the rest is left for the next call.
+ */
+void CanHandler::processAll()
+{
+    canHandlerEv.processTxQueue();
+    canHandlerCar.processTxQueue();
+    for (int i = 0; i < CFG_CAN_RX_BATCH; i++) {
+        bool ev = canHandlerEv.processFrame();
+        bool car = canHandlerCar.processFrame();
+        if (!ev && !car) {
+            break;
+        }
+    }
+}
+
+/*
+ * Called from the CAN interrupt for every received frame. Copies the frame
+ * into the receive ring and signals loop() to process it.
+ */
+void CanHandler::receiveFrame(CAN_FRAME *frame)
+{
+    uint32_t timestamp = micros();
+    if (numGatewayRules > 0) {
+        forwardFrame(*frame, timestamp);
+    }
+    storeFrame(*frame, timestamp);
+    sendQueuedFrames(); // a good opportunity to re-fill the transmit mailboxes
+    loadMonitor.setEvent(EVENT_CAN);
+}
+
+/*
+ * Feed a frame into the receive ring as if it had been received at the given
+ * time (micros()), e.g. when a trace is replayed.
+ */
+void CanHandler::injectFrame(const CAN_FRAME &frame, uint32_t timestamp)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq(); // the interrupt is the only producer of the ring otherwise
+    if (numGatewayRules > 0) {
+        forwardFrame(frame, timestamp);
+    }
+    storeFrame(frame, timestamp);
+    __set_PRIMASK(primask);
+    loadMonitor.setEvent(EVENT_CAN);
+}
+
+/*
+ * Copy a frame into the receive ring. Must be called from the CAN interrupt
+ * or with interrupts disabled.
+ */
+void CanHandler::storeFrame(const CAN_FRAME &frame, uint32_t timestamp)
+{
+    uint16_t next = (rxHead + 1) % CFG_CAN_RX_BUFFER_SIZE;
+    busBits += frameBits(frame);
+    if (next == rxTail) {
+        rxOverrunCount++;
+        return;
+    }
+    rxBuffer[rxHead].frame = frame;
+    rxBuffer[rxHead].timestamp = timestamp;
+    __DMB(); // the slot must be complete before it's published
+    rxHead = next;
+
+    uint16_t waiting = (next + CFG_CAN_RX_BUFFER_SIZE - rxTail) % CFG_CAN_RX_BUFFER_SIZE;
+    if (waiting > rxHighWater) {
+        rxHighWater = waiting;
+    }
+}
+
+/*
+ * If a message is available, forward it to registered observers.
+ * The observers get a pointer into the receive ring, the slot is only
+ * released after all of them have been called. So the frame is not copied
+ * and can't be modified for the following observers.
+ * CANopen SDO frames are decoded only once, no matter how many observers receive them.
+ *
+ * \retval true if a frame was processed
+ */
+bool CanHandler::processFrame()
+{
+    static SDO_FRAME sFrame;
+
+    if (rxHead == rxTail) {
+        return false;
+    }
+    __DMB(); // don't read the slot before it was published
+    const CanRxSlot &slot = rxBuffer[rxTail];
+    const CAN_FRAME &frame = slot.frame;
+    rxTimestamp = slot.timestamp;
+    rxFrameCount++;
+    IdMonitorEntry *monitor = recordRxFrame(frame, rxTimestamp);
+    if (numWatches > 0) {
+        updateWatches(frame, rxTimestamp);
+    }
+    if (traceRecorder.isRecording()) {
+        traceRecorder.recordCanFrame(canBusNode == CAN_BUS_CAR, frame, rxTimestamp);
+    }
+//  logFrame(frame);
+
+    uint32_t observers = findObservers(frame);
+    bool sdoDecoded = false;
+
+    if ((observers & onChangeObservers) != 0 && !payloadChanged(monitor, frame)) {
+        observers &= ~onChangeObservers;
+        monitor->suppressed++;
+    }
+
+    while (observers != 0) {
+        uint8_t i = __builtin_ctz(observers);
+        observers &= observers - 1;
+
+        CanObserver *observer = observerData[i].observer;
+        if (observer == NULL) { // detached by a previous observer
+            continue;
+        }
+
+        if (observerData[i].canOpen) {
+            if (frame.id > 0x17F && frame.id < 0x580) {
+                observer->handlePDOFrame(&frame);
+                continue;
+            }
+            if (!sdoDecoded) {
+                sFrame.nodeID = observerData[i].nodeID;
+                sFrame.index = frame.data.byte[1] + (frame.data.byte[2] * 256);
+                sFrame.subIndex = frame.data.byte[3];
+                sFrame.cmd = (SDO_COMMAND)(frame.data.byte[0] & 0xF0);
+
+                if ((frame.data.byte[0] != 0x40) && (frame.data.byte[0] != 0x60)) {
+                    sFrame.dataLength = (3 - ((frame.data.byte[0] & 0xC) >> 2)) + 1;
+                }
+                else sFrame.dataLength = 0;
+
+                for (int x = 0; x < sFrame.dataLength; x++) sFrame.data[x] = frame.data.byte[4 + x];
+                sdoDecoded = true;
+            }
+            if (frame.id == 0x600 + (uint32_t) observerData[i].nodeID) { //SDO request targetted to our ID
+                observer->handleSDORequest(&sFrame);
+            } else { //SDO reply to our ID
+                observer->handleSDOResponse(&sFrame);
+            }
+        } else { //raw canbus
+            observer->handleCanFrame(&frame);
+        }
+    }
+
+    __DMB(); // all observers are done with the slot before it's released to the interrupt
+    rxTail = (rxTail + 1) % CFG_CAN_RX_BUFFER_SIZE;
+    return true;
+}
+
+/*
+ * Returns true if received frames are waiting to be processed.
+ */
+bool CanHandler::isFrameAvailable()
+{
+    return rxHead != rxTail;
+}
+
+/*
+ * The time (micros()) at which the frame which is currently passed to the
+ * observers was received. Only valid while called from one of the handle methods.
+ */
+uint32_t CanHandler::getRxTimestamp()
+{
+    return rxTimestamp;
+}
+
+/*
+ * Number of received frames which were processed.
+ */
+uint32_t CanHandler::getRxFrameCount()
+{
+    return rxFrameCount;
+}
+
+/*
+ * The maximum number of frames which were waiting in the receive ring.
+ */
+uint16_t CanHandler::getRxHighWater()
+{
+    return rxHighWater;
+}
+
+/*
+ * Number of received frames which were dropped because the receive ring was full.
+ */
+uint32_t CanHandler::getRxOverrunCount()
+{
+    return rxOverrunCount;
+}
+
+/*
+ * Number of receive mailboxes which are programmed with a filter.
+ */
+uint8_t CanHandler::getUsedMailboxes()
+{
+    return numFilters;
+}
+
+uint8_t CanHandler::getNumRxMailboxes()
+{
+    return numRxMailboxes;
+}
+
+/*
+ * The baud rate of the bus in bits per second.
+ */
+uint32_t CanHandler::getBusSpeed()
+{
+    return busSpeed;
+}
+
+/*
+ * Read back the bit timing which the driver programmed for the requested bit rate.
+ * The rate is derived from MCK, so it may differ slightly from the requested one.
+ *
+ * \retval false if the bus is not initialized
+ */
+bool CanHandler::getBitTiming(BitTiming &timing)
+{
+    if (!busInitialized) {
+        return false;
+    }
+    uint32_t br = (canBusNode == CAN_BUS_EV ? CAN0 : CAN1)->CAN_BR;
+
+    timing.prescaler = ((br & CAN_BR_BRP_Msk) >> CAN_BR_BRP_Pos) + 1;
+    timing.propagation = ((br & CAN_BR_PROPAG_Msk) >> CAN_BR_PROPAG_Pos) + 1;
+    timing.phase1 = ((br & CAN_BR_PHASE1_Msk) >> CAN_BR_PHASE1_Pos) + 1;
+    timing.phase2 = ((br & CAN_BR_PHASE2_Msk) >> CAN_BR_PHASE2_Pos) + 1;
+    timing.sjw = ((br & CAN_BR_SJW_Msk) >> CAN_BR_SJW_Pos) + 1;
+    timing.quanta = 1 + timing.propagation + timing.phase1 + timing.phase2;
+    timing.bitRate = VARIANT_MCK / ((uint32_t) timing.prescaler * timing.quanta);
+    timing.samplePoint = (1 + timing.propagation + timing.phase1) * 1000 / timing.quanta;
+    timing.tripleSample = (br & CAN_BR_SMP);
+    return true;
+}
+
+void CanHandler::resetRxStatistics()
+{
+    noInterrupts();
+    rxFrameCount = 0;
+    rxHighWater = 0;
+    rxOverrunCount = 0;
+    interrupts();
+}
+
+/*
+ * Update the receive statistics of the frame's id. The entry is looked up in
+ * an open addressing hash table with at most CAN_ID_STATS_PROBES probes, so
+ * the cost per frame is constant. Ids which find no entry are only counted.
+ *
+ * The gap to the previous frame of the same id is taken from the timestamps
+ * of the CAN controller when they are precise enough (CFG_CAN_HW_TIMESTAMPS),
+ * so the latency of the interrupt doesn't add to the jitter.
+ *
+ * \retval the entry of the id or NULL if it found no entry
+ */
+CanHandler::IdMonitorEntry *CanHandler::recordRxFrame(const CAN_FRAME &frame, uint32_t timestamp)
+{
+    uint32_t key = (frame.extended ? (frame.id & CAN_EXT_ID_MASK) | CAN_ID_EXTENDED_FLAG : frame.id & CAN_STD_ID_MASK);
+    if (key == 0) {
+        key = CAN_ID_KEY_ZERO;
+    }
+    uint32_t hash = (key ^ (key >> 7) ^ (key >> 14)) & (CFG_CAN_ID_STATS_SIZE - 1);
+    IdMonitorEntry *entry = NULL;
+
+    for (uint8_t i = 0; i < CAN_ID_STATS_PROBES; i++) {
+        IdMonitorEntry *candidate = &idMonitor[(hash + i) & (CFG_CAN_ID_STATS_SIZE - 1)];
+        if (candidate->key == key) {
+            entry = candidate;
+            break;
+        }
+        if (candidate->key == 0) {
+            entry = candidate;
+            entry->key = key;
+            break;
+        }
+    }
+    if (entry == NULL) {
+        untrackedFrames++;
+        return NULL;
+    }
+
+    if (entry->count > 0) {
+        uint32_t gap = timestamp - entry->lastTimestamp;
+#ifdef CFG_CAN_HW_TIMESTAMPS
+        if (gap < hwTimestampRange) {
+            gap = (uint16_t) (frame.time - entry->lastTime) * bitTimeNs / 1000;
+        }
+#endif
+        if (entry->count > 1) {
+            uint32_t deviation = (gap > entry->lastGap ? gap - entry->lastGap : entry->lastGap - gap);
+            entry->jitter += deviation - ((entry->jitter + 8) >> 4);
+        }
+        if (gap > entry->maxGap) {
+            entry->maxGap = gap;
+        }
+        entry->totalGap += gap;
+        entry->lastGap = gap;
+    }
+    entry->count++;
+    entry->lastTimestamp = timestamp;
+    entry->lastTime = frame.time;
+    return entry;
+}
+
+/*
+ * Compare the payload of a frame with the previous one of the same id and
+ * remember it. Only the first length bytes are compared. Frames of ids which
+ * found no entry in idMonitor always count as changed.
+ *
+ * \retval true if the on-change observers must receive the frame
+ */
+bool CanHandler::payloadChanged(IdMonitorEntry *entry, const CAN_FRAME &frame)
+{
+    if (entry == NULL) {
+        return true;
+    }
+    uint8_t length = (frame.length > 8 ? 8 : frame.length);
+    uint8_t format = length | (frame.rtr ? 0x80 : 0);
+    uint64_t payload = (length == 8 ? frame.data.value : frame.data.value & ((1ULL << (length * 8)) - 1));
+
+    if (entry->payloadValid && entry->lastFormat == format && entry->lastPayload == payload) {
+        return false;
+    }
+    entry->payloadValid = true;
+    entry->lastFormat = format;
+    entry->lastPayload = payload;
+    return true;
+}
+
+/*
+ * Forget the remembered payloads, so the next frame of every id is delivered to the on-change observers.
+ */
+void CanHandler::invalidatePayloads()
+{
+    for (int i = 0; i < CFG_CAN_ID_STATS_SIZE; i++) {
+        idMonitor[i].payloadValid = false;
+    }
+}
+
+/*
+ * Number of bits a frame occupies on the bus including the interframe space,
+ * assuming the worst case of bit stuffing.
+ */
+uint16_t CanHandler::frameBits(const CAN_FRAME &frame)
+{
+    uint8_t dataBits = (frame.rtr ? 0 : min(frame.length, 8) * 8);
+    if (frame.extended) {
+        return 67 + dataBits + (54 + dataBits - 1) / 4;
+    }
+    return 47 + dataBits + (34 + dataBits - 1) / 4;
+}
+
+/*
+ * Close the bus load measurement window when it's over and poll the error
+ * state of the controller. Called by the monitorTicker (not from processAll()
+ * as a bus-off or silent bus raises no EVENT_CAN), bus-off periods which end
+ * between two calls are only visible in the error counter maxima.
+ */
+void CanHandler::monitorBus()
+{
+    if (!busInitialized) {
+        return;
+    }
+    uint32_t now = micros();
+    uint32_t elapsed = now - loadWindowStart;
+
+    if (elapsed >= CAN_BUS_LOAD_WINDOW) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint32_t bits = busBits;
+        busBits = 0;
+        __set_PRIMASK(primask);
+
+        loadWindowStart = now;
+        busLoad = min((uint64_t) bits * 1000 * 1000000 / ((uint64_t) busSpeed * elapsed), 1000);
+        if (busLoad > peakBusLoad) {
+            peakBusLoad = busLoad;
+        }
+    }
+
+    uint32_t status = bus->get_status();
+    uint8_t txErrors = bus->get_tx_error_cnt();
+    uint8_t rxErrors = bus->get_rx_error_cnt();
+    if (txErrors > maxTxErrors) {
+        maxTxErrors = txErrors;
+    }
+    if (rxErrors > maxRxErrors) {
+        maxRxErrors = rxErrors;
+    }
+    if ((status & CAN_SR_BOFF) && !busOff) {
+        busOffCount++;
+        Logger::warn("CAN%d is bus-off", (canBusNode == CAN_BUS_EV ? 0 : 1));
+    }
+    if ((status & CAN_SR_ERRP) && !errorPassive) {
+        errorPassiveCount++;
+    }
+    busOff = (status & CAN_SR_BOFF);
+    errorPassive = (status & CAN_SR_ERRP);
+}
+
+/*
+ * Copy the receive statistics of all received can id's.
+ *
+ * \retval the number of entries copied
+ */
+uint8_t CanHandler::getIdStatistics(IdStatistics *statistics, uint8_t maxEntries)
+{
+    uint8_t count = 0;
+
+    for (int i = 0; i < CFG_CAN_ID_STATS_SIZE && count < maxEntries; i++) {
+        IdMonitorEntry *entry = &idMonitor[i];
+        if (entry->key == 0) {
+            continue;
+        }
+        IdStatistics *stats = &statistics[count++];
+        stats->id = (entry->key == CAN_ID_KEY_ZERO ? 0 : entry->key & CAN_EXT_ID_MASK);
+        stats->extended = (entry->key & CAN_ID_EXTENDED_FLAG);
+        stats->count = entry->count;
+        stats->avgGap = (entry->count > 1 ? entry->totalGap / (entry->count - 1) : 0);
+        stats->maxGap = entry->maxGap;
+        stats->jitter = entry->jitter >> 4;
+        stats->suppressed = entry->suppressed;
+    }
+    return count;
+}
+
+void CanHandler::getBusStatistics(BusStatistics &statistics)
+{
+    statistics.load = busLoad;
+    statistics.peakLoad = peakBusLoad;
+    statistics.txErrors = bus->get_tx_error_cnt();
+    statistics.rxErrors = bus->get_rx_error_cnt();
+    statistics.maxTxErrors = maxTxErrors;
+    statistics.maxRxErrors = maxRxErrors;
+    statistics.busOff = busOff;
+    statistics.errorPassive = errorPassive;
+    statistics.busOffCount = busOffCount;
+    statistics.errorPassiveCount = errorPassiveCount;
+    statistics.untrackedFrames = untrackedFrames;
+}
+
+/*
+ * Reset the per id receive statistics, the bus load and the error maxima.
+ */
+void CanHandler::resetBusStatistics()
+{
+    for (int i = 0; i < CFG_CAN_ID_STATS_SIZE; i++) {
+        idMonitor[i].key = 0;
+        idMonitor[i].count = 0;
+        idMonitor[i].lastGap = 0;
+        idMonitor[i].maxGap = 0;
+        idMonitor[i].totalGap = 0;
+        idMonitor[i].jitter = 0;
+        idMonitor[i].payloadValid = false;
+        idMonitor[i].suppressed = 0;
+    }
+    untrackedFrames = 0;
+    busBits = 0;
+    loadWindowStart = micros();
+    busLoad = peakBusLoad = 0;
+    maxTxErrors = maxRxErrors = 0;
+    busOff = errorPassive = false;
+    busOffCount = errorPassiveCount = 0;
+}
+
+/*
+ * Watch frames which are expected periodically. If no matching frame is received
+ * for period * (maxMissed + 1) microseconds, the observer's handleCanTimeout() is
+ * called (with a delay of max CFG_TICK_INTERVAL_CAN_WATCH), the next frame then
+ * triggers handleCanRecovery(). Until the first frame is received the id is stale,
+ * without a timeout being reported.
+ *
+ * \retval the handle of the watch or -1 if all CFG_CAN_NUM_WATCHES are in use
+ */
+int8_t CanHandler::watchFrames(uint32_t id, uint32_t mask, bool extended, uint32_t period, uint8_t maxMissed, CanObserver *observer)
+{
+    for (int8_t i = 0; i < CFG_CAN_NUM_WATCHES; i++) {
+        WatchEntry *watch = &watches[i];
+        if (!watch->active) {
+            watch->id = id;
+            watch->mask = mask;
+            watch->extended = extended;
+            watch->timeout = period * (maxMissed + 1);
+            watch->lastSeen = micros();
+            watch->seen = false;
+            watch->stale = true;
+            watch->observer = observer;
+            watch->active = true;
+            if (numWatches++ == 0) {
+                nextWatchDeadline = watch->lastSeen + watch->timeout;
+                tickHandler.attach(&watchTicker, CFG_TICK_INTERVAL_CAN_WATCH, TICK_PRIORITY_CONTROL);
+            } else if ((int32_t) (watch->lastSeen + watch->timeout - nextWatchDeadline) < 0) {
+                nextWatchDeadline = watch->lastSeen + watch->timeout;
+            }
+            return i;
+        }
+    }
+    Logger::error("no free CAN watch, increase CFG_CAN_NUM_WATCHES");
+    return -1;
+}
+
+void CanHandler::unwatchFrames(int8_t watch)
+{
+    if (watch < 0 || watch >= CFG_CAN_NUM_WATCHES || !watches[watch].active) {
+        return;
+    }
+    watches[watch].active = false;
+    if (--numWatches == 0) {
+        tickHandler.detach(&watchTicker);
+    }
+}
+
+/*
+ * Returns true if a matching frame was received within the timeout of the watch.
+ */
+bool CanHandler::isFresh(int8_t watch)
+{
+    if (watch < 0 || watch >= CFG_CAN_NUM_WATCHES || !watches[watch].active) {
+        return false;
+    }
+    return !watches[watch].stale && micros() - watches[watch].lastSeen <= watches[watch].timeout;
+}
+
+/*
+ * Microseconds since the last matching frame was received, 0xFFFFFFFF if none was received yet.
+ */
+uint32_t CanHandler::getFrameAge(int8_t watch)
+{
+    if (watch < 0 || watch >= CFG_CAN_NUM_WATCHES || !watches[watch].active || !watches[watch].seen) {
+        return 0xFFFFFFFF;
+    }
+    return micros() - watches[watch].lastSeen;
+}
+
+/*
+ * Refresh the watches matching a received frame and report recoveries.
+ * Deadlines only move later here, so nextWatchDeadline stays a valid lower bound.
+ */
+void CanHandler::updateWatches(const CAN_FRAME &frame, uint32_t timestamp)
+{
+    for (int8_t i = 0; i < CFG_CAN_NUM_WATCHES; i++) {
+        WatchEntry *watch = &watches[i];
+        if (!watch->active || watch->extended != (frame.extended != 0) || (frame.id & watch->mask) != (watch->id & watch->mask)) {
+            continue;
+        }
+        watch->lastSeen = timestamp;
+        watch->seen = true;
+        if (watch->stale) {
+            watch->stale = false;
+            if (watch->observer != NULL) {
+                watch->observer->handleCanRecovery(i);
+            }
+        }
+    }
+}
+
+/*
+ * Report the watches whose deadline passed. Usually only one comparison,
+ * the watches are only scanned when the earliest deadline is reached.
+ */
+void CanHandler::checkWatchDeadlines()
+{
+    uint32_t now = micros();
+
+    if ((int32_t) (now - nextWatchDeadline) < 0) {
+        return;
+    }
+    nextWatchDeadline = now + 0x7FFFFFFF;
+    for (int8_t i = 0; i < CFG_CAN_NUM_WATCHES; i++) {
+        WatchEntry *watch = &watches[i];
+        if (!watch->active || watch->stale) {
+            continue;
+        }
+        uint32_t deadline = watch->lastSeen + watch->timeout;
+        if ((int32_t) (now - deadline) >= 0) {
+            watch->stale = true;
+            if (watch->observer != NULL) {
+                watch->observer->handleCanTimeout(i);
+            }
+        } else if ((int32_t) (deadline - nextWatchDeadline) < 0) {
+            nextWatchDeadline = deadline;
+        }
+    }
+}
+
+void CanWatchTicker::handleTick()
+{
+    canHandler->checkWatchDeadlines();
+}
+
+void CanMonitorTicker::handleTick()
+{
+    canHandler->monitorBus();
+}
+
+/*
+ * Forward a received frame to the other bus according to the matching gateway
+ * rules. Called from the CAN interrupt, so the frame goes straight into the
+ * transmit queue of the other bus without a round trip through loop().
  */
-CanHandler::CanHandler(CanBusNode canBusNode)
+void CanHandler::forwardFrame(const CAN_FRAME &frame, uint32_t timestamp)
 {
-    this->canBusNode = canBusNode;
+    CanHandler *target = (canBusNode == CAN_BUS_EV ? &canHandlerCar : &canHandlerEv);
 
-    // assign the correct bus instance to the pointer
-    if (canBusNode == CAN_BUS_CAR) {
-        bus = &CAN2;
-    } else {
-        bus = &CAN;
+    for (uint8_t i = 0; i < CFG_CAN_GATEWAY_RULES; i++) {
+        GatewayEntry *entry = &gatewayRules[i];
+        const GatewayRule &rule = entry->rule;
+        if (!entry->active || rule.extended != (frame.extended != 0) || (frame.id & rule.mask) != (rule.id & rule.mask)) {
+            continue;
+        }
+        if (rule.minInterval > 0 && entry->forwardedOnce && timestamp - entry->lastForward < rule.minInterval) {
+            entry->rateLimited++;
+            continue;
+        }
+
+        CAN_FRAME output = frame;
+        if (rule.newId != CAN_GATEWAY_KEEP_ID) {
+            output.id = rule.newId;
+        }
+        if (rule.remap) {
+            for (uint8_t j = 0; j < 8; j++) {
+                uint8_t source = rule.byteMap[j];
+                output.data.bytes[j] = (source < 8 ? frame.data.bytes[source] : 0);
+            }
+        }
+        if (target->queueFrame(output, rule.priority, timestamp, entry)) {
+            entry->forwarded++;
+            entry->lastForward = timestamp;
+            entry->forwardedOnce = true;
+        } else {
+            entry->dropped++;
+        }
     }
+}
 
-    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
-        observerData[i].observer = NULL;
+/*
+ * Add a rule which forwards frames received on this bus to the other bus.
+ * The receive mailboxes are re-planned to accept the frames.
+ *
+ * \retval the handle of the rule or -1 if all CFG_CAN_GATEWAY_RULES are in use
+ */
+int8_t CanHandler::addGatewayRule(const GatewayRule &rule)
+{
+    for (int8_t i = 0; i < CFG_CAN_GATEWAY_RULES; i++) {
+        GatewayEntry *entry = &gatewayRules[i];
+        if (!entry->active) {
+            noInterrupts();
+            entry->rule = rule;
+            entry->forwardedOnce = false;
+            entry->forwarded = entry->rateLimited = entry->dropped = entry->sent = 0;
+            entry->maxLatency = 0;
+            entry->totalLatency = 0;
+            entry->active = true;
+            numGatewayRules++;
+            interrupts();
+            updateFilters();
+            Logger::info("CAN%d gateway: forwarding id=%X, mask=%X", (canBusNode == CAN_BUS_EV ? 0 : 1), rule.id, rule.mask);
+            return i;
+        }
     }
-    masterID = 0x05;
+    Logger::error("no free gateway rule, increase CFG_CAN_GATEWAY_RULES");
+    return -1;
 }
 
 /*
- * Initialization of the CAN bus
+ * Remove a gateway rule. Frames of the rule which are still queued
+ * on the other bus are sent without updating the rule's statistics.
  */
-void CanHandler::setup()
+void CanHandler::removeGatewayRule(int8_t handle)
 {
-    // Initialize the canbus at the specified baudrate
-    bus->begin(canBusNode == CAN_BUS_EV ? CFG_CAN0_SPEED : CFG_CAN1_SPEED, 255);
-    bus->setNumTXBoxes(2);
+    if (handle < 0 || handle >= CFG_CAN_GATEWAY_RULES || !gatewayRules[handle].active) {
+        return;
+    }
+    CanHandler *target = (canBusNode == CAN_BUS_EV ? &canHandlerCar : &canHandlerEv);
 
-    //Mailboxes are default set up initialized with one MB for TX and the rest for RX
-    //That's OK with us so no need to initialize those things there.
+    noInterrupts();
+    gatewayRules[handle].active = false;
+    numGatewayRules--;
+    for (uint8_t i = 0; i < target->txQueueSize; i++) {
+        if (target->txQueue[i].gateway == &gatewayRules[handle]) {
+            target->txQueue[i].gateway = NULL;
+        }
+    }
+    interrupts();
+    updateFilters();
+}
 
-    Logger::info("CAN%d init ok", (canBusNode == CAN_BUS_EV ? 0 : 1));
+void CanHandler::clearGatewayRules()
+{
+    for (int8_t i = 0; i < CFG_CAN_GATEWAY_RULES; i++) {
+        removeGatewayRule(i);
+    }
 }
 
 /*
- * Attach a CanObserver. Can frames which match the id/mask will be forwarded to the observer
- * via the method handleCanFrame(RX_CAN_FRAME).
- * Sets up a can bus mailbox if necessary.
+ * Copy the counters of all active gateway rules.
  *
- *  \param observer - the observer object to register (must implement CanObserver class)
- *  \param id - the id of the can frame to listen to
- *  \param mask - the mask to be applied to the frames
- *  \param extended - set if extended frames must be supported
+ * \retval the number of entries copied
  */
-void CanHandler::attach(CanObserver* observer, uint32_t id, uint32_t mask, bool extended)
+uint8_t CanHandler::getGatewayStatistics(GatewayStatistics *statistics, uint8_t maxEntries)
 {
-    int8_t pos = findFreeObserverData();
+    uint8_t count = 0;
 
-    if (pos == -1) {
-        Logger::error("no free space in CanHandler::observerData, increase its size via CFG_CAN_NUM_OBSERVERS");
-        return;
+    for (uint8_t i = 0; i < CFG_CAN_GATEWAY_RULES && count < maxEntries; i++) {
+        GatewayEntry *entry = &gatewayRules[i];
+        if (!entry->active) {
+            continue;
+        }
+        GatewayStatistics *stats = &statistics[count++];
+        noInterrupts();
+        stats->id = entry->rule.id;
+        stats->mask = entry->rule.mask;
+        stats->newId = entry->rule.newId;
+        stats->forwarded = entry->forwarded;
+        stats->rateLimited = entry->rateLimited;
+        stats->dropped = entry->dropped;
+        stats->maxLatency = entry->maxLatency;
+        stats->avgLatency = (entry->sent > 0 ? entry->totalLatency / entry->sent : 0);
+        interrupts();
     }
+    return count;
+}
 
-    int mailbox = bus->findFreeRXMailbox();
-
-    if (mailbox == -1) {
-        Logger::error("no free CAN mailbox on bus %d", canBusNode);
-        return;
+void CanHandler::resetGatewayStatistics()
+{
+    noInterrupts();
+    for (uint8_t i = 0; i < CFG_CAN_GATEWAY_RULES; i++) {
+        GatewayEntry *entry = &gatewayRules[i];
+        entry->forwarded = entry->rateLimited = entry->dropped = entry->sent = 0;
+        entry->maxLatency = 0;
+        entry->totalLatency = 0;
     }
+    interrupts();
+}
 
-    observerData[pos].id = id;
-    observerData[pos].mask = mask;
-    observerData[pos].extended = extended;
-    observerData[pos].mailbox = mailbox;
-    observerData[pos].observer = observer;
+/*
+ * Prepare the CAN transmit frame.
+ * Re-sets all parameters in the re-used frame.
+ */
+void CanHandler::prepareOutputFrame(CAN_FRAME *frame, uint32_t id)
+{
+    frame->length = 8;
+    frame->id = id;
+    frame->extended = 0;
+    frame->rtr = 0;
 
-    bus->setRXFilter((uint8_t) mailbox, id, mask, extended);
+    frame->data.bytes[0] = 0;
+    frame->data.bytes[1] = 0;
+    frame->data.bytes[2] = 0;
+    frame->data.bytes[3] = 0;
+    frame->data.bytes[4] = 0;
+    frame->data.bytes[5] = 0;
+    frame->data.bytes[6] = 0;
+    frame->data.bytes[7] = 0;
+}
 
-    Logger::debug("attached CanObserver (%X) for id=%X, mask=%X, mailbox=%d", observer, id, mask, mailbox);
+/*
+ * Queue a frame for transmission. The queue is ordered by priority and within the
+ * same priority by CAN arbitration id (lower id first), frames with the same key
+ * keep their order. As many frames as there are free transmit mailboxes are handed
+ * to the driver immediately, so the driver never has to buffer frames in its own
+ * (first in, first out) ring.
+ * If the queue is full, the frame with the lowest priority is dropped.
+ * Interrupts are blocked while the queue is modified as frames may also be sent
+ * from TickObservers running in the timer interrupt.
+ */
+void CanHandler::sendFrame(CAN_FRAME& frame, CanTxPriority priority)
+{
+    queueFrame(frame, priority, micros(), NULL);
 }
 
 /*
- * Detaches a previously attached observer from this handler.
+ * Insert a frame into the transmit queue and send as many frames as there are
+ * free transmit mailboxes. May be called from interrupts.
  *
- * \param observer - observer object to detach
- * \param id - id of the observer to detach (required as one CanObserver may register itself several times)
- * \param mask - mask of the observer to detach (dito)
+ * \retval false if the frame was dropped because the queue is full
  */
-void CanHandler::detach(CanObserver* observer, uint32_t id, uint32_t mask)
+bool CanHandler::queueFrame(const CAN_FRAME &frame, CanTxPriority priority, uint32_t queued, GatewayEntry *gateway)
 {
-    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
-        if (observerData[i].observer == observer &&
-                observerData[i].id == id &&
-                observerData[i].mask == mask) {
-            observerData[i].observer = NULL;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    TxEntry entry;
+    entry.frame = frame;
+    entry.key = ((uint32_t) priority << 29) | (frame.extended ? frame.id & CAN_EXT_ID_MASK : (frame.id & CAN_STD_ID_MASK) << 18);
+    entry.sequence = txSequence++;
+    entry.queued = queued;
+    entry.gateway = gateway;
 
-            //TODO: if no more observers on same mailbox, disable its interrupt, reset mailbox
+    uint8_t pos;
+    if (txQueueSize < CFG_CAN_TX_QUEUE_SIZE) {
+        pos = txQueueSize++;
+    } else {
+        txDropCount++;
+        pos = txQueueSize / 2; // the lowest priority entry is one of the leaves
+        for (uint8_t i = pos + 1; i < txQueueSize; i++) {
+            if (txBefore(txQueue[pos], txQueue[i])) {
+                pos = i;
+            }
+        }
+        if (!txBefore(entry, txQueue[pos])) { // the new frame has the lowest priority itself
+            __set_PRIMASK(primask);
+            return false;
+        }
+        if (txQueue[pos].gateway != NULL) {
+            txQueue[pos].gateway->dropped++;
         }
     }
+    // sift up
+    while (pos > 0 && txBefore(entry, txQueue[(pos - 1) / 2])) {
+        txQueue[pos] = txQueue[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    txQueue[pos] = entry;
+    if (txQueueSize > txMaxDepth) {
+        txMaxDepth = txQueueSize;
+    }
+
+    sendQueuedFrames();
+    __set_PRIMASK(primask);
+    return true;
 }
 
 /*
- * Logs the content of a received can frame
- *
- * \param frame - the received can frame to log
+ * Check if entry a has to be sent before entry b.
  */
-void CanHandler::logFrame(CAN_FRAME& frame)
+bool CanHandler::txBefore(const TxEntry &a, const TxEntry &b)
 {
-    if (Logger::isDebug()) {
-        Logger::debug("CAN: dlc=%X fid=%X id=%X ide=%X rtr=%X data=%X,%X,%X,%X,%X,%X,%X,%X",
-                      frame.length, frame.fid, frame.id, frame.extended, frame.rtr,
-                      frame.data.bytes[0], frame.data.bytes[1], frame.data.bytes[2], frame.data.bytes[3],
-                      frame.data.bytes[4], frame.data.bytes[5], frame.data.bytes[6], frame.data.bytes[7]);
-    }
+    return a.key < b.key || (a.key == b.key && (int32_t) (a.sequence - b.sequence) < 0);
 }
 
 /*
- * Find a observerData entry which is not in use.
- *
- * \retval array index of the next unused entry in observerData[]
+ * Check if one of the transmit mailboxes is ready to take a frame.
  */
-int8_t CanHandler::findFreeObserverData()
+bool CanHandler::isTxMailboxFree()
 {
-    for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
-        if (observerData[i].observer == NULL) {
-            return i;
+    if (!busInitialized) {
+        return false;
+    }
+    for (uint8_t i = numRxMailboxes; i < CANMB_NUMBER; i++) {
+        if (bus->mailbox_get_status(i) & CAN_MSR_MRDY) {
+            return true;
         }
     }
-
-    return -1;
+    return false;
 }
 
 /*
- * Find a unused can mailbox according to entries in observerData[].
- *
- * \retval the mailbox index of the next unused mailbox
+ * Hand the queued frames with the highest priority to the free transmit mailboxes
+ * and record their queueing latency. Must be called with interrupts disabled.
  */
-int8_t CanHandler::findFreeMailbox()
+void CanHandler::sendQueuedFrames()
 {
-    uint8_t numRxMailboxes = (canBusNode == CAN_BUS_EV ? CFG_CAN0_NUM_RX_MAILBOXES : CFG_CAN1_NUM_RX_MAILBOXES);
-
-    for (uint8_t i = 0; i < numRxMailboxes; i++) {
-        bool used = false;
+    while (txQueueSize > 0 && isTxMailboxFree()) {
+        TxEntry &head = txQueue[0];
+        uint32_t latency = micros() - head.queued;
+        if (head.gateway != NULL) {
+            GatewayEntry *gateway = head.gateway;
+            gateway->sent++;
+            gateway->totalLatency += latency;
+            if (latency > gateway->maxLatency) {
+                gateway->maxLatency = latency;
+            }
+        } else {
+            recordTxLatency(head.frame.id, latency);
+        }
+        bus->sendFrame(head.frame);
+        busBits += frameBits(head.frame);
 
-        for (uint8_t j = 0; j < CFG_CAN_NUM_OBSERVERS; j++) {
-            if (observerData[j].observer != NULL && observerData[j].mailbox == i) {
-                used = true;
+        // move the last entry to the top and sift it down
+        TxEntry last = txQueue[--txQueueSize];
+        uint8_t pos = 0;
+        while (true) {
+            uint8_t child = pos * 2 + 1;
+            if (child >= txQueueSize) {
+                break;
+            }
+            if (child + 1 < txQueueSize && txBefore(txQueue[child + 1], txQueue[child])) {
+                child++;
             }
+            if (!txBefore(txQueue[child], last)) {
+                break;
+            }
+            txQueue[pos] = txQueue[child];
+            pos = child;
         }
+        txQueue[pos] = last;
+    }
+}
 
-        if (!used) {
-            return i;
+/*
+ * Update the latency statistics of a can id. Ids which don't fit into
+ * the table any more are not recorded.
+ */
+void CanHandler::recordTxLatency(uint32_t id, uint32_t latency)
+{
+    for (uint8_t i = 0; i < CAN_TX_STATS_SIZE; i++) {
+        TxStatistics *stats = &txStatistics[i];
+        if (stats->count == 0) {
+            stats->id = id;
+        } else if (stats->id != id) {
+            continue;
+        }
+        stats->count++;
+        stats->totalLatency += latency;
+        if (latency > stats->maxLatency) {
+            stats->maxLatency = latency;
         }
+        return;
     }
+}
 
-    return -1;
+/*
+ * Send queued frames if transmit mailboxes became free. Called from loop() as the
+ * driver gives no notification when a transmission is complete.
+ */
+void CanHandler::processTxQueue()
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    sendQueuedFrames();
+    __set_PRIMASK(primask);
 }
 
 /*
- * If a message is available, read it and forward it to registered observers.
+ * Returns true if queued frames can be handed to a free transmit mailbox.
  */
-void CanHandler::process()
+bool CanHandler::isTxReady()
 {
-    static CAN_FRAME frame;
-    static SDO_FRAME sFrame;
+    return txQueueSize > 0 && isTxMailboxFree();
+}
 
-    CanObserver *observer;
-
-    if (bus->rx_avail()) {
-        bus->get_rx_buff(frame);
-//      logFrame(frame);
-
-        for (int i = 0; i < CFG_CAN_NUM_OBSERVERS; i++) {
-            observer = observerData[i].observer;
-            if (observer != NULL) {
-                // Apply mask to frame.id and observer.id. If they match, forward the frame to the observer
-                if (observer->isCANOpen())
-                {
-                    if (frame.id > 0x17F && frame.id < 0x580)
-                    {
-                        observer->handlePDOFrame(&frame);
-                    }
-                    if (frame.id == 0x600 + observer->getNodeID()) //SDO request targetted to our ID
-                    {
-                        sFrame.nodeID = observer->getNodeID();
-                        sFrame.index = frame.data.byte[1] + (frame.data.byte[2] * 256);
-                        sFrame.subIndex = frame.data.byte[3];
-                        sFrame.cmd = (SDO_COMMAND)(frame.data.byte[0] & 0xF0);
-            
-                        if ((frame.data.byte[0] != 0x40) && (frame.data.byte[0] != 0x60))
-                        {
-                            sFrame.dataLength = (3 - ((frame.data.byte[0] & 0xC) >> 2)) + 1;            
-                        }
-                        else sFrame.dataLength = 0;
-
-                        for (int x = 0; x < sFrame.dataLength; x++) sFrame.data[x] = frame.data.byte[4 + x];
-                        observer->handleSDORequest(&sFrame);
-                    }
-
-                    if (frame.id == 0x580 + observer->getNodeID()) //SDO reply to our ID
-                    {
-                        sFrame.nodeID = observer->getNodeID();
-                        sFrame.index = frame.data.byte[1] + (frame.data.byte[2] * 256);
-                        sFrame.subIndex = frame.data.byte[3];
-                        sFrame.cmd = (SDO_COMMAND)(frame.data.byte[0] & 0xF0);
-            
-                        if ((frame.data.byte[0] != 0x40) && (frame.data.byte[0] != 0x60))
-                        {
-                            sFrame.dataLength = (3 - ((frame.data.byte[0] & 0xC) >> 2)) + 1;            
-                        }
-                        else sFrame.dataLength = 0;
-
-                        for (int x = 0; x < sFrame.dataLength; x++) sFrame.data[x] = frame.data.byte[4 + x];
-
-                        observer->handleSDOResponse(&sFrame);                       
-                    }
-                }
-                else //raw canbus
-                {
-                    if ((frame.id & observerData[i].mask) == (observerData[i].id & observerData[i].mask)) {
-                        observer->handleCanFrame(&frame);
-                    }
-                }
-            }
-        }
+/*
+ * Copy the transmit statistics of all sent can id's.
+ *
+ * \retval the number of entries copied
+ */
+uint8_t CanHandler::getTxStatistics(TxStatistics *statistics, uint8_t maxEntries)
+{
+    uint8_t count = 0;
+
+    noInterrupts();
+    for (uint8_t i = 0; i < CAN_TX_STATS_SIZE && count < maxEntries && txStatistics[i].count > 0; i++) {
+        statistics[count++] = txStatistics[i];
     }
+    interrupts();
+    return count;
 }
 
 /*
- * Prepare the CAN transmit frame.
- * Re-sets all parameters in the re-used frame.
+ * The maximum number of frames which were waiting in the transmit queue.
  */
-void CanHandler::prepareOutputFrame(CAN_FRAME *frame, uint32_t id)
+uint8_t CanHandler::getTxMaxDepth()
 {
-    frame->length = 8;
-    frame->id = id;
-    frame->extended = 0;
-    frame->rtr = 0;
+    return txMaxDepth;
+}
 
-    frame->data.bytes[0] = 0;
-    frame->data.bytes[1] = 0;
-    frame->data.bytes[2] = 0;
-    frame->data.bytes[3] = 0;
-    frame->data.bytes[4] = 0;
-    frame->data.bytes[5] = 0;
-    frame->data.bytes[6] = 0;
-    frame->data.bytes[7] = 0;
+/*
+ * Number of frames which were dropped because the transmit queue was full.
+ */
+uint32_t CanHandler::getTxDropCount()
+{
+    return txDropCount;
 }
 
-//Allow the canbus driver to figure out the proper mailbox to use
-//(whatever happens to be open) or queue it to send (if nothing is open)
-void CanHandler::sendFrame(CAN_FRAME& frame)
+void CanHandler::resetTxStatistics()
 {
-    bus->sendFrame(frame);
+    noInterrupts();
+    for (uint8_t i = 0; i < CAN_TX_STATS_SIZE; i++) {
+        txStatistics[i].count = 0;
+        txStatistics[i].totalLatency = 0;
+        txStatistics[i].maxLatency = 0;
+    }
+    txMaxDepth = txQueueSize;
+    txDropCount = 0;
+    interrupts();
 }
 
-void CanHandler::sendISOTP(int id, int length, uint8_t *data)
+/*
+ * Register a frame which is sent every period microseconds.
+ * If a source is given, its fillCyclicFrame() is called from loop() to fill in
+ * the data right before the frame is sent. Otherwise the frame is sent directly
+ * from the timer interrupt (for precise timing) with the data last set via
+ * setCyclicPayload(), nothing is sent until the payload was set for the first time.
+ * Unless a phase is specified, the TickHandler chooses the offset with the least
+ * collisions with other messages and tick observers.
+ *
+ * \retval the handle of the message or -1 if no more messages can be added
+ */
+int8_t CanHandler::addCyclicMessage(uint32_t id, bool extended, uint32_t period, CanCyclicSource *source, CanTxPriority priority,
+        uint32_t phase)
 {
-    CAN_FRAME frame;
+    for (int8_t i = 0; i < CFG_CAN_NUM_CYCLIC_MESSAGES; i++) {
+        CanCyclicMessage *message = &cyclicMessages[i];
+        if (message->active) {
+            continue;
+        }
+        prepareOutputFrame(&message->frame, id);
+        message->frame.extended = extended;
+        message->source = source;
+        message->priority = priority;
+        message->period = period;
+        message->sentLastCycle = false;
+        message->calls = 0;
+        message->periods = 0;
+        message->maxJitter = 0;
+        message->totalJitter = 0;
+        message->active = true;
+        tickHandler.attach(message, period, (source == NULL ? TICK_PRIORITY_INTERRUPT : TICK_PRIORITY_CONTROL), phase);
+        return i;
+    }
+    Logger::error("no free cyclic message on CAN%d, increase CFG_CAN_NUM_CYCLIC_MESSAGES", (canBusNode == CAN_BUS_EV ? 0 : 1));
+    return -1;
+}
 
-    frame.extended = false;
-    frame.id = id;
-    frame.rtr = 0;
+/*
+ * Set the data of a cyclic message without a source. The id of the frame is
+ * ignored. May only be called from one place (e.g. the device's handleTick()).
+ */
+void CanHandler::setCyclicPayload(int8_t handle, const CAN_FRAME &frame)
+{
+    if (handle >= 0 && handle < CFG_CAN_NUM_CYCLIC_MESSAGES) {
+        cyclicMessages[handle].payload.write(frame);
+    }
+}
 
-    if (length < 8) //single frame
-    {
-        frame.length = length + 1;
-        frame.data.byte[0] = SINGLE + (length << 4);
-        for (int i = 0; i < length; i++) frame.data.byte[i + 1] = data[i];
-        bus->sendFrame(frame);
+/*
+ * Stop sending a cyclic message.
+ */
+void CanHandler::removeCyclicMessage(int8_t handle)
+{
+    if (handle >= 0 && handle < CFG_CAN_NUM_CYCLIC_MESSAGES && cyclicMessages[handle].active) {
+        tickHandler.detach(&cyclicMessages[handle]);
+        cyclicMessages[handle].active = false;
     }
-    else //multi-frame sending
-    {
-        int temp = length;
-        uint8_t idx = 0;
-        int base;
-        frame.length = 8;
-        frame.data.byte[0] = FIRST + (length >> 8);
-        frame.data.byte[1] = (length & 0xFF);
-        for (int i = 0; i < 6; i++) frame.data.byte[i + 2] = data[i];
-        bus->sendFrame(frame);
-        temp -= 6;
-        base = 6;
-        while (temp > 7)
-        {
-            frame.length = 8;
-            frame.data.byte[0] = CONSEC + (idx << 4);
-            idx = (idx + 1) & 0xF;
-            for (int i = 0; i < 7; i++) frame.data.byte[i + 1] = data[i + base];
-            bus->sendFrame(frame);
-            temp -= 7;
-            base += 7;
-        }
-        if (temp > 0)
-        {
-            frame.length = temp + 1;
-            frame.data.byte[0] = CONSEC + (idx << 4);
-            for (int i = 0; i < temp; i++) frame.data.byte[i + 1] = data[i + base];
-            bus->sendFrame(frame);
+}
+
+/*
+ * Copy the timing statistics of all active cyclic messages.
+ *
+ * \retval the number of entries copied
+ */
+uint8_t CanHandler::getCyclicStatistics(CyclicStatistics *statistics, uint8_t maxEntries)
+{
+    uint8_t count = 0;
+
+    for (int i = 0; i < CFG_CAN_NUM_CYCLIC_MESSAGES && count < maxEntries; i++) {
+        CanCyclicMessage *message = &cyclicMessages[i];
+        if (!message->active) {
+            continue;
         }
+        CyclicStatistics *stats = &statistics[count++];
+        noInterrupts();
+        stats->id = message->frame.id;
+        stats->period = message->period;
+        stats->calls = message->calls;
+        stats->maxJitter = message->maxJitter;
+        stats->avgJitter = (message->periods > 0 ? message->totalJitter / message->periods : 0);
+        interrupts();
+    }
+    return count;
+}
+
+void CanHandler::resetCyclicStatistics()
+{
+    for (int i = 0; i < CFG_CAN_NUM_CYCLIC_MESSAGES; i++) {
+        noInterrupts();
+        cyclicMessages[i].sentLastCycle = false;
+        cyclicMessages[i].calls = 0;
+        cyclicMessages[i].periods = 0;
+        cyclicMessages[i].maxJitter = 0;
+        cyclicMessages[i].totalJitter = 0;
+        interrupts();
     }
 }
 
@@ -356,7 +1596,7 @@ void CanHandler::sendPDOMessage(int id, int length, unsigned char *data)
     frame.extended = false;
     frame.length = length;
     for (int x = 0; x < length; x++) frame.data.byte[x] = data[x];
-    bus->sendFrame(frame);
+    sendFrame(frame);
 }
 
 void CanHandler::sendSDORequest(SDO_FRAME *sframe)
@@ -378,8 +1618,10 @@ void CanHandler::sendSDORequest(SDO_FRAME *sframe)
         frame.data.byte[3] = sframe->subIndex;
         for (int x = 0; x < sframe->dataLength; x++) frame.data.byte[4 + x] = sframe->data[x];
         //SerialUSB.println("plugging trigger");
-        bus->sendFrame(frame);
+        sendFrame(frame);
         //SerialUSB.println("sent frame");
+    } else {
+        Logger::warn("SDO request with %d bytes not sent, use the SdoClient for segmented transfers", sframe->dataLength);
     }
 }
 
@@ -401,7 +1643,7 @@ void CanHandler::sendSDOResponse(SDO_FRAME *sframe)
         frame.data.byte[2] = sframe->index >> 8;
         frame.data.byte[3] = sframe->subIndex;
         for (int x = 0; x < sframe->dataLength; x++) frame.data.byte[4 + x] = sframe->data[x];
-        bus->sendFrame(frame);
+        sendFrame(frame);
     }
 }
 
@@ -412,7 +1654,7 @@ void CanHandler::sendHeartbeat()
     frame.length = 1;
     frame.extended = false;
     frame.data.byte[0] = 5; //we're always operational
-    bus->sendFrame(frame);  
+    sendFrame(frame);  
 }
 
 void CanHandler::sendNMTMsg(int id, int cmd)
@@ -425,7 +1667,7 @@ void CanHandler::sendNMTMsg(int id, int cmd)
     frame.data.byte[0] = cmd;
     frame.data.byte[1] = id;
     //the rest don't matter
-    bus->sendFrame(frame);
+    sendFrame(frame);
 }
 
 void CanHandler::setMasterID(int id)
@@ -433,6 +1675,11 @@ void CanHandler::setMasterID(int id)
     masterID = id;
 }
 
+int CanHandler::getMasterID()
+{
+    return masterID;
+}
+
 
 CanObserver::CanObserver()
 {
@@ -465,22 +1712,111 @@ bool CanObserver::isCANOpen()
  * Default implementation of the CanObserver method. Must be overwritten
  * by every sub-class. However, canopen devices should still call this version to save themselves some effort
  */
-void CanObserver::handleCanFrame(CAN_FRAME *frame)
+void CanObserver::handleCanFrame(const CAN_FRAME *frame)
 {
     Logger::error("CanObserver does not implement handleCanFrame(), frame.id=%d", frame->id);
 }
 
-void CanObserver::handlePDOFrame(CAN_FRAME *frame)
+void CanObserver::handlePDOFrame(const CAN_FRAME *frame)
 {
     Logger::error("CanObserver does not implement handlePDOFrame(), frame.id=%d", frame->id);
 }
 
-void CanObserver::handleSDORequest(SDO_FRAME *frame)
+void CanObserver::handleSDORequest(const SDO_FRAME *frame)
 {
     Logger::error("CanObserver does not implement handleSDORequest(), frame.id=%d", frame->nodeID);
 }
 
-void CanObserver::handleSDOResponse(SDO_FRAME *frame)
+void CanObserver::handleSDOResponse(const SDO_FRAME *frame)
 {
     Logger::error("CanObserver does not implement handleSDOResponse(), frame.id=%d", frame->nodeID);
-}
\ No newline at end of file
+}
+
+/*
+ * Called by the SdoClient when a transfer is complete. Observers which don't
+ * care about the result don't need to implement it.
+ */
+void CanObserver::handleSDOComplete(const SDO_RESULT *result)
+{
+}
+
+/*
+ * Default implementation of the CanObserver method. Called when no frame matching
+ * a watch was received within its timeout (see CanHandler::watchFrames()).
+ */
+void CanObserver::handleCanTimeout(int8_t watch)
+{
+}
+
+/*
+ * Default implementation of the CanObserver method. Called when a frame matching
+ * a stale watch is received.
+ */
+void CanObserver::handleCanRecovery(int8_t watch)
+{
+}
+
+CanCyclicMessage::CanCyclicMessage()
+{
+    canHandler = NULL;
+    source = NULL;
+    active = false;
+}
+
+/*
+ * Send the frame of a cyclic message and measure the achieved period.
+ */
+void CanCyclicMessage::handleTick()
+{
+    CAN_FRAME output = frame;
+
+    if (source != NULL) {
+        if (!source->fillCyclicFrame(output)) {
+            sentLastCycle = false;
+            return;
+        }
+    } else {
+        if (!payload.read(output)) {
+            return;
+        }
+        output.id = frame.id;
+        output.extended = frame.extended;
+    }
+
+    uint32_t now = micros();
+    if (sentLastCycle) {
+        uint32_t elapsed = now - lastSent;
+        uint32_t jitter = (elapsed > period ? elapsed - period : period - elapsed);
+        if (jitter > maxJitter) {
+            maxJitter = jitter;
+        }
+        totalJitter += jitter;
+        periods++;
+    }
+    lastSent = now;
+    sentLastCycle = true;
+    calls++;
+    canHandler->sendFrame(output, priority);
+}
+
+/*
+ * Default implementation of the CanCyclicSource method, sends the frame unchanged.
+ */
+bool CanCyclicSource::fillCyclicFrame(CAN_FRAME &frame)
+{
+    return true;
+}
+
+/*
+ * Interrupt callbacks of the CAN driver, they are called for every frame
+ * received in one of the mailboxes.
+ */
+void canRxInterruptEv(CAN_FRAME *frame)
+{
+    canHandlerEv.receiveFrame(frame);
+}
+
+void canRxInterruptCar(CAN_FRAME *frame)
+{
+    canHandlerCar.receiveFrame(frame);
+}
@@ -33,6 +33,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "variant.h"
 #include <DueTimer.h>
 #include "Logger.h"
+#include "TickHandler.h"
 
 enum SDO_COMMAND
 {
@@ -51,22 +52,31 @@ struct SDO_FRAME
     uint8_t data[4];
 };
 
-enum ISOTP_MODE
+/*
+ * Result of a transfer of the SdoClient.
+ */
+struct SDO_RESULT
 {
-    SINGLE = 0,
-    FIRST = 1,
-    CONSEC = 2,
-    FLOW = 3
+    uint8_t nodeID;
+    uint16_t index;
+    uint8_t subIndex;
+    bool write;         // download (true) or upload (false)
+    uint32_t abortCode; // 0 if successful, otherwise the CANopen abort code
+    uint8_t *data;      // upload: the buffer passed to SdoClient::read()
+    uint16_t length;    // number of bytes transferred
 };
 
 class CanObserver
 {
 public:
     CanObserver();
-    virtual void handleCanFrame(CAN_FRAME *frame);
-    virtual void handlePDOFrame(CAN_FRAME *frame);
-    virtual void handleSDORequest(SDO_FRAME *frame);
-    virtual void handleSDOResponse(SDO_FRAME *frame);
+    virtual void handleCanFrame(const CAN_FRAME *frame);
+    virtual void handlePDOFrame(const CAN_FRAME *frame);
+    virtual void handleSDORequest(const SDO_FRAME *frame);
+    virtual void handleSDOResponse(const SDO_FRAME *frame);
+    virtual void handleSDOComplete(const SDO_RESULT *result);
+    virtual void handleCanTimeout(int8_t watch);
+    virtual void handleCanRecovery(int8_t watch);
     void setCANOpenMode(bool en);
     bool isCANOpen();
     void setNodeID(int id);
@@ -77,9 +87,211 @@ private:
     int nodeID;
 };
 
+/*
+ * Slot of the receive ring. The frame is copied once from the CAN mailbox by
+ * the interrupt, observers get a pointer to it which stays valid until all
+ * of them have been called.
+ */
+struct CanRxSlot {
+    CAN_FRAME frame;
+    uint32_t timestamp; // micros() when the frame was received
+};
+
+#define CAN_NUM_STD_IDS         2048 // number of 11-bit identifiers
+#define CAN_EXT_CACHE_SIZE      16 // entries of the cache for the dispatch of extended frames (power of 2)
+#define CAN_MAX_OBSERVER_SETS   64 // max number of different combinations of observers in the 11-bit dispatch table
+#define CAN_OBSERVER_SET_SCAN   0xFF // marks an id whose observers have to be looked up by scanning all entries
+
+#define CAN_GATEWAY_KEEP_ID     0xFFFFFFFF // the forwarded frame keeps the id of the received one
+#define CAN_GATEWAY_ZERO_BYTE   0xFF // entry of a gateway byte map: the output byte is set to 0
+#define CAN_TX_STATS_SIZE       16 // number of can id's for which transmit statistics are kept
+#define CAN_ID_STATS_PROBES     4 // max entries of the per id receive statistics which are checked for an id (keeps the update constant time)
+#define CAN_BUS_LOAD_WINDOW     1000000 // microseconds over which the bus load is measured
+#define CAN_MAX_SPEED_KBPS      1000 // highest bit rate of the CAN controller (in kbit/s, as stored in EESYS_CAN0_BAUD/EESYS_CAN1_BAUD)
+#define CAN_STD_ID_MASK         0x7FF
+#define CAN_ID_EXTENDED_FLAG    0x80000000 // marks extended ids in keys which hold standard and extended ids
+#define CAN_ID_KEY_ZERO         0x40000000 // key of the standard id 0 (so a key of 0 can mark unused entries)
+#define CAN_EXT_ID_MASK         0x1FFFFFFF
+
+#if CFG_CAN0_NUM_RX_MAILBOXES > CANMB_NUMBER - 1 || CFG_CAN1_NUM_RX_MAILBOXES > CANMB_NUMBER - 1
+#error "at least one CAN mailbox must be left for transmission (CFG_CAN0_NUM_RX_MAILBOXES / CFG_CAN1_NUM_RX_MAILBOXES)"
+#endif
+#define CAN_MAX_RX_MAILBOXES    (CANMB_NUMBER - 1)
+
+#if CFG_CAN_NUM_OBSERVERS > 32
+#error "the CanHandler dispatch index supports max 32 observers per bus (CFG_CAN_NUM_OBSERVERS)"
+#endif
+
+/*
+ * Priority of a transmitted frame. Within the same priority the frames are
+ * sent in the order of their arbitration id.
+ */
+enum CanTxPriority {
+    CAN_TX_PRIORITY_HIGH,   // e.g. torque commands to the motor controller
+    CAN_TX_PRIORITY_NORMAL,
+    CAN_TX_PRIORITY_LOW     // e.g. displays, diagnostics
+};
+
+class CanHandler;
+
+/*
+ * Implemented by devices which fill the data of a cyclic message right before
+ * it's sent (see CanHandler::addCyclicMessage()).
+ */
+class CanCyclicSource
+{
+public:
+    virtual bool fillCyclicFrame(CAN_FRAME &frame); // return false to skip this cycle
+};
+
+/*
+ * A frame which is sent periodically by a CanHandler. It's driven by the
+ * TickHandler, so the phase of all cyclic messages (and tick observers) is
+ * spread over their period.
+ */
+class CanCyclicMessage : public TickObserver
+{
+public:
+    CanCyclicMessage();
+    void handleTick();
+
+    CanHandler *canHandler;
+    CAN_FRAME frame;        // id and default content of the frame
+    CanCyclicSource *source; // if set, fills the frame from loop(), otherwise the payload is sent from the timer interrupt
+    TickMailbox<CAN_FRAME> payload; // the data to send if no source is set
+    CanTxPriority priority;
+    uint32_t period;        // in microseconds
+    bool active;
+    bool sentLastCycle;     // the previous cycle sent a frame, the period can be measured
+    uint32_t lastSent;      // micros() of the last sent frame
+    uint32_t calls;         // number of sent frames
+    uint32_t periods;       // number of measured periods
+    uint32_t maxJitter;     // largest deviation of the achieved period from the period in microseconds
+    uint64_t totalJitter;   // sum of the deviations
+};
+
+/*
+ * Checks the deadlines of the watched frames of a CanHandler (see CanHandler::watchFrames()).
+ */
+class CanWatchTicker : public TickObserver
+{
+public:
+    void handleTick();
+
+    CanHandler *canHandler;
+};
+
+/*
+ * Polls the bus load and the error state of a CanHandler (see CanHandler::monitorBus()).
+ * It must not depend on received frames as a bus-off controller doesn't receive any.
+ */
+class CanMonitorTicker : public TickObserver
+{
+public:
+    void handleTick();
+
+    CanHandler *canHandler;
+};
+
 class CanHandler
 {
 public:
+    /*
+     * Achieved timing of a cyclic message, all times in microseconds.
+     */
+    struct CyclicStatistics {
+        uint32_t id;
+        uint32_t period;
+        uint32_t calls;
+        uint32_t maxJitter;
+        uint32_t avgJitter;
+    };
+
+    /*
+     * Queueing latency (time between sendFrame() and hand-over to a transmit
+     * mailbox) of one can id in microseconds.
+     */
+    struct TxStatistics {
+        uint32_t id;
+        uint32_t count;
+        uint32_t maxLatency;
+        uint64_t totalLatency;
+    };
+
+    /*
+     * Receive statistics of one can id, times in microseconds.
+     */
+    struct IdStatistics {
+        uint32_t id;
+        bool extended;
+        uint32_t count;
+        uint32_t avgGap;    // mean time between two frames
+        uint32_t maxGap;
+        uint32_t jitter;    // mean deviation between consecutive gaps (RFC 3550 estimator)
+        uint32_t suppressed; // frames withheld from on-change observers because the payload didn't change
+    };
+
+    /*
+     * Load and error state of the bus.
+     */
+    /*
+     * The bit timing which the CAN controller actually uses (decoded from its CAN_BR register).
+     */
+    struct BitTiming {
+        uint32_t bitRate;       // achieved bits per second
+        uint8_t prescaler;      // MCK cycles per time quantum
+        uint8_t quanta;         // time quanta per bit (sync + propagation + phase 1 + phase 2)
+        uint8_t propagation;    // time quanta of the propagation segment
+        uint8_t phase1;
+        uint8_t phase2;
+        uint8_t sjw;            // re-synchronization jump width in time quanta
+        uint16_t samplePoint;   // position of the sample point in 0.1% of the bit time
+        bool tripleSample;
+    };
+
+    struct BusStatistics {
+        uint16_t load;      // bus load of the last measurement window in 0.1%
+        uint16_t peakLoad;  // highest load since the last reset in 0.1%
+        uint8_t txErrors;   // current transmit error counter of the controller
+        uint8_t rxErrors;   // current receive error counter of the controller
+        uint8_t maxTxErrors;
+        uint8_t maxRxErrors;
+        bool busOff;
+        bool errorPassive;
+        uint32_t busOffCount;       // number of times the controller went bus-off
+        uint32_t errorPassiveCount; // number of times the controller became error passive
+        uint32_t untrackedFrames;   // frames of ids which didn't fit into the per id statistics
+    };
+
+    /*
+     * Forwards matching frames received on this bus to the other bus.
+     */
+    struct GatewayRule {
+        uint32_t id;            // id of the frames to forward
+        uint32_t mask;
+        bool extended;
+        uint32_t newId;         // id of the forwarded frame or CAN_GATEWAY_KEEP_ID
+        bool remap;             // if set, the data is re-arranged according to byteMap
+        uint8_t byteMap[8];     // per output byte the index of the input byte or CAN_GATEWAY_ZERO_BYTE
+        uint32_t minInterval;   // microseconds, matching frames which arrive earlier are dropped (0 = no limit)
+        CanTxPriority priority;
+    };
+
+    /*
+     * Counters of a gateway rule. The latency is measured from the reception
+     * of the frame (interrupt) to its hand-over to a transmit mailbox of the other bus.
+     */
+    struct GatewayStatistics {
+        uint32_t id;
+        uint32_t mask;
+        uint32_t newId;
+        uint32_t forwarded;
+        uint32_t rateLimited;   // dropped because of minInterval
+        uint32_t dropped;       // dropped because the transmit queue of the other bus was full
+        uint32_t maxLatency;
+        uint32_t avgLatency;
+    };
+
     enum CanBusNode {
         CAN_BUS_EV, // CAN0 is intended to be connected to the EV bus (controller, charger, etc.)
         CAN_BUS_CAR // CAN1 is intended to be connected to the car's high speed bus (the one with the ECU)
@@ -87,12 +299,50 @@ public:
 
     CanHandler(CanBusNode busNumber);
     void setup();
-    void attach(CanObserver *observer, uint32_t id, uint32_t mask, bool extended);
+    void attach(CanObserver *observer, uint32_t id, uint32_t mask, bool extended, bool onChange = false);
     void detach(CanObserver *observer, uint32_t id, uint32_t mask);
     void process();
+    static void processAll();
+    void receiveFrame(CAN_FRAME *frame); // must be public when called from the non-class functions
+    void injectFrame(const CAN_FRAME &frame, uint32_t timestamp);
+    bool isFrameAvailable();
+    uint32_t getRxTimestamp();
+    uint32_t getRxFrameCount();
+    uint16_t getRxHighWater();
+    uint32_t getRxOverrunCount();
+    void resetRxStatistics();
+    uint8_t getIdStatistics(IdStatistics *statistics, uint8_t maxEntries);
+    void getBusStatistics(BusStatistics &statistics);
+    void resetBusStatistics();
+    void monitorBus();
+    uint8_t getUsedMailboxes();
+    uint8_t getNumRxMailboxes();
+    uint32_t getBusSpeed();
+    bool getBitTiming(BitTiming &timing);
     void prepareOutputFrame(CAN_FRAME *frame, uint32_t id);
-    void sendFrame(CAN_FRAME& frame);
-    void sendISOTP(int id, int length, uint8_t *data);
+    void sendFrame(CAN_FRAME& frame, CanTxPriority priority = CAN_TX_PRIORITY_NORMAL);
+    void processTxQueue();
+    bool isTxReady();
+    uint8_t getTxStatistics(TxStatistics *statistics, uint8_t maxEntries);
+    uint8_t getTxMaxDepth();
+    uint32_t getTxDropCount();
+    void resetTxStatistics();
+    int8_t addCyclicMessage(uint32_t id, bool extended, uint32_t period, CanCyclicSource *source = NULL,
+            CanTxPriority priority = CAN_TX_PRIORITY_NORMAL, uint32_t phase = TICK_PHASE_AUTO);
+    void setCyclicPayload(int8_t handle, const CAN_FRAME &frame);
+    void removeCyclicMessage(int8_t handle);
+    uint8_t getCyclicStatistics(CyclicStatistics *statistics, uint8_t maxEntries);
+    void resetCyclicStatistics();
+    int8_t watchFrames(uint32_t id, uint32_t mask, bool extended, uint32_t period, uint8_t maxMissed, CanObserver *observer);
+    void unwatchFrames(int8_t watch);
+    bool isFresh(int8_t watch);
+    uint32_t getFrameAge(int8_t watch);
+    void checkWatchDeadlines();
+    int8_t addGatewayRule(const GatewayRule &rule);
+    void removeGatewayRule(int8_t handle);
+    void clearGatewayRules();
+    uint8_t getGatewayStatistics(GatewayStatistics *statistics, uint8_t maxEntries);
+    void resetGatewayStatistics();
 
     //canopen support functions
     void sendNodeStart(int id = 0);
@@ -104,6 +354,7 @@ public:
     void sendSDOResponse(SDO_FRAME *frame);
     void sendHeartbeat();
     void setMasterID(int id);   
+    int getMasterID();
 
 protected:
 
@@ -113,22 +364,143 @@ private:
         uint32_t mask;  // the CAN frame mask to listen to
         bool extended;  // are extended frames expected
         uint8_t mailbox;    // which mailbox is this observer assigned to
+        bool canOpen;   // the observer is in CANopen mode (copied at attach time)
+        uint8_t nodeID; // the CANopen node id of the observer (copied at attach time)
+        bool onChange;  // only frames whose payload differs from the previous frame of the id are delivered
         CanObserver *observer;  // the observer object (e.g. a device)
     };
+    struct HardwareFilter {
+        uint32_t id;        // id bits which must match (only the bits set in mask)
+        uint32_t mask;      // id bits which are compared
+        bool extended;
+    };
+    struct WatchEntry {
+        bool active;
+        uint32_t id;
+        uint32_t mask;
+        bool extended;
+        uint32_t timeout;       // period * (maxMissed + 1) in microseconds
+        uint32_t lastSeen;      // micros() of the last matching frame (or of the registration)
+        bool seen;              // a matching frame was received at least once
+        bool stale;             // the deadline passed (or no frame was received yet)
+        CanObserver *observer;
+    };
+    struct GatewayEntry {
+        bool active;
+        GatewayRule rule;
+        uint32_t lastForward;   // micros() when the last frame was forwarded
+        bool forwardedOnce;
+        uint32_t forwarded;
+        uint32_t rateLimited;
+        uint32_t dropped;
+        uint32_t sent;          // frames handed to a transmit mailbox (for the average latency)
+        uint32_t maxLatency;
+        uint64_t totalLatency;
+    };
+    struct TxEntry {
+        CAN_FRAME frame;
+        uint32_t key;       // priority and arbitration id, lower is sent first
+        uint32_t sequence;  // keeps the order of frames with the same key
+        uint32_t queued;    // micros() when the frame was queued (or received, if forwarded by the gateway)
+        GatewayEntry *gateway; // the gateway rule which forwarded the frame
+    };
+    struct IdMonitorEntry {
+        uint32_t key;       // id | CAN_ID_EXTENDED_FLAG, 0 if unused (id 0 is stored as CAN_ID_KEY_ZERO)
+        uint32_t count;
+        uint32_t lastTimestamp; // micros() of the last frame
+        uint16_t lastTime;  // hardware timestamp (bit times) of the last frame
+        uint32_t lastGap;
+        uint32_t maxGap;
+        uint64_t totalGap;
+        uint32_t jitter;    // scaled by 16
+        bool payloadValid;  // lastPayload holds the payload of the last frame with on-change observers
+        uint8_t lastFormat; // length of the last payload, bit 7 set for remote frames
+        uint64_t lastPayload;
+        uint32_t suppressed; // frames not delivered to on-change observers
+    };
+    struct ExtendedCacheEntry {
+        bool valid;
+        uint32_t id;        // extended frame id
+        uint32_t observers; // bit mask of the matching observerData entries
+    };
 
     CanBusNode canBusNode;  // indicator to which can bus this instance is assigned to
     CANRaw *bus;    // the can bus instance which this CanHandler instance is assigned to
     CanObserverData observerData[CFG_CAN_NUM_OBSERVERS];    // Can observers
+    uint8_t numRxMailboxes; // number of mailboxes used for reception (the first ones)
+    HardwareFilter filters[CAN_MAX_RX_MAILBOXES]; // the filters which are programmed into the receive mailboxes
+    uint8_t numFilters;
+    bool busInitialized; // the mailboxes can only be programmed after setup()
+    uint8_t stdIdIndex[CAN_NUM_STD_IDS]; // per 11-bit id the index of the set of matching observers in observerSets
+    uint32_t observerSets[CAN_MAX_OBSERVER_SETS]; // bit masks of observerData entries, entry 0 is the empty set
+    uint32_t onChangeObservers; // bit mask of the observerData entries attached in on-change mode
+    uint8_t numObserverSets;
+    ExtendedCacheEntry extendedCache[CAN_EXT_CACHE_SIZE]; // direct mapped cache of the observers of extended ids
+    CanRxSlot rxBuffer[CFG_CAN_RX_BUFFER_SIZE]; // single producer (CAN interrupt), single consumer (processFrame()) ring
+    volatile uint16_t rxHead, rxTail;
+    uint32_t rxTimestamp; // timestamp of the frame which is currently dispatched
+    uint32_t rxFrameCount; // number of processed frames
+    volatile uint16_t rxHighWater; // max number of frames waiting in the receive ring
+    volatile uint32_t rxOverrunCount; // number of frames dropped because the receive ring was full
+    IdMonitorEntry idMonitor[CFG_CAN_ID_STATS_SIZE]; // open addressing hash table of the received ids
+    uint32_t untrackedFrames; // frames of ids which found no free entry in idMonitor
+    uint32_t busSpeed; // bits per second
+    uint32_t bitTimeNs; // duration of one bit in nanoseconds (resolution of the hardware timestamps)
+    uint32_t hwTimestampRange; // gaps (us) below this can be taken from the 16 bit hardware timestamps without ambiguity
+    volatile uint32_t busBits; // bits of the received and sent frames in the current bus load window
+    uint32_t loadWindowStart; // micros() when the current bus load window started
+    uint16_t busLoad, peakBusLoad; // in 0.1%
+    uint8_t maxTxErrors, maxRxErrors;
+    bool busOff, errorPassive;
+    uint32_t busOffCount, errorPassiveCount;
+    TxEntry txQueue[CFG_CAN_TX_QUEUE_SIZE]; // binary heap, the next frame to send is at index 0
+    volatile uint8_t txQueueSize;
+    uint32_t txSequence;
+    uint8_t txMaxDepth; // max number of frames waiting in the transmit queue
+    uint32_t txDropCount; // frames dropped because the transmit queue was full
+    TxStatistics txStatistics[CAN_TX_STATS_SIZE];
+    CanCyclicMessage cyclicMessages[CFG_CAN_NUM_CYCLIC_MESSAGES];
+    WatchEntry watches[CFG_CAN_NUM_WATCHES];
+    uint8_t numWatches;
+    uint32_t nextWatchDeadline; // no deadline passes before this time (micros())
+    CanWatchTicker watchTicker;
+    CanMonitorTicker monitorTicker;
+    GatewayEntry gatewayRules[CFG_CAN_GATEWAY_RULES]; // rules for frames received on this bus
+    volatile uint8_t numGatewayRules;
 
-    void logFrame(CAN_FRAME& frame);
+    void logFrame(const CAN_FRAME& frame);
     int8_t findFreeObserverData();
-    int8_t findFreeMailbox();
+    bool matches(uint8_t entry, uint32_t id, bool extended);
+    uint32_t scanObservers(uint32_t id, bool extended);
+    uint32_t findObservers(const CAN_FRAME &frame);
+    uint8_t findObserverSet(uint32_t observers);
+    void buildDispatchIndex();
+    uint8_t planFilters(HardwareFilter *plan);
+    void removeCoveredFilters(HardwareFilter *plan, uint8_t &count);
+    void updateFilters();
+    void storeFrame(const CAN_FRAME &frame, uint32_t timestamp);
+    bool processFrame();
+    bool queueFrame(const CAN_FRAME &frame, CanTxPriority priority, uint32_t queued, GatewayEntry *gateway);
+    void forwardFrame(const CAN_FRAME &frame, uint32_t timestamp);
+    bool txBefore(const TxEntry &a, const TxEntry &b);
+    bool isTxMailboxFree();
+    void sendQueuedFrames();
+    void recordTxLatency(uint32_t id, uint32_t latency);
+    IdMonitorEntry *recordRxFrame(const CAN_FRAME &frame, uint32_t timestamp);
+    bool payloadChanged(IdMonitorEntry *entry, const CAN_FRAME &frame);
+    void invalidatePayloads();
+    void updateWatches(const CAN_FRAME &frame, uint32_t timestamp);
+    uint16_t frameBits(const CAN_FRAME &frame);
+    void setBusSpeed(uint32_t speed);
 
     //canopen support functions
     void sendNMTMsg(int, int);
     int masterID; //what is our ID as the master node?      
 };
 
+void canRxInterruptEv(CAN_FRAME *frame);
+void canRxInterruptCar(CAN_FRAME *frame);
+
 extern CanHandler canHandlerEv;
 extern CanHandler canHandlerCar;
 
@@ -37,6 +37,8 @@ CanPIDListener::CanPIDListener() : Device() {
     responseId = 0;
     responseMask = 0x7ff;
     responseExtended = false;
+    physicalSession = -1;
+    functionalSession = -1;
 }
 
 void CanPIDListener::setup() {
@@ -46,8 +48,10 @@ void CanPIDListener::setup() {
     Device::setup();
 
     //TODO: FIXME Quickly coded as hard coded values. This is naughty.
-    canHandlerEv.attach(this, 0x7DF, 0x7DF, false);
-    canHandlerEv.attach(this, 0x7E0, 0x7E0, false);
+    isoTpHandlerEv.closeSession(physicalSession);
+    isoTpHandlerEv.closeSession(functionalSession);
+    physicalSession = isoTpHandlerEv.openSession(0x7E8, 0x7E0, false, this);
+    functionalSession = isoTpHandlerEv.openSession(0x7E8, 0x7DF, false, this);
     //TickHandler::getInstance()->attach(this, CFG_TICK_INTERVAL_CAN_THROTTLE);
 }
 
@@ -90,18 +94,27 @@ void CanPIDListener::setup() {
 	bits 0-3 = third char (stored as normal nibble)
 	Then next byte has two nibbles for the next 2 characters (fourth char = bits 4-7, fifth = 0-3)
 
-	Mode 9 PIDs
+	Mode 9 PIDs (the responses are longer than a single frame and are sent segmented by ISO-TP)
 	0x0 = Mode 9 pids supported (same scheme as mode 1)
-	0x9 = How long is ECU name returned by 0x0A?
-	0xA = ASCII string of ECU name. 20 characters are to be returned, I believe 4 at a time
+	0x2 = VIN, 17 ASCII characters (CFG_PID_VIN)
+	0xA = ASCII string of ECU name, 20 characters (CFG_PID_ECU_NAME)
 
  *
  */
-void CanPIDListener::handleCanFrame(CAN_FRAME *frame) {
+void CanPIDListener::handleIsoTpMessage(int8_t session, const uint8_t *data, uint16_t length) {
+    CAN_FRAME request;
     CAN_FRAME outputFrame;
+    uint8_t vehicleInfo[23]; // mode 9 response: mode, pid, number of items, up to 20 characters
+    uint16_t vehicleInfoLength = 0;
     bool ret;
 
-    if ((frame->id == 0x7E0) || (frame->id == 0x7DF)) {
+    // the PID code works on the single frame layout (byte 0 = length)
+    memset(request.data.bytes, 0, 8);
+    request.data.bytes[0] = length;
+    memcpy(&request.data.bytes[1], data, min(length, 7));
+    const CAN_FRAME *frame = &request;
+
+    if (length >= 2) {
         //Do some common setup for our output - we won't pull the trigger unless we need to.
         outputFrame.id = 0x7E8; //first ECU replying - TODO: Perhaps allow this to be configured from 0x7E8 - 0x7EF
         outputFrame.data.bytes[1] = frame->data.bytes[1] + 0x40; //to show that this is a response
@@ -131,6 +144,7 @@ void CanPIDListener::handleCanFrame(CAN_FRAME *frame) {
         case 8: //control operation of on-board systems - this sounds really proprietary and dangerous. Maybe ignore this?
             break;
         case 9: //request vehicle info - We can identify ourselves here but little else
+            ret = processVehicleInfo(frame, vehicleInfo, vehicleInfoLength);
             break;
         case 0x20: //custom PID codes we made up for GEVCU
             break;
@@ -139,14 +153,22 @@ void CanPIDListener::handleCanFrame(CAN_FRAME *frame) {
         //here is where we'd send out response. Right now it sends over canbus but when we support other
         //alteratives they'll be sending here too.
         if (ret) {
-            canHandlerEv.sendFrame(outputFrame);
+            bool sent;
+            if (vehicleInfoLength > 0) {
+                sent = isoTpHandlerEv.send(physicalSession, vehicleInfo, vehicleInfoLength);
+            } else {
+                sent = isoTpHandlerEv.send(physicalSession, &outputFrame.data.bytes[1], outputFrame.data.bytes[0]);
+            }
+            if (!sent) {
+                Logger::warn(PIDLISTENER, "response to mode %X pid %X dropped, the ISO-TP session is busy", frame->data.bytes[1], frame->data.bytes[2]);
+            }
         }
     }
 }
 
 
 //Process SAE standard PID requests. Function returns whether it handled the request or not.
-bool CanPIDListener::processShowData(CAN_FRAME* inFrame, CAN_FRAME& outFrame) {
+bool CanPIDListener::processShowData(const CAN_FRAME* inFrame, CAN_FRAME& outFrame) {
     MotorController* motorController = deviceManager.getMotorController();
     int temp;
 
@@ -278,13 +300,52 @@ bool CanPIDListener::processShowData(CAN_FRAME* inFrame, CAN_FRAME& outFrame) {
     return false;
 }
 
-bool CanPIDListener::processShowCustomData(CAN_FRAME* inFrame, CAN_FRAME& outFrame) {
+bool CanPIDListener::processShowCustomData(const CAN_FRAME* inFrame, CAN_FRAME& outFrame) {
     int pid = inFrame->data.bytes[2] * 256 + inFrame->data.bytes[3];
     switch (pid) {
     }
     return false;
 }
 
+//Process mode 9 vehicle information requests. The response is written to a buffer as it doesn't fit into a single frame.
+bool CanPIDListener::processVehicleInfo(const CAN_FRAME* inFrame, uint8_t *response, uint16_t &length) {
+    const char *text;
+    uint8_t textLength;
+    uint8_t size;
+
+    response[0] = 0x49; //mode 9 + 0x40 to show that this is a response
+    response[1] = inFrame->data.bytes[2];
+
+    switch (inFrame->data.bytes[2]) {
+    case 0: //mode 9 pids we support - bitfield
+        response[2] = 0b01000000; //pids 1 - 8: VIN
+        response[3] = 0b01000000; //pids 9 - 0x10: ECU name
+        response[4] = 0;
+        response[5] = 0;
+        length = 6;
+        return true;
+    case 2: //VIN
+        text = CFG_PID_VIN;
+        textLength = sizeof(CFG_PID_VIN) - 1;
+        size = 17;
+        break;
+    case 0xA: //ECU name (may contain zeros, so the length of the literal is used)
+        text = CFG_PID_ECU_NAME;
+        textLength = sizeof(CFG_PID_ECU_NAME) - 1;
+        size = 20;
+        break;
+    default:
+        return false;
+    }
+
+    response[2] = 1; //number of data items
+    for (uint8_t i = 0; i < size; i++) {
+        response[3 + i] = (i < textLength ? text[i] : 0); //pad with zeros
+    }
+    length = 3 + size;
+    return true;
+}
+
 DeviceId CanPIDListener::getId() {
     return PIDLISTENER;
 }
@@ -33,6 +33,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "DeviceManager.h"
 #include "TickHandler.h"
 #include "CanHandler.h"
+#include "IsoTpHandler.h"
 #include "constants.h"
 
 
@@ -43,12 +44,12 @@ public:
     bool useExtended;
 };
 
-class CanPIDListener: public Device, CanObserver {
+class CanPIDListener: public Device, IsoTpObserver {
 public:
     CanPIDListener();
     void setup();
     void handleTick();
-    void handleCanFrame(CAN_FRAME *frame);
+    void handleIsoTpMessage(int8_t session, const uint8_t *data, uint16_t length);
     DeviceId getId();
 
     void loadConfiguration();
@@ -60,8 +61,11 @@ private:
     uint32_t responseId; // the CAN id with which the response is sent;
     uint32_t responseMask; // the mask for the responseId
     bool responseExtended; // if the response is expected as an extended frame
-    bool processShowData(CAN_FRAME* inFrame, CAN_FRAME& outFrame);
-    bool processShowCustomData(CAN_FRAME* inFrame, CAN_FRAME& outFrame);
+    int8_t physicalSession; // ISO-TP session for requests to our id, also used to send all responses
+    int8_t functionalSession; // ISO-TP session for requests to all ECUs (single frames only)
+    bool processShowData(const CAN_FRAME* inFrame, CAN_FRAME& outFrame);
+    bool processShowCustomData(const CAN_FRAME* inFrame, CAN_FRAME& outFrame);
+    bool processVehicleInfo(const CAN_FRAME* inFrame, uint8_t *response, uint16_t &length);
 };
 
 #endif //CAN_PID_H_
@@ -31,10 +31,11 @@ CanThrottle::CanThrottle() : Throttle() {
     rawSignal.input1 = 0;
     rawSignal.input2 = 0;
     rawSignal.input3 = 0;
-    ticksNoResponse = 255; // invalidate input signal until response is received
+    responseWatch = -1; // the input signal is invalid until a response is received
     responseId = 0;
     responseMask = 0x7ff;
     responseExtended = false;
+    requestMessage = -1;
 
     commonName = "CANBus accelerator";
 }
@@ -78,27 +79,24 @@ void CanThrottle::setup() {
     }
 
     canHandlerCar.attach(this, responseId, responseMask, responseExtended);
-    tickHandler.attach(this, CFG_TICK_INTERVAL_CAN_THROTTLE);
-}
-
-/*
- * Send a request to the ECU.
- *
- */
-void CanThrottle::handleTick() {
-    Throttle::handleTick(); // Call parent handleTick
+    uint32_t interval = loadTickInterval(CFG_TICK_INTERVAL_CAN_THROTTLE);
+    tickHandler.attach(this, interval, TICK_PRIORITY_CONTROL);
 
-    canHandlerCar.sendFrame(requestFrame);
+    // a response is expected for every request, tolerate a few lost ones
+    canHandlerCar.unwatchFrames(responseWatch);
+    responseWatch = canHandlerCar.watchFrames(responseId, responseMask, responseExtended, interval, CFG_CANTHROTTLE_MAX_NUM_LOST_MSG - 1, NULL);
 
-    if (ticksNoResponse < 255) // make sure it doesn't overflow
-        ticksNoResponse++;
+    // the request is sent by the can handler's cyclic scheduler
+    canHandlerCar.removeCyclicMessage(requestMessage);
+    requestMessage = canHandlerCar.addCyclicMessage(requestFrame.id, requestFrame.extended, interval, NULL, CAN_TX_PRIORITY_HIGH);
+    canHandlerCar.setCyclicPayload(requestMessage, requestFrame);
 }
 
 /*
  * Handle the response of the ECU and calculate the throttle value
  *
  */
-void CanThrottle::handleCanFrame(CAN_FRAME *frame) {
+void CanThrottle::handleCanFrame(const CAN_FRAME *frame) {
     CanThrottleConfiguration *config = (CanThrottleConfiguration *)getConfiguration();
 
     if (frame->id == responseId) {
@@ -110,7 +108,6 @@ void CanThrottle::handleCanFrame(CAN_FRAME *frame) {
             rawSignal.input1 = (frame->data.bytes[5] + 1) * frame->data.bytes[6];
             break;
         }
-        ticksNoResponse = 0;
     }
 }
 
@@ -121,9 +118,9 @@ RawSignalData* CanThrottle::acquireRawSignal() {
 bool CanThrottle::validateSignal(RawSignalData* rawSignal) {
     CanThrottleConfiguration *config = (CanThrottleConfiguration *) getConfiguration();
 
-    if (ticksNoResponse >= CFG_CANTHROTTLE_MAX_NUM_LOST_MSG) {
+    if (!canHandlerCar.isFresh(responseWatch)) {
         if (status == OK)
-            Logger::error(CANACCELPEDAL, "no response on position request received: %d ", ticksNoResponse);
+            Logger::error(CANACCELPEDAL, "no response on position request received");
         status = ERR_MISC;
         return false;
     }
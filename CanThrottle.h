@@ -51,8 +51,7 @@ class CanThrottle: public Throttle, CanObserver {
 public:
     CanThrottle();
     void setup();
-    void handleTick();
-    void handleCanFrame(CAN_FRAME *frame);
+    void handleCanFrame(const CAN_FRAME *frame);
     DeviceId getId();
 
     RawSignalData *acquireRawSignal();
@@ -65,8 +64,9 @@ protected:
 
 private:
     CAN_FRAME requestFrame; // the request frame sent to the car
+    int8_t requestMessage; // handle of the cyclic message which sends the request
     RawSignalData rawSignal; // raw signal
-    uint8_t ticksNoResponse; // number of ticks no response was received
+    int8_t responseWatch; // handle of the watch on the responses of the ECU
     uint32_t responseId; // the CAN id with which the response is sent;
     uint32_t responseMask; // the mask for the responseId
     bool responseExtended; // if the response is expected as an extended frame
@@ -43,7 +43,6 @@ template<class T> inline Print &operator <<(Print &obj, T arg) {
     return obj;
 }
 
-long mss;
 extern bool runThrottle;
 const uint8_t swizzleTable[] = { 0xAA, 0x7F, 0xFE, 0x29, 0x52, 0xA4, 0x9D, 0xEF, 0xB, 0x16, 0x2C, 0x58, 0xB0, 0x60, 0xC0, 1 };
 
@@ -54,7 +53,7 @@ CodaMotorController::CodaMotorController() : MotorController()
 
     prefsHandler = new PrefHandler(CODAUQM);
     operationState = ENABLE;
-    online = 0;
+    rxWatch = -1;
     activityCount = 0;
     sequence=0;
     commonName = "Coda UQM Powerphase 100 Inverter";
@@ -74,23 +73,36 @@ void CodaMotorController::setup()
 
     // register ourselves as observer of all 0x20x can frames for UQM
     canHandlerEv.attach(this, 0x200, 0x7f0, false);
+    canHandlerEv.unwatchFrames(rxWatch);
+    rxWatch = canHandlerEv.watchFrames(0x200, 0x7f0, false, CFG_MOTORCTRL_RX_TIMEOUT, 0, this);
 
     operationState=ENABLE;
     selectedGear=DRIVE;
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER_CODAUQM);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_MOTOR_CONTROLLER_CODAUQM), TICK_PRIORITY_CONTROL);
 }
 
 
-void CodaMotorController::handleCanFrame(CAN_FRAME *frame)
+/*
+ * No frame was received from the UQM for CFG_MOTORCTRL_RX_TIMEOUT
+ */
+void CodaMotorController::handleCanTimeout(int8_t watch)
+{
+    running = false;
+}
+
+/*
+ * Frames are received from the UQM (again)
+ */
+void CodaMotorController::handleCanRecovery(int8_t watch)
+{
+    faultHandler.cancelOngoingFault(CODAUQM, FAULT_MOTORCTRL_COMM); // we're newly running, cancel faults if necessary
+    running = true;
+}
+
+void CodaMotorController::handleCanFrame(const CAN_FRAME *frame)
 {
     int RotorTemp, invTemp, StatorTemp;
     int temp;
-    online = 1; //if a frame got to here then it passed the filter and must come from UQM
-    if (!running) //if we're newly running then cancel faults if necessary.
-    {
-        faultHandler.cancelOngoingFault(CODAUQM, FAULT_MOTORCTRL_COMM);
-    }
-    running=true;
     Logger::debug("UQM inverter msg: %X   %X   %X   %X   %X   %X   %X   %X  %X", frame->id, frame->data.bytes[0],
                   frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],
                   frame->data.bytes[5],frame->data.bytes[6],frame->data.bytes[7]);
@@ -158,16 +170,6 @@ void CodaMotorController::handleTick() {
     MotorController::handleTick(); //kick the ball up to papa
     sendCmd1();   //Send our lone torque command
 
-    if(!online)  //This routine checks to see if we have received any frames from the inverter.  If so, ONLINE would be true and
-    {   //we set the RUNNING light on.  If no frames are received for 2 seconds, we set running OFF.
-        if (millis()-mss>2000)
-        {
-            running=false; // We haven't received any frames for over 2 seconds.  Otherwise online would be true.
-            mss=millis();   //Reset our 2 second timer
-        }
-    }
-    else running=true;
-    online=false;//This flag will be set to true by received frames
 
 }
 
@@ -248,7 +250,7 @@ void CodaMotorController::sendCmd1()
     output.data.bytes[2] = (torqueCommand & 0x00FF);
     output.data.bytes[4] = genCodaCRC(output.data.bytes[1], output.data.bytes[2], output.data.bytes[3]); //Calculate security byte
 
-    canHandlerEv.sendFrame(output);  //Mail it.
+    canHandlerEv.sendFrame(output, CAN_TX_PRIORITY_HIGH);  //Mail it.
     timestamp();
 
     Logger::debug("Torque command: %X   %X  ControlByte: %X  LSB %X  MSB: %X  CRC: %X  %d:%d:%d.%d",output.id, output.data.bytes[0],
@@ -49,7 +49,9 @@ class CodaMotorController: public MotorController, CanObserver {
 
 public:
     virtual void handleTick();
-    virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanFrame(const CAN_FRAME *frame);
+    virtual void handleCanTimeout(int8_t watch);
+    virtual void handleCanRecovery(int8_t watch);
     virtual void setup();
 
     CodaMotorController();
@@ -62,7 +64,7 @@ public:
     virtual void saveConfiguration();
 
 private:
-    byte online; //counter for whether DMOC appears to be operating
+    int8_t rxWatch; // handle of the watch on the frames from the inverter
     byte alive;
     int activityCount;
     byte sequence;
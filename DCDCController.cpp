@@ -42,12 +42,13 @@ DCDCController::DCDCController() : Device()
     //prefsHandler->setEnabledStatus(true);
 
     commonName = "Delphi DC-DC Converter";
+    cmdMessage = -1;
 
 }
 
 
 
-void DCDCController::handleCanFrame(CAN_FRAME *frame)
+void DCDCController::handleCanFrame(const CAN_FRAME *frame)
 {
     Logger::debug("DCDC msg: %X", frame->id);
     Logger::debug("DCDC data: %X%X%X%X%X%X%X%X", frame->data.bytes[0],frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],frame->data.bytes[5],frame->data.bytes[6],frame->data.bytes[7]);
@@ -64,7 +65,12 @@ void DCDCController::setup()
 
     canHandlerCar.attach(this, 0x1D5, 0x7ff, false);
     //Watch for 0x1D5 messages from Delphi converter
-    tickHandler.attach(this, CFG_TICK_INTERVAL_DCDC);
+    uint32_t interval = loadTickInterval(CFG_TICK_INTERVAL_DCDC);
+    tickHandler.attach(this, interval);
+
+    // the command is sent by the can handler's cyclic scheduler, handleTick() only updates it
+    canHandlerCar.removeCyclicMessage(cmdMessage);
+    cmdMessage = canHandlerCar.addCyclicMessage(0x1D7, false, interval);
 }
 
 
@@ -72,7 +78,7 @@ void DCDCController::handleTick() {
 
     Device::handleTick(); //kick the ball up to papa
 
-    sendCmd();   //Send our Delphi voltage control command
+    sendCmd();   //Update our Delphi voltage control command
 
 }
 
@@ -107,7 +113,7 @@ void DCDCController::sendCmd()
     output.data.bytes[6] = 0;
     output.data.bytes[7] = 0x00;
 
-    canHandlerCar.sendFrame(output);
+    canHandlerCar.setCyclicPayload(cmdMessage, output);
     timestamp();
     Logger::debug("Delphi DC-DC cmd: %X %X %X %X %X %X %X %X %X  %d:%d:%d.%d",output.id, output.data.bytes[0],
                   output.data.bytes[1],output.data.bytes[2],output.data.bytes[3],output.data.bytes[4],output.data.bytes[5],output.data.bytes[6],output.data.bytes[7], hours, minutes, seconds, milliseconds);
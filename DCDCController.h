@@ -46,7 +46,7 @@ public:
 class DCDCController: public Device, CanObserver {
 public:
     virtual void handleTick();
-    virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanFrame(const CAN_FRAME *frame);
     virtual void setup();
 
     DCDCController();
@@ -62,6 +62,7 @@ private:
     int seconds;
     int minutes;
     int hours;
+    int8_t cmdMessage; // handle of the cyclic message which sends the command
     void sendCmd();
 };
 
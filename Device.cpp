@@ -30,6 +30,8 @@
 Device::Device() {
     deviceConfiguration = NULL;
     prefsHandler = NULL;
+    tickInterval = 0;
+    idleTickRate = false;
     //since all derived classes eventually call this base method this will cause every device to auto register itself with the device manager
     deviceManager.addDevice(this);
     commonName = "Generic Device";
@@ -51,6 +53,68 @@ uint32_t Device::getTickInterval() {
     return 0;
 }
 
+/*
+ * Return the interval the device should be attached to the TickHandler with.
+ * This is the default of the device unless an override is stored in its EEPROM
+ * section (EE_TICK_INTERVAL). Must be called once in setup() before attaching.
+ */
+uint32_t Device::loadTickInterval(uint32_t defaultInterval) {
+    uint32_t interval = 0;
+
+    if (prefsHandler) {
+        prefsHandler->read(EE_TICK_INTERVAL, &interval);
+    }
+    if (interval < CFG_TIMER_BASE_INTERVAL || interval > 10000000) { // not set (or garbage from an older layout)
+        interval = defaultInterval;
+    } else {
+        Logger::info("using tick interval override of %lus for %s", interval, commonName);
+    }
+    tickInterval = interval;
+    idleTickRate = false;
+    return interval;
+}
+
+/*
+ * Store an interval in EEPROM which replaces the default tick interval of the
+ * device (0 = back to the default, applied after a power cycle) and apply it immediately.
+ */
+void Device::setTickIntervalOverride(uint32_t interval) {
+    if (!prefsHandler) {
+        return;
+    }
+    prefsHandler->write(EE_TICK_INTERVAL, interval);
+    prefsHandler->saveChecksum();
+    if (interval >= CFG_TIMER_BASE_INTERVAL && tickInterval != 0) {
+        tickInterval = interval;
+        if (!idleTickRate) {
+            tickHandler.setInterval(this, tickInterval);
+        }
+    }
+}
+
+/*
+ * Switch between the full tick rate and the slow CFG_TICK_INTERVAL_IDLE rate
+ * (which is never faster than the full rate).
+ */
+void Device::setIdleTickRate(bool idle) {
+    if (idle == idleTickRate || tickInterval == 0) {
+        return;
+    }
+    idleTickRate = idle;
+    tickHandler.setInterval(this, getActiveTickInterval());
+    Logger::debug("%s now ticks at %s rate", commonName, (idle ? "idle" : "full"));
+}
+
+/*
+ * The interval the device is currently ticked with.
+ */
+uint32_t Device::getActiveTickInterval() {
+    if (idleTickRate && tickInterval < CFG_TICK_INTERVAL_IDLE) {
+        return CFG_TICK_INTERVAL_IDLE;
+    }
+    return tickInterval;
+}
+
 //just bubbles up the value from the preference handler.
 bool Device::isEnabled() {
     return prefsHandler->isEnabled();
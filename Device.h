@@ -57,6 +57,8 @@ public:
     void handleTick();
     bool isEnabled();
     virtual uint32_t getTickInterval();
+    void setTickIntervalOverride(uint32_t interval);
+    void setIdleTickRate(bool idle);
     char* getCommonName();
 
     virtual void loadConfiguration();
@@ -67,6 +69,11 @@ public:
 protected:
     PrefHandler *prefsHandler;
     char *commonName;
+    uint32_t tickInterval; // the interval the device is attached to the TickHandler with at full rate
+    bool idleTickRate; // true if the device currently runs at CFG_TICK_INTERVAL_IDLE
+
+    uint32_t loadTickInterval(uint32_t defaultInterval);
+    uint32_t getActiveTickInterval();
 
 private:
     DeviceConfiguration *deviceConfiguration; // reference to the currently active configuration
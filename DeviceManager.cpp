@@ -238,6 +238,18 @@ Device *DeviceManager::getDeviceByType(DeviceType type)
     return 0; //NULL!
 }
 
+/*
+Find the device which is registered at the TickHandler as the given observer.
+*/
+Device *DeviceManager::getDeviceByTickObserver(TickObserver *observer)
+{
+    for (int i = 0; i < CFG_DEV_MGR_MAX_DEVICES; i++)
+    {
+        if (devices[i] && (TickObserver *) devices[i] == observer) return devices[i];
+    }
+    return 0; //NULL!
+}
+
 /*
  * Find the position of a device in the devices array
  * /retval the position of the device or -1 if not found.
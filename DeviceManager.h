@@ -56,6 +56,7 @@ public:
     MotorController *getMotorController();
     Device *getDeviceByID(DeviceId);
     Device *getDeviceByType(DeviceType);
+    Device *getDeviceByTickObserver(TickObserver *observer);
     void printDeviceList();
     void updateWifi();
     Device *updateWifiByID(DeviceId);
@@ -44,7 +44,6 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "DmocMotorController.h"
 
 extern bool runThrottle; //TODO: remove use of global variables !
-long ms;
 
 DmocMotorController::DmocMotorController() : MotorController() {
     prefsHandler = new PrefHandler(DMOC645);
@@ -53,7 +52,8 @@ DmocMotorController::DmocMotorController() : MotorController() {
     selectedGear = NEUTRAL;
     operationState = DISABLED;
     actualState = DISABLED;
-    online = 0;
+    statusWatch = -1;
+    temperatureWatch = -1;
     activityCount = 0;
 //	maxTorque = 2000;
     commonName = "DMOC645 Inverter";
@@ -70,14 +70,36 @@ void DmocMotorController::setup() {
     // register ourselves as observer of 0x23x and 0x65x can frames
     canHandlerEv.attach(this, 0x230, 0x7f0, false);
     canHandlerEv.attach(this, 0x650, 0x7f0, false);
+    // the inverter is running as long as it sends any of these frames
+    canHandlerEv.unwatchFrames(statusWatch);
+    canHandlerEv.unwatchFrames(temperatureWatch);
+    statusWatch = canHandlerEv.watchFrames(0x230, 0x7f0, false, CFG_MOTORCTRL_RX_TIMEOUT, 0, this);
+    temperatureWatch = canHandlerEv.watchFrames(0x650, 0x7f0, false, CFG_MOTORCTRL_RX_TIMEOUT, 0, this);
 
     running = false;
     setPowerMode(modeTorque);
     setSelectedGear(NEUTRAL);
     setOpState(DISABLED );
-    ms=millis();
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC), TICK_PRIORITY_CONTROL);
+#ifdef CFG_DMOC_COMMANDS_IN_INTERRUPT
+    tickHandler.detach(&commandSender);
+    tickHandler.attach(&commandSender, tickInterval, TICK_PRIORITY_INTERRUPT);
+#endif
+}
+
+/*
+ * No 0x23x or 0x65x frame was received from the inverter for CFG_MOTORCTRL_RX_TIMEOUT
+ */
+void DmocMotorController::handleCanTimeout(int8_t watch) {
+    running = canHandlerEv.isFresh(statusWatch) || canHandlerEv.isFresh(temperatureWatch);
+}
+
+/*
+ * Frames are received from the inverter (again)
+ */
+void DmocMotorController::handleCanRecovery(int8_t watch) {
+    running = true;
 }
 
 /*
@@ -88,12 +110,11 @@ void DmocMotorController::setup() {
  everything has gone according to plan.
  */
 
-void DmocMotorController::handleCanFrame(CAN_FRAME *frame) {
+void DmocMotorController::handleCanFrame(const CAN_FRAME *frame) {
     int RotorTemp, invTemp, StatorTemp;
     int temp;
-    online = true; //if a frame got to here then it passed the filter and must have been from the DMOC
 
-    Logger::debug("DMOC CAN received: %X  %X  %X  %X  %X  %X  %X  %X  %X", frame->id,frame->data.bytes[0] ,frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],frame->data.bytes[5],frame->data.bytes[6],frame->data.bytes[70]);
+    Logger::debug("DMOC CAN received: %X  %X  %X  %X  %X  %X  %X  %X  %X", frame->id,frame->data.bytes[0] ,frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],frame->data.bytes[5],frame->data.bytes[6],frame->data.bytes[7]);
 
 
     switch (frame->id) {
@@ -203,17 +224,6 @@ void DmocMotorController::handleTick() {
         setSelectedGear(NEUTRAL); //We will stay in NEUTRAL until we get at least 40 frames ahead indicating continous communications.
     }
 
-    if(!online)  //This routine checks to see if we have received any frames from the inverter.  If so, ONLINE would be true and
-    {   //we set the RUNNING light on.  If no frames are received for 2 seconds, we set running OFF.
-        if ((millis()-ms)>2000)
-        {
-            running=false; // We haven't received any frames for over 2 seconds.  Otherwise online would be true.
-            ms=millis();   //Reset our 2 second timer
-        }
-    }
-    else running=true;
-    online=false;//This flag will be set to 1 by received frames.
-
 
     sendCmd1();  //This actually sets our GEAR and our actualstate cycle
     sendCmd2();  //This is our torque command
@@ -221,6 +231,11 @@ void DmocMotorController::handleTick() {
     //sendCmd4();  //These appear to be not needed.
     //sendCmd5();  //But we'll keep them for future reference
 
+#ifdef CFG_DMOC_COMMANDS_IN_INTERRUPT
+    commands.tick = tickHandler.getTickCount();
+    commands.maxAge = CFG_DMOC_COMMAND_MAX_AGE * tickInterval / CFG_TIMER_BASE_INTERVAL;
+    commandSender.publish(commands);
+#endif
 
 }
 
@@ -267,7 +282,7 @@ void DmocMotorController::sendCmd1() {
     Logger::debug("DMOC 0x232 tx: %X %X %X %X %X %X %X %X", output.data.bytes[0], output.data.bytes[1], output.data.bytes[2], output.data.bytes[3],
                   output.data.bytes[4], output.data.bytes[5], output.data.bytes[6], output.data.bytes[7]);
 
-    canHandlerEv.sendFrame(output);
+    sendCommandFrame(output);
 }
 
 void DmocMotorController::taperRegen()
@@ -345,7 +360,7 @@ void DmocMotorController::sendCmd2() {
 
     //Logger::debug("requested torque: %i",(((long) throttleRequested * (long) maxTorque) / 1000L));
 
-    canHandlerEv.sendFrame(output);
+    sendCommandFrame(output);
     timestamp();
     Logger::debug("Torque command: %X  %X  %X  %X  %X  %X  %X  CRC: %X",output.data.bytes[0],
                   output.data.bytes[1],output.data.bytes[2],output.data.bytes[3],output.data.bytes[4],output.data.bytes[5],output.data.bytes[6],output.data.bytes[7]);
@@ -371,7 +386,7 @@ void DmocMotorController::sendCmd3() {
     output.data.bytes[6] = alive;
     output.data.bytes[7] = calcChecksum(output);
 
-    canHandlerEv.sendFrame(output);
+    sendCommandFrame(output);
 }
 
 //challenge/response frame 1 - Really doesn't contain anything we need I dont think
@@ -432,6 +447,18 @@ void DmocMotorController::setGear(Gears gear) {
     //when in neutral and I don't think people will like that.
 }
 
+/*
+ * Send one of the command frames 0x232 to 0x234, either directly or (if they're
+ * sent from the timer interrupt) by staging it for the DmocCommandSender.
+ */
+void DmocMotorController::sendCommandFrame(CAN_FRAME &frame) {
+#ifdef CFG_DMOC_COMMANDS_IN_INTERRUPT
+    commands.frames[frame.id - 0x232] = frame;
+#else
+    canHandlerEv.sendFrame(frame, CAN_TX_PRIORITY_HIGH);
+#endif
+}
+
 //this might look stupid. You might not believe this is real. It is. This is how you
 //calculate the checksum for the DMOC frames.
 byte DmocMotorController::calcChecksum(CAN_FRAME thisFrame) {
@@ -482,4 +509,38 @@ void DmocMotorController::timestamp()
 
 }
 
+#ifdef CFG_DMOC_COMMANDS_IN_INTERRUPT
+DmocCommandSender::DmocCommandSender() {
+    alive = 0;
+}
+
+/*
+ * Hand over a new set of command frames (called from DmocMotorController::handleTick()).
+ */
+void DmocCommandSender::publish(DmocCommands &commands) {
+    mailbox.write(commands);
+}
+
+/*
+ * Runs in the timer interrupt: send the most recent command frames with a fresh
+ * alive counter and checksum. Must stay short, no logging here.
+ */
+void DmocCommandSender::handleTick() {
+    DmocCommands commands;
+
+    if (!mailbox.read(commands)) {
+        return;
+    }
+    if (tickHandler.getTickCount() - commands.tick > commands.maxAge) {
+        return; // loop() stalled, let the DMOC time out
+    }
 
+    alive = (alive + 2) & 0x0F;
+    for (int i = 0; i < 3; i++) {
+        CAN_FRAME &frame = commands.frames[i];
+        frame.data.bytes[6] = (frame.data.bytes[6] & 0xF0) | alive;
+        frame.data.bytes[7] = DmocMotorController::calcChecksum(frame);
+        canHandlerEv.sendFrame(frame, CAN_TX_PRIORITY_HIGH);
+    }
+}
+#endif
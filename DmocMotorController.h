@@ -43,6 +43,36 @@ class DmocMotorControllerConfiguration : public MotorControllerConfiguration {
 public:
 };
 
+#ifdef CFG_DMOC_COMMANDS_IN_INTERRUPT
+/*
+ * The command frames (0x232, 0x233, 0x234) prepared by DmocMotorController::handleTick()
+ */
+struct DmocCommands {
+    CAN_FRAME frames[3];
+    uint32_t tick; // TickHandler tick count when the frames were prepared
+    uint32_t maxAge; // number of base ticks after which the frames are no longer sent
+};
+
+/*
+ * Sends the DMOC command frames directly from the timer interrupt so they
+ * don't wait for whatever loop() is doing. The frames are prepared in the
+ * queued handleTick() of the DmocMotorController and handed over through a
+ * TickMailbox, the sender only adds the alive counter and the checksum.
+ * If the frames weren't updated for CFG_DMOC_COMMAND_MAX_AGE intervals, it
+ * stops sending so the DMOC still detects a stalled controller.
+ */
+class DmocCommandSender: public TickObserver {
+public:
+    DmocCommandSender();
+    void handleTick();
+    void publish(DmocCommands &commands);
+
+private:
+    TickMailbox<DmocCommands> mailbox;
+    byte alive;
+};
+#endif
+
 class DmocMotorController: public MotorController, CanObserver {
 public:
 
@@ -62,7 +92,9 @@ public:
 
 public:
     virtual void handleTick();
-    virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanFrame(const CAN_FRAME *frame);
+    virtual void handleCanTimeout(int8_t watch);
+    virtual void handleCanRecovery(int8_t watch);
     virtual void setup();
     void setGear(Gears gear);
 
@@ -73,12 +105,14 @@ public:
 
     virtual void loadConfiguration();
     virtual void saveConfiguration();
+    static byte calcChecksum(CAN_FRAME thisFrame);
 
 private:
 
     OperationState actualState; //what the controller is reporting it is
     int step;
-    byte online; //counter for whether DMOC appears to be operating
+    int8_t statusWatch; // handles of the watches on the frames from the inverter
+    int8_t temperatureWatch;
     byte alive;
     int activityCount;
     uint16_t torqueCommand;
@@ -89,7 +123,11 @@ private:
     void sendCmd3();
     void sendCmd4();
     void sendCmd5();
-    byte calcChecksum(CAN_FRAME thisFrame);
+    void sendCommandFrame(CAN_FRAME &frame);
+#ifdef CFG_DMOC_COMMANDS_IN_INTERRUPT
+    DmocCommandSender commandSender;
+    DmocCommands commands;
+#endif
 
 };
 
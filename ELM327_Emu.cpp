@@ -75,7 +75,7 @@ void ELM327Emu::setup() {
 
     //this isn't a wifi link but the timer interval can be the same
     //because it serves a similar function and has similar timing requirements
-    tickHandler.attach(this, CFG_TICK_INTERVAL_WIFI);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_WIFI), TICK_PRIORITY_BACKGROUND);
 }
 
 /*
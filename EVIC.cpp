@@ -45,6 +45,8 @@ template<class T> inline Print &operator <<(Print &obj, T arg) {
 EVIC::EVIC() : Device()
 {
     prefsHandler = new PrefHandler(EVICTUS);
+    measurementWatch = -1;
+    statusWatch = -1;
 
     commonName = "Andromeda Interfaces EVIC Display";
 }
@@ -63,9 +65,13 @@ void EVIC::setup() {
 
     Device::setup(); // run the parent class version of this function
 
-    // register ourselves as observer of all 0x404 and 0x505 can frames from JLD505
-    canHandlerCar.attach(this, 0x404, 0x7ff, false);
-    canHandlerCar.attach(this, 0x505, 0x7ff, false);
+    // register ourselves as observer of all 0x404 and 0x505 can frames from JLD505 (only when their content changes)
+    canHandlerCar.attach(this, 0x404, 0x7ff, false, true);
+    canHandlerCar.attach(this, 0x505, 0x7ff, false, true);
+    canHandlerCar.unwatchFrames(measurementWatch);
+    canHandlerCar.unwatchFrames(statusWatch);
+    measurementWatch = canHandlerCar.watchFrames(0x404, 0x7ff, false, CFG_EVIC_JLD505_TIMEOUT, 0, NULL);
+    statusWatch = canHandlerCar.watchFrames(0x505, 0x7ff, false, CFG_EVIC_JLD505_TIMEOUT, 0, NULL);
 
     MotorController* motorController = deviceManager.getMotorController();
     nominalVolt=(motorController->nominalVolts); //Get default nominal volts and capacity from motorcontroller
@@ -84,16 +90,16 @@ void EVIC::setup() {
     CellHi=63;
     Cello=60;
 
-    elapsedtime=timemark = timemark2=millis();
+    elapsedtime = timemark2=millis();
     rpm=0;  //Increment all our test variables each time
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_EVIC);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_EVIC));
 
 }
 
 
 //This method handles particular received CAN frames we have registered for
-void EVIC::handleCanFrame(CAN_FRAME *frame)
+void EVIC::handleCanFrame(const CAN_FRAME *frame)
 {
 
     Logger::debug("EVIC received msg: %X   %X   %X   %X   %X   %X   %X   %X  %X", frame->id, frame->data.bytes[0],
@@ -114,7 +120,6 @@ void EVIC::handleCanFrame(CAN_FRAME *frame)
 
 
         Logger::debug("JLD404 DC Voltage: %d Amps: %d AH: %d Capacity: %d SOC: %d", dcVoltage,dcCurrent,AH,capacity,SOC);
-        timemark=millis();  //We'll use this to indicate how long since we received from a 505.
         break;
 
     case 0x505:    //System Status Message
@@ -150,7 +155,6 @@ void EVIC::handleCanFrame(CAN_FRAME *frame)
 
 
         Logger::debug("JLD505 Message Received Power output: %d kiloWatt-Hours: %d ", Power/10,kWh/10);
-        timemark=millis();
         break;
     }
 }
@@ -209,7 +213,7 @@ void EVIC::sendTestCmdCurtis()
     output.data.bytes[6] = highByte(DCV);
     output.data.bytes[7] = lowByte(DCV);
 
-    canHandlerCar.sendFrame(output);  //Mail it.
+    canHandlerCar.sendFrame(output, CAN_TX_PRIORITY_LOW);  //Mail it.
 
     timestamp();
 
@@ -236,7 +240,7 @@ void EVIC::sendTestCmdOrion()
     output.data.bytes[6] = 0;  //Cell temp
     output.data.bytes[7] = 0; //Cell temp
 
-    canHandlerCar.sendFrame(output);  //Mail it.
+    canHandlerCar.sendFrame(output, CAN_TX_PRIORITY_LOW);  //Mail it.
     timestamp();
 
     Logger::debug("Orion Message1: %X  %X %X %X %X %X %X %X %X  %d:%d:%d.%d",output.id, output.data.bytes[0],
@@ -257,7 +261,7 @@ void EVIC::sendTestCmdOrion()
     output.data.bytes[6] = 0;  //pack cycles MSB
     output.data.bytes[7] = 0; //pack cycles LSB
 
-    canHandlerCar.sendFrame(output);  //Mail it.
+    canHandlerCar.sendFrame(output, CAN_TX_PRIORITY_LOW);  //Mail it.
     timestamp();
 
     Logger::debug("Orion Message2: %X  %X %X %X %X %X %X %X %X  %d:%d:%d.%d",output.id, output.data.bytes[0],
@@ -265,12 +269,20 @@ void EVIC::sendTestCmdOrion()
 
 }
 
+/*
+ * Returns true if any of the JLD505's messages was received within CFG_EVIC_JLD505_TIMEOUT
+ */
+bool EVIC::isJld505Online()
+{
+    return canHandlerCar.isFresh(measurementWatch) || canHandlerCar.isFresh(statusWatch);
+}
+
 void EVIC::sendCmdCurtis()
 {
 
     MotorController* motorController = deviceManager.getMotorController();
 
-    if(millis()-timemark>2000)
+    if(!isJld505Online())
     {
         dcCurrent=motorController->getDcCurrent();
         dcVoltage=motorController->getDcVoltage();
@@ -291,7 +303,7 @@ void EVIC::sendCmdCurtis()
     output.data.bytes[6] = highByte(dcVoltage);
     output.data.bytes[7] = lowByte(dcVoltage);
 
-    canHandlerCar.sendFrame(output);  //Mail it.
+    canHandlerCar.sendFrame(output, CAN_TX_PRIORITY_LOW);  //Mail it.
     timestamp();
     Logger::debug("EVIC Message: %X  %X %X %X %X %X %X %X %X  %d:%d:%d.%d",output.id, output.data.bytes[0],
                   output.data.bytes[1],output.data.bytes[2],output.data.bytes[3],output.data.bytes[4],output.data.bytes[5],output.data.bytes[6],output.data.bytes[7], hours, minutes, seconds, milliseconds);
@@ -303,8 +315,8 @@ void EVIC::sendCmdOrion()
     elapsedtime = (millis() - timemark2);
     timemark2=millis();
 
-    if(millis()-timemark>2000) // Checks to see how long its been since JLD505 message was received.
-        //If more than 2 seconds, we'll use MotorController values and calculate what we need.
+    if(!isJld505Online()) // Checks to see if a JLD505 message was received lately.
+        //If not, we'll use MotorController values and calculate what we need.
     {
         MotorController* motorController = deviceManager.getMotorController();
         dcCurrent=(motorController->getDcCurrent());
@@ -349,7 +361,7 @@ void EVIC::sendCmdOrion()
     output.data.bytes[6] = CellHi;  //Cell temp
     output.data.bytes[7] = Cello; //Cell temp
 
-    canHandlerCar.sendFrame(output);  //Mail it.
+    canHandlerCar.sendFrame(output, CAN_TX_PRIORITY_LOW);  //Mail it.
     timestamp();
     Logger::debug("Orion Message1: %X  %X %X %X %X %X %X %X %X  %d:%d:%d.%d",output.id, output.data.bytes[0],
                   output.data.bytes[1],output.data.bytes[2],output.data.bytes[3],output.data.bytes[4],output.data.bytes[5],output.data.bytes[6],output.data.bytes[7], hours, minutes, seconds, milliseconds);
@@ -374,7 +386,7 @@ void EVIC::sendCmdOrion()
     output.data.bytes[6] = 0;  //pack cycles MSB
     output.data.bytes[7] = 0; //pack cycles LSB
 
-    canHandlerCar.sendFrame(output);  //Mail it.
+    canHandlerCar.sendFrame(output, CAN_TX_PRIORITY_LOW);  //Mail it.
     timestamp();
     Logger::debug("Orion Message2: %X  %X %X %X %X %X %X %X %X  %d:%d:%d.%d",output.id, output.data.bytes[0],
                   output.data.bytes[1],output.data.bytes[2],output.data.bytes[3],output.data.bytes[4],output.data.bytes[5],output.data.bytes[6],output.data.bytes[7], hours, minutes, seconds, milliseconds);
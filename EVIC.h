@@ -57,7 +57,7 @@ public:
     EVIC();
     //EVIC(USARTClass *which);
     virtual void handleTick();
-    virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanFrame(const CAN_FRAME *frame);
 
     virtual void setup(); //initialization on start up
     void timestamp();
@@ -85,7 +85,6 @@ public:
     uint8_t getCellHi();
     uint8_t getCello();
 
-    unsigned long timemark;
     unsigned long timemark2;
     int16_t torqueActual;
     int16_t speedActual;
@@ -112,7 +111,10 @@ private:
     void sendTestCmdOrion();
     void sendCmdCurtis();
     void sendCmdOrion();
+    bool isJld505Online();
 
+    int8_t measurementWatch; // handles of the watches on the 0x404 and 0x505 frames of the JLD505
+    int8_t statusWatch;
     double AHf;
     double milliAH;
     float  SOCf;
@@ -0,0 +1,108 @@
+/*
+ * FirmwareProtocol.h
+ *
+ * Definition of the CAN firmware update protocol, shared by the receiver in
+ * the GEVCU (FirmwareUpdater) and the sender on the host (tools/canflash).
+ * Contains no Arduino dependencies so it compiles on Linux as well.
+ *
+ * The host starts an update with the size and CRC-32 of the image. The image
+ * follows in data frames of 8 bytes, the low 6 bits of their id are the
+ * sequence number (frame index modulo 64). The GEVCU acknowledges the frames
+ * it received and grants credit for the frames which may follow (windowed
+ * flow control, limited by its page buffers and the depth of the receive ring).
+ * If a frame is lost, it requests a retransmission from the missing frame on
+ * (go-back-N). When the image is complete and its CRC verified, the host
+ * commits the update and the GEVCU installs the image and resets.
+ *
+ * Host -> GEVCU, FWUPDATE_CMD_ID:
+ *   START   0x01, size (3 bytes), CRC-32 (4 bytes), little endian
+ *   COMMIT  0x02
+ *   ABORT   0x03
+ * Host -> GEVCU, FWUPDATE_DATA_ID + (frame index & FWUPDATE_SEQ_MASK): 8 bytes of the image
+ * GEVCU -> host, FWUPDATE_RESPONSE_ID:
+ *   STARTED 0x80, status, credit (frames)
+ *   ACK     0x81, frames received (2 bytes), credit (frames after these which may be sent)
+ *   NACK    0x82, index of the next expected frame (2 bytes), credit (frames from this one on)
+ *   RESULT  0x83, status (the image is complete and verified or not)
+ *   COMMIT  0x84, status (if OK, the GEVCU installs the image and resets)
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef FIRMWARE_PROTOCOL_H_
+#define FIRMWARE_PROTOCOL_H_
+
+#include <stdint.h>
+
+#define FWUPDATE_CMD_ID             0x7F0 // commands from the host
+#define FWUPDATE_RESPONSE_ID        0x7F1 // responses of the GEVCU
+#define FWUPDATE_DATA_ID            0x740 // data frames use FWUPDATE_DATA_ID to FWUPDATE_DATA_ID + FWUPDATE_SEQ_MASK
+#define FWUPDATE_DATA_MASK          0x7C0
+#define FWUPDATE_SEQ_MASK           0x3F  // credit must stay below half of the sequence range
+#define FWUPDATE_FRAME_SIZE         8
+#define FWUPDATE_MAX_IMAGE_SIZE     0x40000 // one flash bank
+
+// commands
+#define FWUPDATE_START              0x01
+#define FWUPDATE_COMMIT             0x02
+#define FWUPDATE_ABORT              0x03
+
+// responses
+#define FWUPDATE_STARTED            0x80
+#define FWUPDATE_ACK                0x81
+#define FWUPDATE_NACK               0x82
+#define FWUPDATE_RESULT             0x83
+#define FWUPDATE_COMMITTED          0x84
+
+// status codes
+#define FWUPDATE_OK                 0x00
+#define FWUPDATE_ERR_SIZE           0x01 // the image is empty or doesn't fit into the flash bank
+#define FWUPDATE_ERR_CRC            0x02 // the CRC of the written image doesn't match
+#define FWUPDATE_ERR_FLASH          0x03 // programming the flash failed
+#define FWUPDATE_ERR_UNSAFE         0x04 // the vehicle is not in a state which allows the update
+#define FWUPDATE_ERR_STATE          0x05 // command not expected in this state
+#define FWUPDATE_ERR_TIMEOUT        0x06 // the transfer stalled
+#define FWUPDATE_ERR_ABORTED        0x07
+#define FWUPDATE_ERR_SUPPLY         0x08 // the supply voltage of the GEVCU dropped, the image is not installed
+
+/*
+ * CRC-32 (IEEE 802.3, as zlib's crc32()), with a 16 entry table to save flash.
+ * Pass 0 as crc for the first block and the previous result for the following ones.
+ */
+static inline uint32_t fwUpdateCrc32(uint32_t crc, const uint8_t *data, uint32_t length)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    crc = ~crc;
+    while (length--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+#endif /* FIRMWARE_PROTOCOL_H_ */
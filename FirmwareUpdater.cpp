@@ -0,0 +1,530 @@
+/*
+ * FirmwareUpdater.cpp
+ *
+ * Receives a firmware image over CAN, stages it in flash bank 1 and installs it.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "FirmwareUpdater.h"
+
+// defined by the linker script, the initialized data is stored after the code
+extern uint32_t _etext;
+extern uint32_t _srelocate;
+extern uint32_t _erelocate;
+
+FirmwareUpdater firmwareUpdater = FirmwareUpdater(&canHandlerEv);
+
+/*
+ * Copies the staged image from bank 1 to bank 0 and resets the processor.
+ * Runs from RAM with interrupts disabled as the code in bank 0 is overwritten,
+ * so it must not call any function or access anything in flash except bank 1.
+ */
+__attribute__((section(".ramfunc"), noinline))
+static void installImage(uint32_t pageCount)
+{
+    for (uint32_t page = 0; page < pageCount; page++) {
+        if ((page % (IFLASH0_LOCK_REGION_SIZE / IFLASH0_PAGE_SIZE)) == 0) {
+            EFC0->EEFC_FCR = EEFC_FCR_FKEY(0x5A) | EEFC_FCR_FARG(page) | EEFC_FCR_FCMD(FWUPDATE_FCMD_CLB);
+            while (!(EFC0->EEFC_FSR & EEFC_FSR_FRDY));
+        }
+
+        const uint32_t *source = (const uint32_t *) (IFLASH1_ADDR + page * IFLASH1_PAGE_SIZE);
+        volatile uint32_t *destination = (volatile uint32_t *) (IFLASH0_ADDR + page * IFLASH0_PAGE_SIZE);
+        for (uint32_t i = 0; i < IFLASH0_PAGE_SIZE / 4; i++) {
+            destination[i] = source[i];
+        }
+        EFC0->EEFC_FCR = EEFC_FCR_FKEY(0x5A) | EEFC_FCR_FARG(page) | EEFC_FCR_FCMD(FWUPDATE_FCMD_EWP);
+        while (!(EFC0->EEFC_FSR & EEFC_FSR_FRDY));
+        WDT->WDT_CR = WDT_CR_KEY(0xA5) | WDT_CR_WDRSTT;
+    }
+
+    RSTC->RSTC_CR = RSTC_CR_KEY(0xA5) | RSTC_CR_PROCRST | RSTC_CR_PERRST;
+    while (true);
+}
+
+FirmwareUpdater::FirmwareUpdater(CanHandler *canHandler)
+{
+    this->canHandler = canHandler;
+    state = STATE_IDLE;
+    stagingAllowed = false;
+    imageSize = 0;
+    imageCrc = 0;
+    totalFrames = 0;
+    frameIndex = 0;
+    ackedFrames = 0;
+    creditLimit = 0;
+    window = CFG_FWUPDATE_CREDIT_SLOW;
+    nackSent = false;
+    pageHead = 0;
+    pageTail = 0;
+    pagesFull = 0;
+    fill = 0;
+    flashPage = 0;
+    programming = false;
+    verified = 0;
+    crc = 0;
+    timer = 0;
+}
+
+/*
+ * Listen for commands of a host. Updates are refused if the running firmware
+ * (code plus the initial values of the data) doesn't leave bank 1 free.
+ */
+void FirmwareUpdater::setup()
+{
+    uint32_t firmwareEnd = (uint32_t) &_etext + ((uint32_t) &_erelocate - (uint32_t) &_srelocate);
+
+    stagingAllowed = (firmwareEnd <= IFLASH1_ADDR);
+    if (!stagingAllowed) {
+        Logger::warn("firmware update over CAN disabled, the firmware reaches into flash bank 1 (end=%X)", firmwareEnd);
+    }
+    canHandler->attach(this, FWUPDATE_CMD_ID, 0x7ff, false);
+    SUPC->SUPC_SMMR = SUPC_SMMR_SMTH(CFG_FWUPDATE_SUPPLY_THRESHOLD) | SUPC_SMMR_SMSMPL_CSM;
+}
+
+void FirmwareUpdater::handleCanFrame(const CAN_FRAME *frame)
+{
+    if (frame->id == FWUPDATE_CMD_ID) {
+        handleCommand(frame);
+    } else if (state == STATE_RECEIVING) {
+        handleData(frame);
+    }
+}
+
+void FirmwareUpdater::handleTick()
+{
+    switch (state) {
+    case STATE_RECEIVING:
+        if (!programPages()) {
+            stop(FWUPDATE_ERR_FLASH);
+        } else if (micros() - timer > CFG_FWUPDATE_TIMEOUT) {
+            stop(FWUPDATE_ERR_TIMEOUT);
+        } else if (frameIndex != ackedFrames || (frameIndex >= creditLimit && credit() > 0)) {
+            sendAck(); // acknowledge the tail of a burst or re-open a closed window
+        }
+        break;
+
+    case STATE_VERIFYING:
+        verify();
+        break;
+
+    case STATE_VERIFIED:
+        if (micros() - timer > CFG_FWUPDATE_TIMEOUT) {
+            stop(FWUPDATE_ERR_TIMEOUT);
+        }
+        break;
+
+    case STATE_INSTALLING:
+        if (micros() - timer < 10000) {
+            break; // let the response and the log message go out
+        }
+        if (!isVehicleSafe()) {
+            Logger::error("firmware update: vehicle no longer safe, installation cancelled");
+            stop(FWUPDATE_ERR_UNSAFE);
+            break;
+        }
+        if (!isSupplyGood()) {
+            Logger::error("firmware update: supply voltage dropped, installation cancelled");
+            stop(FWUPDATE_ERR_SUPPLY);
+            break;
+        }
+        noInterrupts();
+        installImage((imageSize + FWUPDATE_PAGE_SIZE - 1) / FWUPDATE_PAGE_SIZE);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void FirmwareUpdater::handleCommand(const CAN_FRAME *frame)
+{
+    if (frame->length < 1 || state == STATE_INSTALLING) {
+        return;
+    }
+
+    switch (frame->data.bytes[0]) {
+    case FWUPDATE_START:
+        if (frame->length == 8) {
+            start(frame->data.bytes);
+        }
+        break;
+    case FWUPDATE_COMMIT:
+        commit();
+        break;
+    case FWUPDATE_ABORT:
+        if (state != STATE_IDLE) {
+            stop(FWUPDATE_ERR_ABORTED);
+        }
+        break;
+    }
+}
+
+/*
+ * Store a data frame if it's the expected one, otherwise request the
+ * retransmission from the expected frame on (once per gap, the frames which
+ * were already under way are ignored).
+ */
+void FirmwareUpdater::handleData(const CAN_FRAME *frame)
+{
+    uint32_t offset = (uint32_t) frameIndex * FWUPDATE_FRAME_SIZE;
+    uint8_t length = (imageSize - offset < FWUPDATE_FRAME_SIZE ? imageSize - offset : FWUPDATE_FRAME_SIZE);
+
+    timer = micros();
+    if ((frame->id & FWUPDATE_SEQ_MASK) != (frameIndex & FWUPDATE_SEQ_MASK) || frame->length < length
+            || pagesFull == CFG_FWUPDATE_PAGE_BUFFERS) {
+        if (!nackSent) {
+            sendNack();
+            nackSent = true;
+        }
+        return;
+    }
+    nackSent = false;
+
+    uint8_t *page = (uint8_t *) pages[pageHead];
+    for (uint8_t i = 0; i < FWUPDATE_FRAME_SIZE; i++) {
+        page[fill++] = (i < length ? frame->data.bytes[i] : 0xFF);
+    }
+    if (fill == FWUPDATE_PAGE_SIZE) {
+        pushPage();
+    }
+    frameIndex++;
+
+    if (frameIndex == totalFrames) {
+        if (fill > 0) {
+            while (fill < FWUPDATE_PAGE_SIZE) {
+                page[fill++] = 0xFF;
+            }
+            pushPage();
+        }
+        state = STATE_VERIFYING;
+        sendAck();
+    } else if (frameIndex - ackedFrames >= window / 2) {
+        sendAck();
+    }
+
+    if (!programPages()) {
+        stop(FWUPDATE_ERR_FLASH);
+    }
+}
+
+/*
+ * Start (or restart) a transfer. The credit is chosen so a full window fits
+ * into the receive ring of the CanHandler, the page buffers absorb the time
+ * the flash needs to program a page.
+ */
+void FirmwareUpdater::start(const uint8_t *data)
+{
+    uint32_t size = data[1] | (data[2] << 8) | (data[3] << 16);
+    uint8_t status = FWUPDATE_OK;
+
+    while (pollFlash() > 0); // a page of an aborted transfer may still be programmed
+
+    if (!stagingAllowed || size == 0 || size > FWUPDATE_MAX_IMAGE_SIZE) {
+        status = FWUPDATE_ERR_SIZE;
+    } else if (!isVehicleSafe()) {
+        status = FWUPDATE_ERR_UNSAFE;
+    } else if (!unlockStaging(size)) {
+        status = FWUPDATE_ERR_FLASH;
+    }
+    if (status != FWUPDATE_OK) {
+        if (state != STATE_IDLE) {
+            stop(status);
+        }
+        Logger::warn("firmware update of %l bytes refused (status=%d)", size, status);
+        sendResponse(FWUPDATE_STARTED, status);
+        return;
+    }
+
+    uint32_t busSpeed = canHandler->getBusSpeed();
+    window = (busSpeed >= 1000000 ? CFG_FWUPDATE_CREDIT_1M : busSpeed >= 500000 ? CFG_FWUPDATE_CREDIT_500K : CFG_FWUPDATE_CREDIT_SLOW);
+
+    imageSize = size;
+    imageCrc = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t) data[7] << 24);
+    totalFrames = (size + FWUPDATE_FRAME_SIZE - 1) / FWUPDATE_FRAME_SIZE;
+    frameIndex = 0;
+    ackedFrames = 0;
+    nackSent = false;
+    pageHead = 0;
+    pageTail = 0;
+    pagesFull = 0;
+    fill = 0;
+    flashPage = 0;
+    verified = 0;
+    crc = 0;
+    timer = micros();
+
+    if (state != STATE_RECEIVING && state != STATE_VERIFYING) {
+        canHandler->attach(this, FWUPDATE_DATA_ID, FWUPDATE_DATA_MASK, false);
+    }
+    if (state == STATE_IDLE) {
+        tickHandler.attach(this, CFG_TICK_INTERVAL_FWUPDATE, TICK_PRIORITY_BACKGROUND);
+    }
+    (void) SUPC->SUPC_SR; // forget supply drops from before the transfer (e.g. cranking)
+    state = STATE_RECEIVING;
+    Logger::info("firmware update: receiving %l bytes, window %d frames", size, window);
+
+    uint8_t initialCredit = credit();
+    creditLimit = initialCredit;
+    sendResponse(FWUPDATE_STARTED, FWUPDATE_OK, initialCredit);
+}
+
+void FirmwareUpdater::commit()
+{
+    if (state != STATE_VERIFIED) {
+        sendResponse(FWUPDATE_COMMITTED, FWUPDATE_ERR_STATE);
+        return;
+    }
+    if (!isVehicleSafe()) {
+        sendResponse(FWUPDATE_COMMITTED, FWUPDATE_ERR_UNSAFE); // the host may commit again later
+        return;
+    }
+    if (!isSupplyGood()) {
+        Logger::warn("firmware update: supply voltage dropped during the transfer, not installing");
+        sendResponse(FWUPDATE_COMMITTED, FWUPDATE_ERR_SUPPLY);
+        return;
+    }
+    sendResponse(FWUPDATE_COMMITTED, FWUPDATE_OK);
+    Logger::info("firmware update: installing the new firmware and resetting");
+    state = STATE_INSTALLING;
+    timer = micros();
+}
+
+/*
+ * End a transfer and report the reason to the host.
+ */
+void FirmwareUpdater::stop(uint8_t status)
+{
+    if (state == STATE_RECEIVING || state == STATE_VERIFYING) {
+        canHandler->detach(this, FWUPDATE_DATA_ID, FWUPDATE_DATA_MASK);
+    }
+    tickHandler.detach(this);
+    state = STATE_IDLE;
+    Logger::error("firmware update stopped at frame %d of %d (status=%d)", frameIndex, totalFrames, status);
+    sendResponse(FWUPDATE_RESULT, status);
+}
+
+void FirmwareUpdater::pushPage()
+{
+    pageHead = (pageHead + 1) % CFG_FWUPDATE_PAGE_BUFFERS;
+    pagesFull++;
+    fill = 0;
+}
+
+/*
+ * Hand the buffered pages to the controller of bank 1. Once a page is in the
+ * latch buffer its RAM buffer is free again. Programming doesn't stall the
+ * code running from bank 0.
+ */
+bool FirmwareUpdater::programPages()
+{
+    while (pagesFull > 0) {
+        int8_t status = pollFlash();
+        if (status != 0) {
+            return (status > 0);
+        }
+
+        const uint32_t *source = pages[pageTail];
+        volatile uint32_t *destination = (volatile uint32_t *) (IFLASH1_ADDR + (uint32_t) flashPage * FWUPDATE_PAGE_SIZE);
+        for (uint16_t i = 0; i < FWUPDATE_PAGE_SIZE / 4; i++) {
+            destination[i] = source[i];
+        }
+        EFC1->EEFC_FCR = EEFC_FCR_FKEY(0x5A) | EEFC_FCR_FARG(flashPage) | EEFC_FCR_FCMD(FWUPDATE_FCMD_EWP);
+        programming = true;
+
+        flashPage++;
+        pageTail = (pageTail + 1) % CFG_FWUPDATE_PAGE_BUFFERS;
+        pagesFull--;
+    }
+    return true;
+}
+
+/*
+ * Check the controller of bank 1.
+ *
+ * \retval 0 ready
+ * \retval 1 busy with a command
+ * \retval -1 the last command failed
+ */
+int8_t FirmwareUpdater::pollFlash()
+{
+    if (!programming) {
+        return 0;
+    }
+    uint32_t status = EFC1->EEFC_FSR; // reading clears the error flags
+    if (!(status & EEFC_FSR_FRDY)) {
+        return 1;
+    }
+    programming = false;
+    return ((status & (EEFC_FSR_FCMDE | EEFC_FSR_FLOCKE)) ? -1 : 0);
+}
+
+/*
+ * Clear the lock bits of the regions of bank 1 which receive the image.
+ */
+bool FirmwareUpdater::unlockStaging(uint32_t size)
+{
+    for (uint32_t offset = 0; offset < size; offset += IFLASH1_LOCK_REGION_SIZE) {
+        EFC1->EEFC_FCR = EEFC_FCR_FKEY(0x5A) | EEFC_FCR_FARG(offset / FWUPDATE_PAGE_SIZE) | EEFC_FCR_FCMD(FWUPDATE_FCMD_CLB);
+        uint32_t status;
+        do {
+            status = EFC1->EEFC_FSR;
+        } while (!(status & EEFC_FSR_FRDY));
+        if (status & EEFC_FSR_FCMDE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Write the remaining pages, then check the CRC of the staged image in chunks
+ * so the other tick observers aren't delayed.
+ */
+void FirmwareUpdater::verify()
+{
+    if (!programPages()) {
+        stop(FWUPDATE_ERR_FLASH);
+        return;
+    }
+    int8_t status = pollFlash();
+    if (pagesFull > 0 || status > 0) {
+        return;
+    }
+    if (status < 0) {
+        stop(FWUPDATE_ERR_FLASH);
+        return;
+    }
+
+    uint32_t length = imageSize - verified;
+    if (length > CFG_FWUPDATE_VERIFY_CHUNK) {
+        length = CFG_FWUPDATE_VERIFY_CHUNK;
+    }
+    crc = fwUpdateCrc32(crc, (const uint8_t *) (IFLASH1_ADDR + verified), length);
+    verified += length;
+
+    if (verified == imageSize) {
+        if (crc != imageCrc) {
+            Logger::error("firmware update: CRC mismatch (received %X, expected %X)", crc, imageCrc);
+            stop(FWUPDATE_ERR_CRC);
+            return;
+        }
+        canHandler->detach(this, FWUPDATE_DATA_ID, FWUPDATE_DATA_MASK);
+        state = STATE_VERIFIED;
+        timer = micros();
+        Logger::info("firmware update: %l bytes received and verified, waiting for commit", imageSize);
+        sendResponse(FWUPDATE_RESULT, FWUPDATE_OK);
+    }
+}
+
+/*
+ * The image may only be received and installed while the motor is not
+ * powered and stands still.
+ */
+bool FirmwareUpdater::isVehicleSafe()
+{
+    MotorController *motorController = deviceManager.getMotorController();
+
+    if (motorController == NULL) {
+        return true;
+    }
+    return (motorController->getOpState() != MotorController::ENABLE && motorController->getSpeedActual() == 0);
+}
+
+/*
+ * A power loss while the image is copied to bank 0 leaves the GEVCU unbootable,
+ * so it is only installed if the supply monitor didn't detect a drop below
+ * CFG_FWUPDATE_SUPPLY_THRESHOLD since the last check and the supply is above it
+ * now. Reading the status register clears the detection flag.
+ */
+bool FirmwareUpdater::isSupplyGood()
+{
+    return !(SUPC->SUPC_SR & (SUPC_SR_SMS | SUPC_SR_SMOS));
+}
+
+/*
+ * Number of frames the host may send after the ones received so far: limited
+ * by the window and the free space in the page buffers.
+ */
+uint8_t FirmwareUpdater::credit()
+{
+    uint32_t frames = ((CFG_FWUPDATE_PAGE_BUFFERS - pagesFull) * FWUPDATE_PAGE_SIZE - fill) / FWUPDATE_FRAME_SIZE;
+
+    if (frames > window) {
+        frames = window;
+    }
+    if (frames > (uint32_t) (totalFrames - frameIndex)) {
+        frames = totalFrames - frameIndex;
+    }
+    return frames;
+}
+
+void FirmwareUpdater::sendAck()
+{
+    CAN_FRAME frame;
+    uint8_t frames = credit();
+
+    canHandler->prepareOutputFrame(&frame, FWUPDATE_RESPONSE_ID);
+    frame.length = 4;
+    frame.data.bytes[0] = FWUPDATE_ACK;
+    frame.data.bytes[1] = frameIndex & 0xFF;
+    frame.data.bytes[2] = frameIndex >> 8;
+    frame.data.bytes[3] = frames;
+    canHandler->sendFrame(frame);
+
+    ackedFrames = frameIndex;
+    creditLimit = frameIndex + frames;
+}
+
+/*
+ * Like an ACK, but the host has to go back to the expected frame.
+ */
+void FirmwareUpdater::sendNack()
+{
+    CAN_FRAME frame;
+    uint8_t frames = credit();
+
+    canHandler->prepareOutputFrame(&frame, FWUPDATE_RESPONSE_ID);
+    frame.length = 4;
+    frame.data.bytes[0] = FWUPDATE_NACK;
+    frame.data.bytes[1] = frameIndex & 0xFF;
+    frame.data.bytes[2] = frameIndex >> 8;
+    frame.data.bytes[3] = frames;
+    canHandler->sendFrame(frame);
+
+    ackedFrames = frameIndex;
+    creditLimit = frameIndex + frames;
+}
+
+void FirmwareUpdater::sendResponse(uint8_t type, uint8_t status, uint8_t value)
+{
+    CAN_FRAME frame;
+
+    canHandler->prepareOutputFrame(&frame, FWUPDATE_RESPONSE_ID);
+    frame.length = (type == FWUPDATE_STARTED ? 3 : 2);
+    frame.data.bytes[0] = type;
+    frame.data.bytes[1] = status;
+    frame.data.bytes[2] = value;
+    canHandler->sendFrame(frame);
+}
@@ -0,0 +1,116 @@
+/*
+ * FirmwareUpdater.h
+ *
+ * Receives a new firmware over the EV CAN bus (see FirmwareProtocol.h for the
+ * protocol and tools/canflash for the host side). The image is staged in flash
+ * bank 1 while the firmware keeps running from bank 0, so the vehicle keeps
+ * being controlled during the transfer. Only when the CRC of the staged image
+ * is verified and the host commits it while the motor is stopped, the image is
+ * copied to bank 0 by a function running from RAM and the GEVCU is reset.
+ *
+ * The copy to bank 0 can't be made fail-safe: if the power fails or the supply
+ * browns out while it runs, bank 0 is left half written and the GEVCU doesn't
+ * boot any more. It can then only be recovered by flashing it with SAM-BA
+ * over USB (erase jumper, bossac). The install is therefore refused if the
+ * supply monitor saw the 3.3V supply drop below CFG_FWUPDATE_SUPPLY_THRESHOLD
+ * since the transfer started, but that doesn't protect against the power being
+ * cut during the copy (a few seconds for a full bank). Keep the ignition on until
+ * the GEVCU is back.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef FIRMWARE_UPDATER_H_
+#define FIRMWARE_UPDATER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+#include "DeviceManager.h"
+#include "FirmwareProtocol.h"
+#include "Logger.h"
+
+#define FWUPDATE_PAGE_SIZE      IFLASH1_PAGE_SIZE
+#define FWUPDATE_FCMD_EWP       0x03 // erase page and write page
+#define FWUPDATE_FCMD_CLB       0x09 // clear lock bit
+
+class FirmwareUpdater : public CanObserver, public TickObserver {
+public:
+    FirmwareUpdater(CanHandler *canHandler);
+    void setup();
+    void handleCanFrame(const CAN_FRAME *frame);
+    void handleTick();
+
+private:
+    enum State {
+        STATE_IDLE,
+        STATE_RECEIVING,        // data frames are received and written to bank 1
+        STATE_VERIFYING,        // all frames received, the last pages are written and the CRC is checked
+        STATE_VERIFIED,         // waiting for the commit of the host
+        STATE_INSTALLING        // committed, the image is installed with the next tick
+    };
+
+    CanHandler *canHandler;
+    State state;
+    bool stagingAllowed;        // the running firmware leaves bank 1 free
+    uint32_t imageSize;
+    uint32_t imageCrc;
+    uint16_t totalFrames;
+    uint16_t frameIndex;        // index of the next expected data frame
+    uint16_t ackedFrames;       // frame count of the last ACK
+    uint16_t creditLimit;       // the host may send frames up to (excluding) this index
+    uint8_t window;             // max credit, depends on the bus speed
+    bool nackSent;              // a retransmission was requested, wait for the expected frame
+    uint32_t pages[CFG_FWUPDATE_PAGE_BUFFERS][FWUPDATE_PAGE_SIZE / 4]; // received pages which wait to be programmed
+    uint8_t pageHead;           // page which is filled
+    uint8_t pageTail;           // next page to program
+    uint8_t pagesFull;
+    uint16_t fill;              // bytes in the page at pageHead
+    uint16_t flashPage;         // next page of bank 1 to program
+    bool programming;           // a flash command was issued and its result not yet checked
+    uint32_t verified;          // bytes of the staged image which were checked
+    uint32_t crc;
+    uint32_t timer;             // micros() of the last frame of the host
+
+    void handleCommand(const CAN_FRAME *frame);
+    void handleData(const CAN_FRAME *frame);
+    void start(const uint8_t *data);
+    void commit();
+    void stop(uint8_t status);
+    void pushPage();
+    bool programPages();
+    int8_t pollFlash();
+    bool unlockStaging(uint32_t size);
+    void verify();
+    bool isVehicleSafe();
+    bool isSupplyGood();
+    uint8_t credit();
+    void sendAck();
+    void sendNack();
+    void sendResponse(uint8_t type, uint8_t status, uint8_t value = 0);
+};
+
+extern FirmwareUpdater firmwareUpdater;
+
+#endif /* FIRMWARE_UPDATER_H_ */
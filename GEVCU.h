@@ -47,6 +47,12 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "Heartbeat.h"
 #include "sys_io.h"
 #include "CanHandler.h"
+#include "IsoTpHandler.h"
+#include "SdoClient.h"
+#include "SdoServer.h"
+#include "FirmwareUpdater.h"
+#include "GvretStreamer.h"
+#include "InputTrace.h"
 #include "MemCache.h"
 #include "ThrottleDetector.h"
 #include "DeviceManager.h"
@@ -60,6 +66,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "EVIC.h"
 #include "Powerkeypad.h"
 #include "VehicleSpecific.h"
+#include "LoadMonitor.h"
 
 #ifdef __cplusplus
 extern "C" {
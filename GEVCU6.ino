@@ -55,7 +55,6 @@ Random comments on things that should be coded up soon:
 // identify the required libraries for the build.
 #include <due_rtc.h>
 #include <due_can.h>
-#include <FirmwareReceiver.h>
 #include <due_wire.h>
 #include <DueTimer.h>
 #include <SPI.h>
@@ -201,6 +200,8 @@ void setup() {
 	Logger::info("SYSIO init ok");	
 
 	initializeDevices();
+	sdoServer.setup();
+	firmwareUpdater.setup();
     serialConsole = new SerialConsole(memCache, heartbeat);
 	serialConsole->printMenu();
 	btDevice = deviceManager.getDeviceByID(ELM327EMU);
@@ -208,18 +209,37 @@ void setup() {
 	Logger::info("System Ready");	
 }
 
+/*
+ * Only run the handlers for which an event is pending, sleep while there is nothing to do.
+ */
 void loop() {
+	uint32_t events = loadMonitor.waitForEvents();
+
 #ifdef CFG_TIMER_USE_QUEUING
-	tickHandler.process();
+	if (events & EVENT_TICK) {
+		tickHandler.process();
+	}
 #endif
 
 	// check if incoming frames are available in the can buffer and process them
-	canHandlerEv.process();
-	canHandlerCar.process();
+	if (events & EVENT_CAN) {
+		CanHandler::processAll();
+	}
 
-	serialConsole->loop();
+	if (gvretStreamer.isActive()) {
+		gvretStreamer.flush(false);
+	}
+	if (traceRecorder.isRecording()) {
+		traceRecorder.flush(false);
+	}
+
+	if (events & EVENT_SERIAL) {
+		serialConsole->loop();
+	}
 
     systemIO.pollInitialization();
+
+    loadMonitor.endIteration();
 }
 
 
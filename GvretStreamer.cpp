@@ -0,0 +1,379 @@
+/*
+ * GvretStreamer.cpp
+ *
+ * Binary capture of the frames of both CAN buses in the GVRET format (SavvyCAN).
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "GvretStreamer.h"
+
+GvretStreamer gvretStreamer;
+
+GvretBusObserver::GvretBusObserver()
+{
+    streamer = NULL;
+    canHandler = NULL;
+    busNumber = 0;
+}
+
+/*
+ * Forward a received frame with the time it was received by the interrupt.
+ */
+void GvretBusObserver::handleCanFrame(const CAN_FRAME *frame)
+{
+    streamer->captureFrame(busNumber, frame, canHandler->getRxTimestamp());
+}
+
+GvretStreamer::GvretStreamer()
+{
+    active = false;
+    numFilters = 0;
+    for (uint8_t i = 0; i < 2; i++) {
+        busObservers[i].streamer = this;
+        busObservers[i].busNumber = i;
+    }
+    busObservers[0].canHandler = &canHandlerEv;
+    busObservers[1].canHandler = &canHandlerCar;
+    bufferHead = bufferTail = 0;
+    commandLength = 0;
+    frameCount = 0;
+    dropCount = 0;
+}
+
+/*
+ * Switch to binary mode: subscribe to the frames of both buses and mute the
+ * logger as any text would corrupt the stream.
+ */
+void GvretStreamer::start()
+{
+    if (active) {
+        return;
+    }
+    Logger::mute();
+
+    bufferHead = bufferTail = 0;
+    commandLength = 0;
+    frameCount = 0;
+    dropCount = 0;
+    lastKeepAlive = micros();
+    active = true;
+    subscribe(true);
+    tickHandler.attach(this, CFG_TICK_INTERVAL_GVRET, TICK_PRIORITY_BACKGROUND);
+}
+
+/*
+ * Return to the text console.
+ */
+void GvretStreamer::stop()
+{
+    if (!active) {
+        return;
+    }
+    tickHandler.detach(this);
+    subscribe(false);
+    active = false;
+    Logger::unmute();
+    Logger::info("GVRET capture stopped, %l frames streamed, %l dropped", frameCount, dropCount);
+}
+
+bool GvretStreamer::isActive()
+{
+    return active;
+}
+
+/*
+ * Attach to (or detach from) both buses, either for the configured filters or for all frames.
+ * The CanHandler programs its mailbox filters accordingly, so unwanted frames are
+ * already dropped by the hardware.
+ */
+void GvretStreamer::subscribe(bool attach)
+{
+    for (uint8_t bus = 0; bus < 2; bus++) {
+        GvretBusObserver *observer = &busObservers[bus];
+        if (numFilters == 0) {
+            if (attach) {
+                observer->canHandler->attach(observer, 0, 0, false);
+                observer->canHandler->attach(observer, 0, 0, true);
+            } else {
+                observer->canHandler->detach(observer, 0, 0);
+            }
+        }
+        for (uint8_t i = 0; i < numFilters; i++) {
+            if (attach) {
+                observer->canHandler->attach(observer, filters[i].id, filters[i].mask, filters[i].extended);
+            } else {
+                observer->canHandler->detach(observer, filters[i].id, filters[i].mask);
+            }
+        }
+    }
+}
+
+/*
+ * Only stream frames matching id/mask (ids above 0x7FF select extended frames).
+ * Without filters all frames of both buses are streamed.
+ *
+ * \retval false if all CFG_GVRET_NUM_FILTERS filters are in use
+ */
+bool GvretStreamer::addFilter(uint32_t id, uint32_t mask)
+{
+    if (numFilters >= CFG_GVRET_NUM_FILTERS) {
+        return false;
+    }
+    if (active) {
+        subscribe(false);
+    }
+    filters[numFilters].id = id;
+    filters[numFilters].mask = mask;
+    filters[numFilters].extended = (id > CAN_STD_ID_MASK);
+    numFilters++;
+    if (active) {
+        subscribe(true);
+    }
+    return true;
+}
+
+void GvretStreamer::clearFilters()
+{
+    if (active) {
+        subscribe(false);
+    }
+    numFilters = 0;
+    if (active) {
+        subscribe(true);
+    }
+}
+
+/*
+ * Encode a received frame into the output ring. Called from loop() while the
+ * CanHandler dispatches the frame, so it only copies a few bytes.
+ */
+void GvretStreamer::captureFrame(uint8_t busNumber, const CAN_FRAME *frame, uint32_t timestamp)
+{
+    uint8_t message[21];
+    uint8_t length = min(frame->length, 8);
+    uint32_t id = frame->id | (frame->extended ? 1ul << 31 : 0);
+
+    message[0] = GVRET_COMMAND;
+    message[1] = GVRET_BUILD_CAN_FRAME;
+    message[2] = timestamp & 0xFF;
+    message[3] = (timestamp >> 8) & 0xFF;
+    message[4] = (timestamp >> 16) & 0xFF;
+    message[5] = timestamp >> 24;
+    message[6] = id & 0xFF;
+    message[7] = (id >> 8) & 0xFF;
+    message[8] = (id >> 16) & 0xFF;
+    message[9] = id >> 24;
+    message[10] = length | (busNumber << 4);
+    memcpy(&message[11], frame->data.bytes, length);
+    message[11 + length] = 0; // checksum, not used by GVRET
+
+    if (queue(message, 12 + length)) {
+        frameCount++;
+    } else {
+        dropCount++;
+    }
+}
+
+/*
+ * Append a message to the output ring.
+ *
+ * \retval false if there's not enough space, nothing is queued then
+ */
+bool GvretStreamer::queue(const uint8_t *data, uint8_t length)
+{
+    uint16_t used = (bufferHead + CFG_GVRET_BUFFER_SIZE - bufferTail) % CFG_GVRET_BUFFER_SIZE;
+    if (used + length >= CFG_GVRET_BUFFER_SIZE) {
+        return false;
+    }
+    if (used == 0) {
+        firstWaiting = micros();
+    }
+    for (uint8_t i = 0; i < length; i++) {
+        buffer[bufferHead] = data[i];
+        bufferHead = (bufferHead + 1) % CFG_GVRET_BUFFER_SIZE;
+    }
+    return true;
+}
+
+/*
+ * Write one chunk of up to CFG_GVRET_PACKET_SIZE bytes to the USB port. Unless
+ * partial is set, only complete chunks are written, so the USB bulk transfers
+ * stay large. One chunk per call limits the time loop() spends in the driver.
+ */
+void GvretStreamer::flush(bool partial)
+{
+    uint16_t used = (bufferHead + CFG_GVRET_BUFFER_SIZE - bufferTail) % CFG_GVRET_BUFFER_SIZE;
+
+    if (used == 0 || (!partial && used < CFG_GVRET_PACKET_SIZE)) {
+        return;
+    }
+    uint16_t chunk = min(min(used, CFG_GVRET_PACKET_SIZE), CFG_GVRET_BUFFER_SIZE - bufferTail);
+    SerialUSB.write(&buffer[bufferTail], chunk);
+    bufferTail = (bufferTail + chunk) % CFG_GVRET_BUFFER_SIZE;
+    firstWaiting = micros();
+}
+
+/*
+ * Send partially filled chunks which waited for CFG_GVRET_FLUSH_INTERVAL and
+ * return to the text console if the host stopped sending keep-alive messages.
+ */
+void GvretStreamer::handleTick()
+{
+    if (micros() - lastKeepAlive > CFG_GVRET_TIMEOUT) {
+        stop();
+        return;
+    }
+    if (micros() - firstWaiting >= CFG_GVRET_FLUSH_INTERVAL) {
+        flush(true);
+    }
+}
+
+/*
+ * Collect the bytes of a binary message from the host.
+ */
+void GvretStreamer::handleByte(uint8_t data)
+{
+    lastKeepAlive = micros();
+    if (commandLength == 0 && data != GVRET_COMMAND) {
+        return; // e.g. repeated requests for binary mode
+    }
+    command[commandLength++] = data;
+    if (commandLength >= expectedLength() || commandLength >= sizeof(command)) {
+        handleCommand();
+        commandLength = 0;
+    }
+}
+
+/*
+ * Number of bytes of the message in the command buffer (as far as known yet).
+ */
+uint8_t GvretStreamer::expectedLength()
+{
+    if (commandLength < 2) {
+        return 2;
+    }
+    switch (command[1]) {
+    case GVRET_BUILD_CAN_FRAME:
+    case GVRET_ECHO_CAN_FRAME:
+        // id (4), bus, length, data, checksum
+        return (commandLength < 8 ? 8 : 9 + min(command[7] & 0x0F, 8));
+    case GVRET_SETUP_CANBUS:
+        return 10;
+    case GVRET_SET_SINGLEWIRE:
+    case GVRET_SET_SYSTYPE:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+void GvretStreamer::handleCommand()
+{
+    uint8_t reply[16];
+    uint32_t now = micros();
+
+    reply[0] = GVRET_COMMAND;
+    reply[1] = command[1];
+    switch (command[1]) {
+    case GVRET_BUILD_CAN_FRAME:
+        sendFrameFromHost();
+        return;
+    case GVRET_ECHO_CAN_FRAME: {
+        CAN_FRAME frame;
+        uint32_t id = command[2] | (command[3] << 8) | (command[4] << 16) | ((uint32_t) command[5] << 24);
+        frame.id = id & CAN_EXT_ID_MASK;
+        frame.extended = (id >> 31);
+        frame.length = min(command[7] & 0x0F, 8);
+        memcpy(frame.data.bytes, &command[8], frame.length);
+        captureFrame(command[6] & 0x01, &frame, now);
+        break;
+    }
+    case GVRET_TIME_SYNC:
+        reply[2] = now & 0xFF;
+        reply[3] = (now >> 8) & 0xFF;
+        reply[4] = (now >> 16) & 0xFF;
+        reply[5] = now >> 24;
+        queue(reply, 6);
+        break;
+    case GVRET_GET_CANBUS_PARAMS:
+        for (uint8_t bus = 0; bus < 2; bus++) {
+            uint32_t speed = busObservers[bus].canHandler->getBusSpeed();
+            reply[2 + bus * 5] = 1; // enabled, not listen only
+            reply[3 + bus * 5] = speed & 0xFF;
+            reply[4 + bus * 5] = (speed >> 8) & 0xFF;
+            reply[5 + bus * 5] = (speed >> 16) & 0xFF;
+            reply[6 + bus * 5] = speed >> 24;
+        }
+        queue(reply, 12);
+        break;
+    case GVRET_GET_DEV_INFO:
+        reply[2] = CFG_BUILD_NUM & 0xFF;
+        reply[3] = CFG_BUILD_NUM >> 8;
+        reply[4] = 0x20; // eeprom version
+        reply[5] = 0; // file output type
+        reply[6] = 0; // auto start logging
+        reply[7] = 0; // single wire mode
+        queue(reply, 8);
+        break;
+    case GVRET_KEEPALIVE:
+        reply[2] = 0xDE;
+        reply[3] = 0xAD;
+        queue(reply, 4);
+        break;
+    case GVRET_GET_NUMBUSES:
+        reply[2] = 2;
+        queue(reply, 3);
+        break;
+    default: // the bus configuration is owned by GEVCU, requests to change it are ignored
+        return;
+    }
+    flush(true);
+}
+
+/*
+ * Transmit a frame the host built. It's queued with low priority so it
+ * can't delay control messages.
+ */
+void GvretStreamer::sendFrameFromHost()
+{
+    CAN_FRAME frame;
+    uint32_t id = command[2] | (command[3] << 8) | (command[4] << 16) | ((uint32_t) command[5] << 24);
+    CanHandler *canHandler = busObservers[command[6] & 0x01].canHandler;
+
+    canHandler->prepareOutputFrame(&frame, id & CAN_EXT_ID_MASK);
+    frame.extended = (id >> 31);
+    frame.length = min(command[7] & 0x0F, 8);
+    memcpy(frame.data.bytes, &command[8], frame.length);
+    canHandler->sendFrame(frame, CAN_TX_PRIORITY_LOW);
+}
+
+uint32_t GvretStreamer::getFrameCount()
+{
+    return frameCount;
+}
+
+uint32_t GvretStreamer::getDropCount()
+{
+    return dropCount;
+}
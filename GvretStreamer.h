@@ -0,0 +1,121 @@
+/*
+ * GvretStreamer.h
+ *
+ * Binary capture of the frames of both CAN buses in the GVRET format, so
+ * SavvyCAN can connect to the native USB port. The host switches the console
+ * into binary mode by sending 0xE7, streaming stops when the host's keep-alive
+ * messages stop. Frames are buffered in a ring and written in large chunks from
+ * loop(), so capturing doesn't block the CAN interrupt or the control ticks.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef GVRET_STREAMER_H_
+#define GVRET_STREAMER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+#include "Logger.h"
+
+#define GVRET_START_BINARY      0xE7 // sent by the host to switch to binary mode
+#define GVRET_COMMAND           0xF1 // first byte of every binary message
+
+// GVRET commands
+#define GVRET_BUILD_CAN_FRAME   0x00
+#define GVRET_TIME_SYNC         0x01
+#define GVRET_SETUP_CANBUS      0x05
+#define GVRET_GET_CANBUS_PARAMS 0x06
+#define GVRET_GET_DEV_INFO      0x07
+#define GVRET_SET_SINGLEWIRE    0x08
+#define GVRET_KEEPALIVE         0x09
+#define GVRET_SET_SYSTYPE       0x0A
+#define GVRET_ECHO_CAN_FRAME    0x0B
+#define GVRET_GET_NUMBUSES      0x0C
+
+class GvretStreamer;
+
+/*
+ * Receives the frames of one bus for the streamer (the CanObserver interface
+ * doesn't tell from which bus a frame comes).
+ */
+class GvretBusObserver : public CanObserver
+{
+public:
+    GvretBusObserver();
+    void handleCanFrame(const CAN_FRAME *frame);
+
+    GvretStreamer *streamer;
+    CanHandler *canHandler;
+    uint8_t busNumber;
+};
+
+class GvretStreamer : public TickObserver
+{
+public:
+    GvretStreamer();
+    void start();
+    void stop();
+    bool isActive();
+    void handleByte(uint8_t data);
+    void captureFrame(uint8_t busNumber, const CAN_FRAME *frame, uint32_t timestamp);
+    void flush(bool partial);
+    void handleTick();
+    bool addFilter(uint32_t id, uint32_t mask);
+    void clearFilters();
+    uint32_t getFrameCount();
+    uint32_t getDropCount();
+
+private:
+    struct Filter {
+        uint32_t id;
+        uint32_t mask;
+        bool extended;
+    };
+
+    bool active;
+    GvretBusObserver busObservers[2];
+    Filter filters[CFG_GVRET_NUM_FILTERS];
+    uint8_t numFilters;
+
+    uint8_t buffer[CFG_GVRET_BUFFER_SIZE]; // ring of encoded messages to the host
+    uint16_t bufferHead, bufferTail;
+    uint32_t firstWaiting; // micros() when the oldest unsent byte was queued
+    uint32_t frameCount;
+    uint32_t dropCount;
+
+    uint8_t command[32]; // binary message from the host which is being received
+    uint8_t commandLength;
+    uint32_t lastKeepAlive; // micros() of the last message from the host
+
+    void subscribe(bool attach);
+    bool queue(const uint8_t *data, uint8_t length);
+    uint8_t expectedLength();
+    void handleCommand();
+    void sendFrameFromHost();
+};
+
+extern GvretStreamer gvretStreamer;
+
+#endif /* GVRET_STREAMER_H_ */
@@ -34,7 +34,7 @@ Heartbeat::Heartbeat() {
 void Heartbeat::setup() {
     tickHandler.detach(this);
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_HEARTBEAT);
+    tickHandler.attach(this, CFG_TICK_INTERVAL_HEARTBEAT, TICK_PRIORITY_BACKGROUND);
 }
 
 void Heartbeat::setThrottleDebug(bool debug) {
@@ -46,8 +46,8 @@ bool Heartbeat::getThrottleDebug() {
 }
 
 void Heartbeat::handleTick() {
-    // Print a dot if no other output has been made since the last tick
-    if (Logger::getLastLogTime() < lastTickTime) {
+    // Print a dot if no other output has been made since the last tick (and the port doesn't carry binary data)
+    if (!Logger::isMuted() && Logger::getLastLogTime() < lastTickTime) {
         SerialUSB.print('.');
         if ((++dotCount % 80) == 0) {
             SerialUSB.println();
@@ -68,6 +68,7 @@ void Heartbeat::handleTick() {
         Throttle *brake = deviceManager.getBrake();
 
         Logger::console("");
+        Logger::console("CPU load: %f%%, max loop time: %lus", loadMonitor.getCpuLoad() / 10.0f, loadMonitor.getMaxIterationTime());
         if (motorController) {
             Logger::console("Motor Controller Status->       isRunning: %T               isFaulted: %T", motorController->isRunning(), motorController->isFaulted());
         }
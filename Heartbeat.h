@@ -31,6 +31,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "TickHandler.h"
 #include "DeviceManager.h"
 #include "sys_io.h"
+#include "LoadMonitor.h"
 
 class Heartbeat: public TickObserver {
 public:
@@ -0,0 +1,431 @@
+/*
+ * InputTrace.cpp
+ *
+ * Recording and replay of the inputs of the system (see InputTrace.h for the format).
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "InputTrace.h"
+#include "sys_io.h"
+
+TraceRecorder traceRecorder;
+TracePlayer tracePlayer;
+
+static const uint8_t traceHeader[TRACE_HEADER_SIZE] = { 'G', 'T', 'R', 'C', TRACE_VERSION };
+
+/*
+ * Encode a value with 7 bits per byte, the highest bit marks that more bytes follow.
+ *
+ * \retval the number of bytes written (max 5)
+ */
+uint8_t traceEncodeVarint(uint8_t *data, uint32_t value)
+{
+    uint8_t length = 0;
+    while (value > 0x7F) {
+        data[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    data[length++] = value;
+    return length;
+}
+
+/*
+ * Map signed values to unsigned ones so small negative values get short varints.
+ */
+uint32_t traceZigZag(int32_t value)
+{
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+int32_t traceUnZigZag(uint32_t value)
+{
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+TraceRecorder::TraceRecorder()
+{
+    recording = false;
+    bufferHead = bufferTail = 0;
+    recordCount = 0;
+    dropCount = 0;
+}
+
+/*
+ * Start streaming a trace to the USB port. The logger is muted as any
+ * text would corrupt the trace.
+ */
+void TraceRecorder::start()
+{
+    if (recording) {
+        return;
+    }
+    Logger::mute();
+
+    bufferHead = bufferTail = 0;
+    lastTime = micros();
+    for (int i = 0; i < TRACE_ADC_CHANNELS; i++) {
+        lastAdc[i] = 0;
+    }
+    digitalInputs = 0;
+    digitalKnown = false;
+    recordCount = 0;
+    dropCount = 0;
+    append(traceHeader, TRACE_HEADER_SIZE);
+    recording = true;
+    tickHandler.attach(this, CFG_TICK_INTERVAL_TRACE, TICK_PRIORITY_BACKGROUND);
+}
+
+void TraceRecorder::stop()
+{
+    if (!recording) {
+        return;
+    }
+    recording = false;
+    tickHandler.detach(this);
+    while (bufferHead != bufferTail) {
+        flush(true);
+    }
+    Logger::unmute();
+    Logger::info("trace recording stopped, %l records, %l dropped", recordCount, dropCount);
+}
+
+bool TraceRecorder::isRecording()
+{
+    return recording;
+}
+
+/*
+ * Encode the record time as difference to the previous record.
+ * Must be called with interrupts disabled, lastTime is only updated if the record fits.
+ */
+uint8_t TraceRecorder::encodeTime(uint8_t *data, uint32_t timestamp)
+{
+    return traceEncodeVarint(data, traceZigZag((int32_t) (timestamp - lastTime)));
+}
+
+/*
+ * Record a received frame with the time it was received by the interrupt.
+ */
+void TraceRecorder::recordCanFrame(bool carBus, const CAN_FRAME &frame, uint32_t timestamp)
+{
+    uint8_t record[TRACE_MAX_RECORD_SIZE];
+    uint8_t dataLength = (frame.rtr ? 0 : min(frame.length, 8));
+
+    record[0] = TRACE_CAN_FRAME | (carBus ? TRACE_FLAG_CAR_BUS : 0) | (frame.extended ? TRACE_FLAG_EXTENDED : 0)
+            | (frame.rtr ? TRACE_FLAG_RTR : 0);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t length = 1 + encodeTime(&record[1], timestamp);
+    length += traceEncodeVarint(&record[length], frame.id);
+    record[length++] = (frame.rtr ? frame.length : dataLength);
+    memcpy(&record[length], frame.data.bytes, dataLength);
+    length += dataLength;
+    if (append(record, length)) {
+        lastTime = timestamp;
+    }
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Record the raw reading of one of the SPI ADC channels.
+ */
+void TraceRecorder::recordAdc(uint8_t channel, int32_t value)
+{
+    uint8_t record[TRACE_MAX_RECORD_SIZE];
+    uint32_t now = micros();
+
+    if (channel >= TRACE_ADC_CHANNELS) {
+        return;
+    }
+    record[0] = TRACE_ADC;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t length = 1 + encodeTime(&record[1], now);
+    record[length++] = channel;
+    length += traceEncodeVarint(&record[length], traceZigZag(value - lastAdc[channel]));
+    if (append(record, length)) {
+        lastTime = now;
+        lastAdc[channel] = value;
+    }
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Record the state of a digital input. Only changes are recorded.
+ */
+void TraceRecorder::recordDigitalInput(uint8_t input, bool active)
+{
+    uint8_t record[TRACE_MAX_RECORD_SIZE];
+    uint32_t now = micros();
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t inputs = (active ? digitalInputs | (1 << input) : digitalInputs & ~(1 << input));
+    if (inputs != digitalInputs || !digitalKnown) {
+        record[0] = TRACE_DIGITAL;
+        uint8_t length = 1 + encodeTime(&record[1], now);
+        record[length++] = inputs;
+        if (append(record, length)) {
+            lastTime = now;
+            digitalInputs = inputs;
+            digitalKnown = true;
+        }
+    }
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Append a record to the output ring. Records which don't fit are dropped
+ * completely, so the trace stays decodable.
+ */
+bool TraceRecorder::append(const uint8_t *data, uint8_t length)
+{
+    uint16_t used = (bufferHead + CFG_TRACE_BUFFER_SIZE - bufferTail) % CFG_TRACE_BUFFER_SIZE;
+    if (used + length >= CFG_TRACE_BUFFER_SIZE) {
+        dropCount++;
+        return false;
+    }
+    if (used == 0) {
+        firstWaiting = micros();
+    }
+    for (uint8_t i = 0; i < length; i++) {
+        buffer[bufferHead] = data[i];
+        bufferHead = (bufferHead + 1) % CFG_TRACE_BUFFER_SIZE;
+    }
+    recordCount++;
+    return true;
+}
+
+/*
+ * Write one chunk of up to CFG_TRACE_PACKET_SIZE bytes to the USB port. Unless
+ * partial is set, only complete chunks are written.
+ */
+void TraceRecorder::flush(bool partial)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint16_t tail = bufferTail;
+    uint16_t used = (bufferHead + CFG_TRACE_BUFFER_SIZE - tail) % CFG_TRACE_BUFFER_SIZE;
+    __set_PRIMASK(primask);
+
+    if (used == 0 || (!partial && used < CFG_TRACE_PACKET_SIZE)) {
+        return;
+    }
+    uint16_t chunk = min(min(used, CFG_TRACE_PACKET_SIZE), CFG_TRACE_BUFFER_SIZE - tail);
+    SerialUSB.write(&buffer[tail], chunk); // the records may only be overwritten once the tail moved
+    bufferTail = (tail + chunk) % CFG_TRACE_BUFFER_SIZE;
+    firstWaiting = micros();
+}
+
+/*
+ * Send partially filled chunks which waited for CFG_TRACE_FLUSH_INTERVAL.
+ */
+void TraceRecorder::handleTick()
+{
+    if (micros() - firstWaiting >= CFG_TRACE_FLUSH_INTERVAL) {
+        flush(true);
+    }
+}
+
+TracePlayer::TracePlayer()
+{
+    playing = false;
+    trace = NULL;
+    length = 0;
+    clock = 0;
+}
+
+/*
+ * Start replaying a trace. SystemIO takes its inputs from the trace until end() is called.
+ *
+ * \retval false if the data isn't a trace of a supported version
+ */
+bool TracePlayer::begin(const uint8_t *trace, uint32_t length)
+{
+    if (length < TRACE_HEADER_SIZE || memcmp(trace, traceHeader, TRACE_HEADER_SIZE) != 0) {
+        Logger::error("not a trace of version %d", TRACE_VERSION);
+        return false;
+    }
+    this->trace = trace;
+    this->length = length;
+    position = TRACE_HEADER_SIZE;
+    nextTime = 0;
+    nextTimeValid = false;
+    clock = 0;
+    for (int i = 0; i < TRACE_ADC_CHANNELS; i++) {
+        lastAdc[i] = 0;
+    }
+    playing = true;
+    systemIO.setReplay(true);
+    return true;
+}
+
+void TracePlayer::end()
+{
+    playing = false;
+    systemIO.setReplay(false);
+}
+
+bool TracePlayer::isPlaying()
+{
+    return playing;
+}
+
+/*
+ * Feed all records up to the given time (microseconds since the start of the recording)
+ * into CanHandler and SystemIO and advance the virtual clock to it.
+ *
+ * \retval false if the end of the trace was reached
+ */
+bool TracePlayer::replayUntil(uint32_t time)
+{
+    while (playing && peekTime() && (int32_t) (nextTime - time) <= 0) {
+        if (!replayRecord()) {
+            break;
+        }
+    }
+    clock = time;
+    return playing && peekTime();
+}
+
+/*
+ * The time of the next record, to skip idle periods.
+ */
+uint32_t TracePlayer::getNextTime()
+{
+    peekTime();
+    return nextTime;
+}
+
+uint32_t TracePlayer::getMicros()
+{
+    return clock;
+}
+
+uint32_t TracePlayer::getMillis()
+{
+    return clock / 1000;
+}
+
+bool TracePlayer::readVarint(uint32_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (position >= length) {
+            return false;
+        }
+        uint8_t data = trace[position++];
+        value |= (uint32_t) (data & 0x7F) << shift;
+        if (!(data & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Decode the time of the next record without consuming it.
+ */
+bool TracePlayer::peekTime()
+{
+    if (nextTimeValid) {
+        return true;
+    }
+    uint32_t start = position;
+    uint32_t delta;
+
+    if (position + 1 >= length) {
+        return false;
+    }
+    position++; // skip the type
+    if (!readVarint(delta)) {
+        position = start;
+        return false;
+    }
+    position = start;
+    nextTime += traceUnZigZag(delta);
+    nextTimeValid = true;
+    return true;
+}
+
+/*
+ * Decode the next record and inject it.
+ *
+ * \retval false if the record is truncated or of an unknown type, replay ends then
+ */
+bool TracePlayer::replayRecord()
+{
+    uint8_t type = trace[position++];
+    uint32_t delta, value;
+
+    readVarint(delta); // already decoded by peekTime()
+    nextTimeValid = false;
+
+    switch (type & 0x0F) {
+    case TRACE_CAN_FRAME: {
+        CAN_FRAME frame;
+        if (!readVarint(value) || position >= length) {
+            break;
+        }
+        frame.id = value;
+        frame.extended = (type & TRACE_FLAG_EXTENDED) ? 1 : 0;
+        frame.rtr = (type & TRACE_FLAG_RTR) ? 1 : 0;
+        frame.length = trace[position++];
+        uint8_t dataLength = (frame.rtr ? 0 : min(frame.length, 8));
+        if (position + dataLength > length) {
+            break;
+        }
+        memcpy(frame.data.bytes, &trace[position], dataLength);
+        position += dataLength;
+        CanHandler &canHandler = ((type & TRACE_FLAG_CAR_BUS) ? canHandlerCar : canHandlerEv);
+        frame.time = (uint16_t) ((uint64_t) nextTime * canHandler.getBusSpeed() / 1000000); // hardware timestamp in bit times
+        canHandler.injectFrame(frame, nextTime);
+        return true;
+    }
+    case TRACE_ADC:
+        if (position >= length) {
+            break;
+        }
+        {
+            uint8_t channel = trace[position++];
+            if (channel >= TRACE_ADC_CHANNELS || !readVarint(value)) {
+                break;
+            }
+            lastAdc[channel] += traceUnZigZag(value);
+            systemIO.setReplayedAdc(channel, lastAdc[channel]);
+        }
+        return true;
+    case TRACE_DIGITAL:
+        if (position >= length) {
+            break;
+        }
+        systemIO.setReplayedDigitalInputs(trace[position++]);
+        return true;
+    }
+    Logger::error("invalid trace record at offset %l, replay ends", position);
+    end();
+    return false;
+}
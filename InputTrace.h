@@ -0,0 +1,141 @@
+/*
+ * InputTrace.h
+ *
+ * Recording and replay of the inputs of the system: received CAN frames,
+ * readings of the SPI ADCs and the digital inputs. A trace is a compact
+ * binary stream which can be fed back into CanHandler and SystemIO with a
+ * virtual clock, so recorded drives can be run through all CanObservers and
+ * Throttles again and their outputs and timing compared between firmware versions.
+ *
+ * Format: the header "GTRC" and a version byte, followed by records.
+ * Each record starts with a byte holding the type (bits 0-3) and flags
+ * (bits 4-7), followed by the time since the previous record in
+ * microseconds (zig-zag varint, CAN frames are stamped when the interrupt
+ * received them and may be older than the previous record):
+ *   CAN frame: flags bit 4 = car bus, bit 5 = extended, bit 6 = rtr,
+ *              varint id, length byte, data bytes
+ *   ADC:       channel byte, zig-zag varint difference to the previous value of the channel
+ *   digital:   byte with the state of the digital inputs (bit 0 = input 0)
+ *
+ * The player is independent of the hardware. On the host build in tools/replay
+ * the Arduino shim's millis() and micros() return TracePlayer::getMillis()/getMicros().
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef INPUT_TRACE_H_
+#define INPUT_TRACE_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+#include "Logger.h"
+
+#define TRACE_VERSION           1
+#define TRACE_HEADER_SIZE       5
+
+// record types
+#define TRACE_CAN_FRAME         0x01
+#define TRACE_ADC               0x02
+#define TRACE_DIGITAL           0x03
+
+// flags of CAN frame records
+#define TRACE_FLAG_CAR_BUS      0x10
+#define TRACE_FLAG_EXTENDED     0x20
+#define TRACE_FLAG_RTR          0x40
+
+#define TRACE_ADC_CHANNELS      9 // 3 ADE7913 chips with 3 channels each
+#define TRACE_MAX_RECORD_SIZE   24
+
+/*
+ * Records the inputs while the system is running and streams them
+ * to the native USB port.
+ */
+class TraceRecorder : public TickObserver
+{
+public:
+    TraceRecorder();
+    void start();
+    void stop();
+    bool isRecording();
+    void recordCanFrame(bool carBus, const CAN_FRAME &frame, uint32_t timestamp);
+    void recordAdc(uint8_t channel, int32_t value);
+    void recordDigitalInput(uint8_t input, bool active);
+    void flush(bool partial);
+    void handleTick();
+
+private:
+    volatile bool recording;
+    uint8_t buffer[CFG_TRACE_BUFFER_SIZE]; // ring of encoded records to the host
+    uint16_t bufferHead, bufferTail;
+    uint32_t firstWaiting; // micros() when the oldest unsent byte was queued
+    uint32_t lastTime; // time of the last record
+    int32_t lastAdc[TRACE_ADC_CHANNELS];
+    uint8_t digitalInputs;
+    bool digitalKnown; // the state of the digital inputs was recorded at least once
+    uint32_t recordCount;
+    uint32_t dropCount;
+
+    uint8_t encodeTime(uint8_t *data, uint32_t timestamp);
+    bool append(const uint8_t *data, uint8_t length);
+};
+
+/*
+ * Feeds a trace back into CanHandler and SystemIO.
+ */
+class TracePlayer
+{
+public:
+    TracePlayer();
+    bool begin(const uint8_t *trace, uint32_t length);
+    void end();
+    bool isPlaying();
+    bool replayUntil(uint32_t time);
+    uint32_t getNextTime();
+    uint32_t getMicros();
+    uint32_t getMillis();
+
+private:
+    const uint8_t *trace;
+    uint32_t length;
+    uint32_t position; // offset of the next record
+    uint32_t nextTime; // time of the next record
+    bool nextTimeValid;
+    uint32_t clock; // the virtual time in microseconds
+    int32_t lastAdc[TRACE_ADC_CHANNELS];
+    bool playing;
+
+    bool readVarint(uint32_t &value);
+    bool peekTime();
+    bool replayRecord();
+};
+
+uint8_t traceEncodeVarint(uint8_t *data, uint32_t value);
+uint32_t traceZigZag(int32_t value);
+int32_t traceUnZigZag(uint32_t value);
+
+extern TraceRecorder traceRecorder;
+extern TracePlayer tracePlayer;
+
+#endif /* INPUT_TRACE_H_ */
@@ -0,0 +1,385 @@
+/*
+ * IsoTpHandler.cpp
+ *
+ * ISO-TP (ISO 15765-2) transport protocol on top of a CanHandler.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "IsoTpHandler.h"
+
+IsoTpHandler isoTpHandlerEv = IsoTpHandler(&canHandlerEv);
+IsoTpHandler isoTpHandlerCar = IsoTpHandler(&canHandlerCar);
+
+IsoTpHandler::IsoTpHandler(CanHandler *canHandler)
+{
+    this->canHandler = canHandler;
+    tickAttached = false;
+    for (int i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++) {
+        sessions[i].open = false;
+    }
+}
+
+/*
+ * Open a session with a peer. A session can send and receive one message at a time.
+ *
+ * \param txId - the id of the frames we send (e.g. 0x7E8 for an OBD-II response)
+ * \param rxId - the id of the frames the peer sends (e.g. 0x7E0 for an OBD-II request)
+ * \param extended - if the ids are extended ids
+ * \param observer - receives the complete messages and the result of send()
+ * \retval the session handle or -1 if no session is available
+ */
+int8_t IsoTpHandler::openSession(uint32_t txId, uint32_t rxId, bool extended, IsoTpObserver *observer)
+{
+    for (int8_t i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++) {
+        Session *session = &sessions[i];
+        if (session->open) {
+            if (session->rxId == rxId && session->extended == extended) {
+                Logger::error("ISO-TP: a session for id %X is already open", rxId);
+                return -1;
+            }
+            continue;
+        }
+        session->txId = txId;
+        session->rxId = rxId;
+        session->extended = extended;
+        session->observer = observer;
+        session->txState = TX_IDLE;
+        session->rxActive = false;
+        session->open = true;
+        canHandler->attach(this, rxId, (extended ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK), extended);
+        return i;
+    }
+    Logger::error("ISO-TP: no free session, increase CFG_ISOTP_NUM_SESSIONS");
+    return -1;
+}
+
+void IsoTpHandler::closeSession(int8_t index)
+{
+    if (index < 0 || index >= CFG_ISOTP_NUM_SESSIONS || !sessions[index].open) {
+        return;
+    }
+    Session *session = &sessions[index];
+    canHandler->detach(this, session->rxId, (session->extended ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK));
+    session->open = false;
+}
+
+/*
+ * Start sending a message. Messages up to 7 bytes are sent in a single frame,
+ * longer ones are segmented as the receiver's flow control permits.
+ * The observer's handleIsoTpSent() is called when the transfer is done.
+ *
+ * \retval false if the session is still sending or the message is too long
+ */
+bool IsoTpHandler::send(int8_t index, const uint8_t *data, uint16_t length)
+{
+    if (index < 0 || index >= CFG_ISOTP_NUM_SESSIONS || !sessions[index].open) {
+        return false;
+    }
+    Session *session = &sessions[index];
+    if (session->txState != TX_IDLE || length == 0 || length > CFG_ISOTP_BUFFER_SIZE || length > 0xFFF) {
+        return false;
+    }
+
+    CAN_FRAME frame;
+    prepareFrame(session, frame);
+    if (length < 8) {
+        frame.data.bytes[0] = ISOTP_SINGLE_FRAME | length;
+        memcpy(&frame.data.bytes[1], data, length);
+        canHandler->sendFrame(frame);
+        if (session->observer) {
+            session->observer->handleIsoTpSent(index, true);
+        }
+        return true;
+    }
+
+    memcpy(session->txBuffer, data, length);
+    session->txLength = length;
+    frame.data.bytes[0] = ISOTP_FIRST_FRAME | (length >> 8);
+    frame.data.bytes[1] = length & 0xFF;
+    memcpy(&frame.data.bytes[2], data, 6);
+    session->txOffset = 6;
+    session->txSequence = 1;
+    session->txState = TX_WAIT_FLOW_CONTROL;
+    session->txTimer = micros();
+    canHandler->sendFrame(frame);
+    requestTicks();
+    return true;
+}
+
+/*
+ * Returns true while a segmented message is being sent.
+ */
+bool IsoTpHandler::isSending(int8_t index)
+{
+    return index >= 0 && index < CFG_ISOTP_NUM_SESSIONS && sessions[index].txState != TX_IDLE;
+}
+
+/*
+ * Forward a received frame to the session which listens to its id.
+ */
+void IsoTpHandler::handleCanFrame(const CAN_FRAME *frame)
+{
+    for (int8_t i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++) {
+        if (sessions[i].open && sessions[i].rxId == frame->id && sessions[i].extended == (frame->extended != 0)) {
+            handleFrame(i, frame);
+            return;
+        }
+    }
+}
+
+void IsoTpHandler::handleFrame(int8_t index, const CAN_FRAME *frame)
+{
+    Session *session = &sessions[index];
+    uint8_t pci = frame->data.bytes[0];
+
+    if (frame->length < 1) {
+        return;
+    }
+
+    switch (pci & 0xF0) {
+    case ISOTP_SINGLE_FRAME: {
+        uint8_t length = pci & 0x0F;
+        if (length == 0 || length > frame->length - 1) {
+            return;
+        }
+        session->rxActive = false; // a new message aborts an unfinished one
+        if (session->observer) {
+            session->observer->handleIsoTpMessage(index, &frame->data.bytes[1], length);
+        }
+        break;
+    }
+    case ISOTP_FIRST_FRAME: {
+        uint16_t length = ((pci & 0x0F) << 8) | frame->data.bytes[1];
+        if (length < 8 || frame->length < 8) {
+            return;
+        }
+        if (length > CFG_ISOTP_BUFFER_SIZE) {
+            session->rxActive = false;
+            sendFlowControl(session, ISOTP_FLOW_OVERFLOW);
+            return;
+        }
+        memcpy(session->rxBuffer, &frame->data.bytes[2], 6);
+        session->rxLength = length;
+        session->rxOffset = 6;
+        session->rxSequence = 1;
+        session->rxBlockCount = 0;
+        session->rxTimer = micros();
+        session->rxActive = true;
+        sendFlowControl(session, ISOTP_FLOW_CONTINUE);
+        requestTicks();
+        break;
+    }
+    case ISOTP_CONSECUTIVE_FRAME: {
+        if (!session->rxActive) {
+            return;
+        }
+        if ((pci & 0x0F) != session->rxSequence) {
+            Logger::warn("ISO-TP: wrong sequence number on id %X, message dropped", session->rxId);
+            session->rxActive = false;
+            return;
+        }
+        uint16_t count = min(session->rxLength - session->rxOffset, 7);
+        if (count > frame->length - 1) {
+            session->rxActive = false;
+            return;
+        }
+        memcpy(&session->rxBuffer[session->rxOffset], &frame->data.bytes[1], count);
+        session->rxOffset += count;
+        session->rxSequence = (session->rxSequence + 1) & 0x0F;
+        session->rxTimer = micros();
+
+        if (session->rxOffset >= session->rxLength) {
+            session->rxActive = false;
+            if (session->observer) {
+                session->observer->handleIsoTpMessage(index, session->rxBuffer, session->rxLength);
+            }
+        }
+#if CFG_ISOTP_BLOCK_SIZE > 0
+        else if (++session->rxBlockCount >= CFG_ISOTP_BLOCK_SIZE) {
+            session->rxBlockCount = 0;
+            sendFlowControl(session, ISOTP_FLOW_CONTINUE);
+        }
+#endif
+        break;
+    }
+    case ISOTP_FLOW_CONTROL:
+        if (session->txState != TX_WAIT_FLOW_CONTROL || frame->length < 3) {
+            return;
+        }
+        switch (pci & 0x0F) {
+        case ISOTP_FLOW_CONTINUE:
+            session->txBlockSize = frame->data.bytes[1];
+            session->txBlockCount = 0;
+            session->txSeparation = decodeSeparationTime(frame->data.bytes[2]);
+            session->txLast = micros() - session->txSeparation;
+            session->txState = TX_SENDING;
+            sendConsecutiveFrames(index);
+            break;
+        case ISOTP_FLOW_WAIT:
+            session->txTimer = micros();
+            break;
+        default: // overflow or invalid
+            Logger::warn("ISO-TP: receiver on id %X refused the message (flow status %X)", session->rxId, pci & 0x0F);
+            finishTransmission(index, false);
+            break;
+        }
+        break;
+    }
+}
+
+/*
+ * Send consecutive frames and check the timeouts of all sessions.
+ * Only attached to the TickHandler while a session is busy.
+ */
+void IsoTpHandler::handleTick()
+{
+    bool busy = false;
+    uint32_t now = micros();
+
+    for (int8_t i = 0; i < CFG_ISOTP_NUM_SESSIONS; i++) {
+        Session *session = &sessions[i];
+        if (!session->open) {
+            continue;
+        }
+        if (session->txState == TX_WAIT_FLOW_CONTROL && now - session->txTimer > CFG_ISOTP_TIMEOUT) {
+            Logger::warn("ISO-TP: no flow control received on id %X", session->rxId);
+            finishTransmission(i, false);
+        }
+        if (session->txState == TX_SENDING) {
+            sendConsecutiveFrames(i);
+        }
+        if (session->rxActive && now - session->rxTimer > CFG_ISOTP_TIMEOUT) {
+            Logger::warn("ISO-TP: timeout while receiving on id %X", session->rxId);
+            session->rxActive = false;
+        }
+        if (session->txState != TX_IDLE || session->rxActive) {
+            busy = true;
+        }
+    }
+
+    if (!busy) {
+        tickHandler.detach(this);
+        tickAttached = false;
+    }
+}
+
+/*
+ * Send the consecutive frames which are due according to STmin, at most
+ * CFG_ISOTP_FRAMES_PER_TICK at a time so the transmit queue isn't flooded.
+ */
+void IsoTpHandler::sendConsecutiveFrames(int8_t index)
+{
+    Session *session = &sessions[index];
+
+    for (int n = 0; n < CFG_ISOTP_FRAMES_PER_TICK && session->txState == TX_SENDING; n++) {
+        uint32_t now = micros();
+        if (now - session->txLast < session->txSeparation) {
+            break;
+        }
+
+        CAN_FRAME frame;
+        prepareFrame(session, frame);
+        uint16_t count = min(session->txLength - session->txOffset, 7);
+        frame.data.bytes[0] = ISOTP_CONSECUTIVE_FRAME | session->txSequence;
+        memcpy(&frame.data.bytes[1], &session->txBuffer[session->txOffset], count);
+        canHandler->sendFrame(frame);
+
+        session->txOffset += count;
+        session->txSequence = (session->txSequence + 1) & 0x0F;
+        session->txLast = now;
+
+        if (session->txOffset >= session->txLength) {
+            finishTransmission(index, true);
+        } else if (session->txBlockSize > 0 && ++session->txBlockCount >= session->txBlockSize) {
+            session->txState = TX_WAIT_FLOW_CONTROL;
+            session->txTimer = now;
+        }
+    }
+}
+
+void IsoTpHandler::finishTransmission(int8_t index, bool success)
+{
+    sessions[index].txState = TX_IDLE;
+    if (sessions[index].observer) {
+        sessions[index].observer->handleIsoTpSent(index, success);
+    }
+}
+
+/*
+ * Initialize a frame of the session, unused bytes are padded.
+ */
+void IsoTpHandler::prepareFrame(Session *session, CAN_FRAME &frame)
+{
+    canHandler->prepareOutputFrame(&frame, session->txId);
+    frame.extended = session->extended;
+    memset(frame.data.bytes, CFG_ISOTP_PADDING, 8);
+}
+
+void IsoTpHandler::sendFlowControl(Session *session, uint8_t flowStatus)
+{
+    CAN_FRAME frame;
+    prepareFrame(session, frame);
+    frame.data.bytes[0] = ISOTP_FLOW_CONTROL | flowStatus;
+    frame.data.bytes[1] = CFG_ISOTP_BLOCK_SIZE;
+    frame.data.bytes[2] = CFG_ISOTP_STMIN;
+    canHandler->sendFrame(frame);
+}
+
+/*
+ * Make sure the handler gets ticks (attached on demand to not wake up loop() when idle).
+ */
+void IsoTpHandler::requestTicks()
+{
+    if (!tickAttached) {
+        tickHandler.attach(this, CFG_TICK_INTERVAL_ISOTP);
+        tickAttached = true;
+    }
+}
+
+/*
+ * Convert the STmin byte of a flow control frame to microseconds.
+ * Reserved values are treated as the maximum (127ms) as required by the standard.
+ */
+uint32_t IsoTpHandler::decodeSeparationTime(uint8_t stMin)
+{
+    if (stMin <= 0x7F) {
+        return stMin * 1000;
+    }
+    if (stMin >= 0xF1 && stMin <= 0xF9) {
+        return (stMin - 0xF0) * 100;
+    }
+    return 127000;
+}
+
+/*
+ * Default implementations of the IsoTpObserver methods.
+ */
+void IsoTpObserver::handleIsoTpMessage(int8_t session, const uint8_t *data, uint16_t length)
+{
+    Logger::error("IsoTpObserver does not implement handleIsoTpMessage(), session=%d", session);
+}
+
+void IsoTpObserver::handleIsoTpSent(int8_t session, bool success)
+{
+}
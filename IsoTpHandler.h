@@ -0,0 +1,121 @@
+/*
+ * IsoTpHandler.h
+ *
+ * ISO-TP (ISO 15765-2) transport protocol on top of a CanHandler. Messages
+ * of up to CFG_ISOTP_BUFFER_SIZE bytes are segmented/re-assembled with
+ * flow control (block size and STmin). Nothing blocks: received frames are
+ * handled when the CanHandler dispatches them, consecutive frames and
+ * timeouts are driven by ticks.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef ISOTP_HANDLER_H_
+#define ISOTP_HANDLER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+#include "Logger.h"
+
+// protocol control information (high nibble of the first data byte)
+#define ISOTP_SINGLE_FRAME      0x00
+#define ISOTP_FIRST_FRAME       0x10
+#define ISOTP_CONSECUTIVE_FRAME 0x20
+#define ISOTP_FLOW_CONTROL      0x30
+
+// flow status of a flow control frame
+#define ISOTP_FLOW_CONTINUE     0x00
+#define ISOTP_FLOW_WAIT         0x01
+#define ISOTP_FLOW_OVERFLOW     0x02
+
+/*
+ * Receives the complete messages of an ISO-TP session.
+ */
+class IsoTpObserver {
+public:
+    virtual void handleIsoTpMessage(int8_t session, const uint8_t *data, uint16_t length);
+    virtual void handleIsoTpSent(int8_t session, bool success);
+};
+
+class IsoTpHandler : public CanObserver, public TickObserver {
+public:
+    IsoTpHandler(CanHandler *canHandler);
+    int8_t openSession(uint32_t txId, uint32_t rxId, bool extended, IsoTpObserver *observer);
+    void closeSession(int8_t session);
+    bool send(int8_t session, const uint8_t *data, uint16_t length);
+    bool isSending(int8_t session);
+    void handleCanFrame(const CAN_FRAME *frame);
+    void handleTick();
+
+private:
+    enum TxState {
+        TX_IDLE,
+        TX_WAIT_FLOW_CONTROL,   // first frame or a block was sent, waiting for the receiver
+        TX_SENDING              // sending consecutive frames
+    };
+    struct Session {
+        bool open;
+        uint32_t txId;          // id of the frames we send (data and our flow control)
+        uint32_t rxId;          // id of the frames we receive (data and the peer's flow control)
+        bool extended;
+        IsoTpObserver *observer;
+
+        TxState txState;
+        uint8_t txBuffer[CFG_ISOTP_BUFFER_SIZE];
+        uint16_t txLength;
+        uint16_t txOffset;      // next byte to send
+        uint8_t txSequence;     // sequence number of the next consecutive frame
+        uint8_t txBlockSize;    // consecutive frames until the next flow control (0 = unlimited)
+        uint8_t txBlockCount;
+        uint32_t txSeparation;  // minimum time between consecutive frames in microseconds (STmin)
+        uint32_t txLast;        // micros() of the last consecutive frame
+        uint32_t txTimer;       // micros() when waiting for the flow control started
+
+        bool rxActive;          // a segmented message is being received
+        uint8_t rxBuffer[CFG_ISOTP_BUFFER_SIZE];
+        uint16_t rxLength;
+        uint16_t rxOffset;
+        uint8_t rxSequence;     // expected sequence number of the next consecutive frame
+        uint8_t rxBlockCount;
+        uint32_t rxTimer;       // micros() of the last received frame
+    };
+
+    CanHandler *canHandler;
+    Session sessions[CFG_ISOTP_NUM_SESSIONS];
+    bool tickAttached;
+
+    void prepareFrame(Session *session, CAN_FRAME &frame);
+    void sendFlowControl(Session *session, uint8_t flowStatus);
+    void sendConsecutiveFrames(int8_t index);
+    void finishTransmission(int8_t index, bool success);
+    void handleFrame(int8_t index, const CAN_FRAME *frame);
+    void requestTicks();
+    uint32_t decodeSeparationTime(uint8_t stMin);
+};
+
+extern IsoTpHandler isoTpHandlerEv;
+extern IsoTpHandler isoTpHandlerCar;
+
+#endif /* ISOTP_HANDLER_H_ */
@@ -0,0 +1,131 @@
+/*
+ * LoadMonitor.cpp
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "LoadMonitor.h"
+#include "CanHandler.h"
+
+LoadMonitor::LoadMonitor() {
+    events = 0;
+    iterationStart = 0;
+    windowStart = 0;
+    windowIdle = 0;
+    cpuLoad = 0;
+    maxIterationTime = 0;
+}
+
+/*
+ * Flag an event which has to be handled by loop(). May be called from interrupts.
+ */
+void LoadMonitor::setEvent(uint32_t event) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    events |= event;
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Events whose source has no hook of its own: the CAN driver and the USB
+ * serial port fill their buffers in their own interrupts, so only their
+ * buffers are checked. Must be called with interrupts disabled.
+ */
+uint32_t LoadMonitor::pollEvents() {
+    uint32_t pending = 0;
+
+    if (canHandlerEv.isFrameAvailable() || canHandlerCar.isFrameAvailable() || canHandlerEv.isTxReady() || canHandlerCar.isTxReady()) {
+        pending |= EVENT_CAN;
+    }
+    if (SerialUSB.available()) {
+        pending |= EVENT_SERIAL;
+    }
+    return pending;
+}
+
+/*
+ * Wait until at least one event is pending and return (and clear) all pending events.
+ * While waiting, the CPU sleeps until the next interrupt (every interrupt which
+ * could set an event wakes it up, at the latest the TickHandler base timer).
+ * The checks are made with interrupts disabled so an event can't slip in
+ * between the check and the sleep (a pending interrupt still ends WFI).
+ */
+uint32_t LoadMonitor::waitForEvents() {
+    uint32_t pending;
+    uint32_t idleStart = micros();
+
+    while (true) {
+        __disable_irq();
+        pending = events | pollEvents();
+        events = 0;
+        if (pending != 0) {
+            __enable_irq();
+            break;
+        }
+#ifdef CFG_LOOP_USE_WFI
+        __WFI();
+#endif
+        __enable_irq();
+    }
+
+    iterationStart = micros();
+    windowIdle += iterationStart - idleStart;
+
+    uint32_t elapsed = iterationStart - windowStart;
+    if (elapsed >= 1000000) {
+        cpuLoad = (windowIdle >= elapsed ? 0 : (uint64_t) (elapsed - windowIdle) * 1000 / elapsed);
+        windowStart = iterationStart;
+        windowIdle = 0;
+    }
+    return pending;
+}
+
+/*
+ * Mark the end of the work of a loop iteration.
+ */
+void LoadMonitor::endIteration() {
+    uint32_t time = micros() - iterationStart;
+    if (time > maxIterationTime) {
+        maxIterationTime = time;
+    }
+}
+
+/*
+ * The CPU load (time not spent waiting for events) during the last second in tenths of a percent.
+ */
+uint16_t LoadMonitor::getCpuLoad() {
+    return cpuLoad;
+}
+
+/*
+ * The longest time (in microseconds) a loop iteration took to handle its events.
+ */
+uint32_t LoadMonitor::getMaxIterationTime() {
+    return maxIterationTime;
+}
+
+void LoadMonitor::resetStatistics() {
+    maxIterationTime = 0;
+}
+
+LoadMonitor loadMonitor;
@@ -0,0 +1,65 @@
+/*
+ * LoadMonitor.h
+ *
+ * Collects the events which loop() has to handle and measures how busy the
+ * controller is. loop() sleeps until an event is pending, the time spent
+ * waiting is accounted as idle time.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef LOADMONITOR_H_
+#define LOADMONITOR_H_
+
+#include <Arduino.h>
+#include "config.h"
+
+// events which are handled by loop()
+#define EVENT_TICK      0x01 // the TickHandler queued a tick
+#define EVENT_CAN       0x02 // a CAN frame was received
+#define EVENT_SERIAL    0x04 // data was received on the console port
+
+class LoadMonitor {
+public:
+    LoadMonitor();
+    void setEvent(uint32_t event);
+    uint32_t waitForEvents();
+    void endIteration();
+    uint16_t getCpuLoad();
+    uint32_t getMaxIterationTime();
+    void resetStatistics();
+
+private:
+    volatile uint32_t events; // pending events, set from interrupts
+    uint32_t iterationStart; // micros() when the current loop iteration started its work
+    uint32_t windowStart; // micros() when the current measurement window started
+    uint32_t windowIdle; // idle time (micros) in the current measurement window
+    uint16_t cpuLoad; // busy time in tenths of a percent during the last complete window
+    uint32_t maxIterationTime; // longest loop iteration (micros) since the last reset
+
+    uint32_t pollEvents();
+};
+
+extern LoadMonitor loadMonitor;
+
+#endif /* LOADMONITOR_H_ */
@@ -28,6 +28,7 @@
 
 Logger::LogLevel Logger::logLevel = Logger::Info;
 uint32_t Logger::lastLogTime = 0;
+uint8_t Logger::muteCount = 0;
 
 /*
  * Output a debug message with a variable amount of parameters.
@@ -139,6 +140,8 @@ void Logger::error(DeviceId deviceId, char *message, ...) {
  * printf() style, see Logger::logMessage()
  */
 void Logger::console(char *message, ...) {
+    if (muteCount > 0)
+        return;
     va_list args;
     va_start(args, message);
     Logger::logMessage(message, args);
@@ -152,6 +155,23 @@ void Logger::setLoglevel(LogLevel level) {
     logLevel = level;
 }
 
+/*
+ * Suppress all output, including console(), while the serial port carries
+ * binary data (e.g. GVRET or a trace). Calls nest, each mute() needs an unmute().
+ */
+void Logger::mute() {
+    muteCount++;
+}
+
+void Logger::unmute() {
+    if (muteCount > 0)
+        muteCount--;
+}
+
+bool Logger::isMuted() {
+    return muteCount > 0;
+}
+
 /*
  * Retrieve the current log level.
  */
@@ -199,6 +219,8 @@ boolean Logger::isDebug() {
  * %T - prints the next parameter as boolean ('true' or 'false')
  */
 void Logger::log(DeviceId deviceId, LogLevel level, char *format, va_list args) {
+    if (muteCount > 0)
+        return;
     lastLogTime = millis();
     SerialUSB.print(lastLogTime);
     SerialUSB.print(" - ");
@@ -254,7 +276,7 @@ void Logger::logMessage(char *format, va_list args) {
                 continue;
             }
             if (*format == 's') {
-                register char *s = (char *) va_arg( args, int );
+                register char *s = va_arg( args, char * );
                 SerialUSB.print(s);
                 continue;
             }
@@ -285,7 +307,7 @@ void Logger::logMessage(char *format, va_list args) {
                 continue;
             }
             if (*format == 'l') {
-                SerialUSB.print(va_arg( args, long ), DEC);
+                SerialUSB.print(va_arg( args, int32_t ), DEC);
                 continue;
             }
 
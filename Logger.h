@@ -50,9 +50,13 @@ public:
     static LogLevel getLogLevel();
     static uint32_t getLastLogTime();
     static boolean isDebug();
+    static void mute();
+    static void unmute();
+    static bool isMuted();
 private:
     static LogLevel logLevel;
     static uint32_t lastLogTime;
+    static uint8_t muteCount; // while > 0 nothing is written to the serial port (not even console output)
 
     static void log(DeviceId, LogLevel, char *format, va_list);
     static void logMessage(char *format, va_list args);
@@ -109,6 +109,8 @@ void MotorController::handleTick() {
 
     MotorControllerConfiguration *config = (MotorControllerConfiguration *)getConfiguration();
 
+    updateTickRate();
+
     //Set status annunciators
     if(ready) statusBitfield1 |=1 << 15;
     else statusBitfield1 &= ~(1 <<15);
@@ -398,6 +400,7 @@ DeviceType MotorController::getType() {
 }
 void MotorController::setOpState(OperationState op) {
     operationState = op;
+    updateTickRate();
 }
 
 MotorController::OperationState MotorController::getOpState() {
@@ -501,6 +504,28 @@ MotorController::Gears MotorController::getSelectedGear() {
 }
 void MotorController::setSelectedGear(Gears gear) {
     selectedGear=gear;
+    updateTickRate();
+}
+
+/*
+ * While the motor controller is disabled or in neutral, run the throttles at the
+ * slow CFG_TICK_INTERVAL_IDLE rate, switch back to the full rate as soon as it is
+ * enabled with a gear selected.
+ * The controller itself keeps its full rate: it polls the enable and gear inputs
+ * and most controllers send their command/watchdog frames from handleTick().
+ * Called on every state change and every tick (some controllers modify the state directly).
+ */
+void MotorController::updateTickRate() {
+    bool idle = (operationState == DISABLED || selectedGear == NEUTRAL);
+    Throttle *accelerator = deviceManager.getAccelerator();
+    Throttle *brake = deviceManager.getBrake();
+
+    if (accelerator) {
+        accelerator->setIdleTickRate(idle);
+    }
+    if (brake) {
+        brake->setIdleTickRate(idle);
+    }
 }
 
 
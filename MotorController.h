@@ -178,6 +178,7 @@ protected:
     bool testenableinput;
     bool testreverseinput;
 
+    void updateTickRate();
 
     Gears selectedGear;
 
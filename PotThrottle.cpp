@@ -49,7 +49,7 @@ void PotThrottle::setup() {
     //set digital ports to inputs and pull them up all inputs currently active low
     //pinMode(THROTTLE_INPUT_BRAKELIGHT, INPUT_PULLUP); //Brake light switch
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_POT_THROTTLE);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_POT_THROTTLE), TICK_PRIORITY_CONTROL);
 }
 
 /*
@@ -20,6 +20,9 @@ PowerkeyPad::PowerkeyPad(void)
 		toggleState[i] = LED::OFF;
 	}
 
+	deviceName[0] = 0;
+	softwareVersion[0] = 0;
+
 	commonName = "PowerKey Pro 2600";
 }
 
@@ -31,26 +34,24 @@ void PowerkeyPad::setup()
 
     loadConfiguration();
 
-    canHandlerCar.attach(this, deviceID, 0x7F, false); //for canopen devices the ID and mask passed don't actually mean a thing
-	
 	//we inherited these methods from CanObserver - they allow this class to receive messages automatically routed and interpreted as canopen
+	//they must be set before attaching as the CanHandler builds its dispatch index on attach
 	setNodeID(deviceID);
 	setCANOpenMode(true);
 
-	//delay(125);
-	//canHandlerCar.sendNodeStart(deviceID); //tell the keypad to enable itself
-	//delay(100);
-	//sendAutoStart();
+    canHandlerCar.attach(this, deviceID, 0x7F, false); //for canopen devices the ID and mask passed don't actually mean a thing
+
+	configure();
 	
 	systemIO.installExtendedIO(this);
 }
 
-void PowerkeyPad::handleCanFrame(CAN_FRAME *)
+void PowerkeyPad::handleCanFrame(const CAN_FRAME *)
 {
 
 }
 
-void PowerkeyPad::handlePDOFrame(CAN_FRAME *frame)
+void PowerkeyPad::handlePDOFrame(const CAN_FRAME *frame)
 {	
 	if (frame->id == (0x180 + deviceID))
 	{
@@ -81,14 +82,45 @@ void PowerkeyPad::handlePDOFrame(CAN_FRAME *frame)
 	}
 }
 
-void PowerkeyPad::handleSDORequest(SDO_FRAME *frame)
+void PowerkeyPad::handleSDORequest(const SDO_FRAME *frame)
 {
 }
 
-void PowerkeyPad::handleSDOResponse(SDO_FRAME *frame)
+void PowerkeyPad::handleSDOResponse(const SDO_FRAME *frame)
 {
 }
 
+/*
+ * Queue the configuration of the keypad. The SdoClient runs the transfers
+ * back to back without waiting for ticks, so no delays are needed any more.
+ */
+void PowerkeyPad::configure()
+{
+	sdoClientCar.read(deviceID, 0x1008, 0, (uint8_t *)deviceName, sizeof(deviceName) - 1, this);
+	sdoClientCar.read(deviceID, 0x100A, 0, (uint8_t *)softwareVersion, sizeof(softwareVersion) - 1, this);
+	sendAutoStart();
+}
+
+void PowerkeyPad::handleSDOComplete(const SDO_RESULT *result)
+{
+	if (result->abortCode != 0) return; //the SdoClient already logged the failure
+
+	if (!result->write && result->index == 0x1008)
+	{
+		deviceName[result->length] = 0;
+		Logger::info(POWERKEYPRO, "Keypad name: %s", deviceName);
+	}
+	else if (!result->write && result->index == 0x100A)
+	{
+		softwareVersion[result->length] = 0;
+		Logger::info(POWERKEYPRO, "Keypad software version: %s", softwareVersion);
+	}
+	else if (result->write && result->index == 0x6500)
+	{
+		Logger::debug(POWERKEYPRO, "Auto start enabled");
+	}
+}
+
 void PowerkeyPad::handleMessage(uint32_t msgType, void* data)
 {
 	CANIODevice::handleMessage(msgType, data);
@@ -107,20 +139,8 @@ void PowerkeyPad::setDigitalOutput(int which, bool hi)
 
 void PowerkeyPad::sendAutoStart()
 {
-	CAN_FRAME autoStartOut;
-	autoStartOut.id = 600 + deviceID;
-	autoStartOut.rtr = 0;
-	autoStartOut.length = 8;
-	autoStartOut.extended = false;
-	autoStartOut.data.bytes[0] = 0x23;
-	autoStartOut.data.bytes[1] = 0;
-	autoStartOut.data.bytes[2] = 0x65;
-	autoStartOut.data.bytes[3] = 1;
-	autoStartOut.data.bytes[4] = 0x10;
-	autoStartOut.data.bytes[5] = 1;
-	autoStartOut.data.bytes[6] = 0;
-	autoStartOut.data.bytes[7] = 0;
-	canHandlerCar.sendFrame(autoStartOut);
+	uint8_t data[4] = { 0x10, 1, 0, 0 };
+	sdoClientCar.write(deviceID, 0x6500, 1, data, 4, this);
 }
 
 /*
@@ -198,19 +218,7 @@ void PowerkeyPad::setLEDState(int which, LED::LEDTYPE state)
 	if (which < 0) return;
 	if (which >= numDigitalInputs) return; //there are as many LEDs as there are buttons
 
-/*	SDO_FRAME frame;
-	frame.nodeID = 0x600 + deviceID;
-	frame.cmd = SDO_WRITE;
-	frame.index = 0x6500;
-	frame.subIndex = 1; 
-	frame.dataLength = 4;
-	frame.data[0] = 1;
-	frame.data[1] = which;
-	frame.data[2] = (int)state;
-	frame.data[3] = 0; 
-
-	canHandlerCar.sendSDORequest(&frame); */
-	LEDState[which] = state;
+	LEDState[which] = state; //sent to the keypad with the next sendLEDBatch()
 }
 
 void PowerkeyPad::sendLEDBatch()
@@ -28,6 +28,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "Device.h"
 #include "DeviceTypes.h"
 #include "CANIODevice.h"
+#include "SdoClient.h"
 
 namespace LED
 {
@@ -69,10 +70,11 @@ public:
 
 	void setup();   
 
-	void handleCanFrame(CAN_FRAME *frame);
-	void handlePDOFrame(CAN_FRAME *frame);
-	void handleSDORequest(SDO_FRAME *frame);
-	void handleSDOResponse(SDO_FRAME *frame);
+	void handleCanFrame(const CAN_FRAME *frame);
+	void handlePDOFrame(const CAN_FRAME *frame);
+	void handleSDORequest(const SDO_FRAME *frame);
+	void handleSDOResponse(const SDO_FRAME *frame);
+	void handleSDOComplete(const SDO_RESULT *result);
 
     void handleMessage(uint32_t, void*);
 	DeviceId getId();
@@ -84,4 +86,8 @@ private:
 	bool toggleState[12]; //used by any inputs set to LatchModes::TOGGLING
 	LED::LEDTYPE LEDState[12]; //LED state for all 12 keys
 	LatchModes::LATCHMODE latchState[12];
+	char deviceName[33]; //read from object 0x1008 (long enough for a block upload)
+	char softwareVersion[17]; //read from object 0x100A
+
+	void configure();
 };
\ No newline at end of file
@@ -40,7 +40,7 @@ RMSMotorController::RMSMotorController() : MotorController()
 
     prefsHandler = new PrefHandler(RINEHARTINV);
     operationState = ENABLE;
-    online = 0;
+    rxWatch = -1;
     activityCount = 0;
     sequence=0;
     commonName = "Rinehart Motion Systems Inverter";
@@ -56,27 +56,38 @@ void RMSMotorController::setup()
 
     MotorController::setup(); // run the parent class version of this function
 
-    //allow through 0xA0 through 0xAF	
-    canHandlerEv.attach(this, 0x0A0, 0x7f0, false);
+    //allow through 0xA0 through 0xAF, only when their content changes (the watch still sees every frame)
+    canHandlerEv.attach(this, 0x0A0, 0x7f0, false, true);
+    canHandlerEv.unwatchFrames(rxWatch);
+    rxWatch = canHandlerEv.watchFrames(0x0A0, 0x7f0, false, CFG_MOTORCTRL_RX_TIMEOUT, 0, this);
 
     operationState=ENABLE;
     selectedGear=NEUTRAL;
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_MOTOR_CONTROLLER), TICK_PRIORITY_CONTROL);
 }
 
 
-void RMSMotorController::handleCanFrame(CAN_FRAME *frame)
+/*
+ * No frame was received from the RMS for CFG_MOTORCTRL_RX_TIMEOUT
+ */
+void RMSMotorController::handleCanTimeout(int8_t watch)
+{
+    running = false;
+}
+
+/*
+ * Frames are received from the RMS (again)
+ */
+void RMSMotorController::handleCanRecovery(int8_t watch)
+{
+    faultHandler.cancelOngoingFault(CODAUQM, FAULT_MOTORCTRL_COMM); // we're newly running, cancel faults if necessary
+    running = true;
+}
+
+void RMSMotorController::handleCanFrame(const CAN_FRAME *frame)
 {
     int temp;
     uint8_t *data = (uint8_t *)frame->data.value;
-    online = 1; //if a frame got to here then it passed the filter and must come from RMS
-	
-    if (!running) //if we're newly running then cancel faults if necessary.
-    {
-        faultHandler.cancelOngoingFault(CODAUQM, FAULT_MOTORCTRL_COMM);
-    }
-    
-    running=true;
     
     Logger::debug("inverter msg: %X   %X   %X   %X   %X   %X   %X   %X  %X", frame->id, frame->data.bytes[0],
                   frame->data.bytes[1],frame->data.bytes[2],frame->data.bytes[3],frame->data.bytes[4],
@@ -478,16 +489,6 @@ void RMSMotorController::handleTick() {
 	
     if (isCANControlled) sendCmdFrame();   //Send out control message if inverter tells us it's set to CAN control. Otherwise just listen
 
-    if(!online)  //This routine checks to see if we have received any frames from the inverter.  If so, ONLINE would be true and
-    {   //we set the RUNNING light on.  If no frames are received for 2 seconds, we set running OFF.
-        if (millis()-mss>2000)
-        {
-            running=false; // We haven't received any frames for over 2 seconds.  Otherwise online would be true.
-            mss=millis();   //Reset our 2 second timer
-        }
-    }
-    else running=true;
-    online=false;//This flag will be set to true by received frames
 }
 
 
@@ -544,7 +545,7 @@ void RMSMotorController::sendCmdFrame()
     output.data.bytes[1] = (torqueCommand & 0xFF00) >> 8;  //Stow torque command in bytes 2 and 3.
     output.data.bytes[0] = (torqueCommand & 0x00FF);
     
-    canHandlerEv.sendFrame(output);  //Mail it.
+    canHandlerEv.sendFrame(output, CAN_TX_PRIORITY_HIGH);  //Mail it.
 
     Logger::debug("CAN Command Frame: %X  %X  %X  %X  %X  %X  %X  %X",output.id, output.data.bytes[0],
                   output.data.bytes[1],output.data.bytes[2],output.data.bytes[3],output.data.bytes[4],
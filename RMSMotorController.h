@@ -46,7 +46,9 @@ class RMSMotorController: public MotorController, CanObserver {
 
 public:
     virtual void handleTick();
-    virtual void handleCanFrame(CAN_FRAME *frame);
+    virtual void handleCanFrame(const CAN_FRAME *frame);
+    virtual void handleCanTimeout(int8_t watch);
+    virtual void handleCanRecovery(int8_t watch);
     virtual void setup();
 
     RMSMotorController();
@@ -57,12 +59,11 @@ public:
     virtual void saveConfiguration();
 
 private:
-    byte online; //counter for whether we're getting traffic from RMS controller
+    int8_t rxWatch; // handle of the watch on the frames from the inverter
     byte alive;
     int activityCount;
     byte sequence;
     uint16_t torqueCommand;
-	uint32_t mss;
 	bool isLockedOut;
 	bool isEnabled;
 	bool isCANControlled;
@@ -0,0 +1,532 @@
+/*
+ * SdoClient.cpp
+ *
+ * Non-blocking CANopen SDO client (CiA 301 expedited, segmented and block transfers).
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "SdoClient.h"
+
+SdoClient sdoClientEv = SdoClient(&canHandlerEv);
+SdoClient sdoClientCar = SdoClient(&canHandlerCar);
+
+SdoClient::SdoClient(CanHandler *canHandler)
+{
+    this->canHandler = canHandler;
+    nextOrder = 0;
+    canAttached = false;
+    tickAttached = false;
+    for (int i = 0; i < CFG_SDO_QUEUE_SIZE; i++) {
+        transfers[i].used = false;
+    }
+}
+
+/*
+ * Queue an upload of an object from a node. The observer's handleSDOComplete()
+ * is called with the result, the buffer must stay valid until then.
+ *
+ * \retval false if the queue is full
+ */
+bool SdoClient::read(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint8_t *buffer, uint16_t maxLength, CanObserver *observer)
+{
+    Transfer *transfer = enqueue(nodeId, index, subIndex, observer);
+    if (transfer == NULL) {
+        return false;
+    }
+    transfer->write = false;
+    transfer->destination = buffer;
+    transfer->maxLength = maxLength;
+    transfer->block = (maxLength > CFG_SDO_BLOCK_MIN_LENGTH);
+    startNext(nodeId);
+    return true;
+}
+
+/*
+ * Queue a download of data to an object of a node. Up to 4 bytes are copied,
+ * longer data must stay valid until the observer's handleSDOComplete() is called.
+ *
+ * \retval false if the queue is full
+ */
+bool SdoClient::write(uint8_t nodeId, uint16_t index, uint8_t subIndex, const uint8_t *data, uint16_t length, CanObserver *observer)
+{
+    if (length == 0) {
+        return false;
+    }
+    Transfer *transfer = enqueue(nodeId, index, subIndex, observer);
+    if (transfer == NULL) {
+        return false;
+    }
+    transfer->write = true;
+    transfer->length = length;
+    if (length <= 4) {
+        memcpy(transfer->small, data, length);
+        transfer->source = transfer->small;
+    } else {
+        transfer->source = data;
+    }
+    transfer->block = (length > CFG_SDO_BLOCK_MIN_LENGTH);
+    startNext(nodeId);
+    return true;
+}
+
+/*
+ * Returns true if transfers of the node are in progress or queued.
+ */
+bool SdoClient::isBusy(uint8_t nodeId)
+{
+    for (int i = 0; i < CFG_SDO_QUEUE_SIZE; i++) {
+        if (transfers[i].used && transfers[i].nodeId == nodeId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SdoClient::Transfer *SdoClient::enqueue(uint8_t nodeId, uint16_t index, uint8_t subIndex, CanObserver *observer)
+{
+    if (!canAttached) { // all SDO responses (0x581 - 0x5FF)
+        canHandler->attach(this, 0x580, 0x780, false);
+        canAttached = true;
+    }
+
+    for (int i = 0; i < CFG_SDO_QUEUE_SIZE; i++) {
+        Transfer *transfer = &transfers[i];
+        if (!transfer->used) {
+            transfer->used = true;
+            transfer->state = STATE_QUEUED;
+            transfer->order = nextOrder++;
+            transfer->nodeId = nodeId & 0x7F;
+            transfer->index = index;
+            transfer->subIndex = subIndex;
+            transfer->observer = observer;
+            transfer->length = 0;
+            transfer->offset = 0;
+            return transfer;
+        }
+    }
+    Logger::error("SDO queue full, increase CFG_SDO_QUEUE_SIZE");
+    return NULL;
+}
+
+/*
+ * Find the transfer of a node which is in progress.
+ */
+SdoClient::Transfer *SdoClient::findActive(uint8_t nodeId)
+{
+    for (int i = 0; i < CFG_SDO_QUEUE_SIZE; i++) {
+        if (transfers[i].used && transfers[i].nodeId == nodeId && transfers[i].state != STATE_QUEUED) {
+            return &transfers[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Start the oldest queued transfer of a node unless one is in progress.
+ */
+void SdoClient::startNext(uint8_t nodeId)
+{
+    Transfer *next = NULL;
+
+    if (findActive(nodeId) != NULL) {
+        return;
+    }
+    for (int i = 0; i < CFG_SDO_QUEUE_SIZE; i++) {
+        Transfer *transfer = &transfers[i];
+        if (transfer->used && transfer->nodeId == nodeId && (next == NULL || (int32_t) (transfer->order - next->order) < 0)) {
+            next = transfer;
+        }
+    }
+    if (next != NULL) {
+        start(next);
+    }
+}
+
+void SdoClient::start(Transfer *transfer)
+{
+    uint8_t data[4] = { 0, 0, 0, 0 };
+
+    transfer->offset = 0;
+    transfer->toggle = 0;
+    transfer->timer = micros();
+    if (transfer->write) {
+        if (transfer->length <= 4) { // expedited download
+            memcpy(data, transfer->source, transfer->length);
+            sendRequest(transfer, 0x23 | ((4 - transfer->length) << 2), data, 4);
+            transfer->state = STATE_INITIATE;
+        } else {
+            data[0] = transfer->length & 0xFF;
+            data[1] = transfer->length >> 8;
+            if (transfer->block) {
+                sendRequest(transfer, 0xC2, data, 4); // block download, size indicated, no CRC
+                transfer->state = STATE_BLOCK_INITIATE;
+            } else {
+                sendRequest(transfer, 0x21, data, 4); // segmented download, size indicated
+                transfer->state = STATE_INITIATE;
+            }
+        }
+    } else {
+        transfer->length = 0;
+        if (transfer->block) {
+            data[0] = CFG_SDO_BLOCK_SIZE;
+            sendRequest(transfer, 0xA0, data, 4); // block upload, no CRC, no protocol switch
+            transfer->state = STATE_BLOCK_INITIATE;
+        } else {
+            sendRequest(transfer, 0x40, data, 4);
+            transfer->state = STATE_INITIATE;
+        }
+    }
+
+    if (!tickAttached) {
+        tickHandler.attach(this, CFG_TICK_INTERVAL_SDO);
+        tickAttached = true;
+    }
+}
+
+/*
+ * Report the result of a transfer to its observer and start the next one of the node.
+ */
+void SdoClient::complete(Transfer *transfer, uint32_t abortCode)
+{
+    SDO_RESULT result;
+
+    result.nodeID = transfer->nodeId;
+    result.index = transfer->index;
+    result.subIndex = transfer->subIndex;
+    result.write = transfer->write;
+    result.abortCode = abortCode;
+    result.data = (transfer->write ? NULL : transfer->destination);
+    result.length = (transfer->write ? transfer->offset : transfer->length);
+    transfer->used = false;
+
+    if (abortCode != 0) {
+        Logger::warn("SDO %s of node %d, object %X sub %d failed: %X", (transfer->write ? "download" : "upload"), transfer->nodeId,
+                transfer->index, transfer->subIndex, abortCode);
+    }
+    if (transfer->observer != NULL) {
+        transfer->observer->handleSDOComplete(&result);
+    }
+    startNext(result.nodeID);
+}
+
+/*
+ * Tell the node that we abort the transfer and report the failure.
+ */
+void SdoClient::abort(Transfer *transfer, uint32_t abortCode)
+{
+    uint8_t data[4] = { (uint8_t) abortCode, (uint8_t) (abortCode >> 8), (uint8_t) (abortCode >> 16), (uint8_t) (abortCode >> 24) };
+    sendRequest(transfer, 0x80, data, 4);
+    complete(transfer, abortCode);
+}
+
+/*
+ * Forward a response to the transfer which is in progress for the node.
+ */
+void SdoClient::handleCanFrame(const CAN_FRAME *frame)
+{
+    if (frame->id < 0x581 || frame->id > 0x5FF || frame->length < 8) {
+        return;
+    }
+    Transfer *transfer = findActive(frame->id - 0x580);
+    if (transfer == NULL) {
+        return;
+    }
+    const uint8_t *data = frame->data.bytes;
+    transfer->timer = micros();
+
+    if (data[0] == 0x80) { // abort by the node (sequence number 0 is never valid in a block)
+        uint32_t code = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t) data[7] << 24);
+        if (transfer->state == STATE_BLOCK_INITIATE && code == SDO_ABORT_COMMAND) {
+            transfer->block = false; // the node doesn't support block transfers
+            start(transfer);
+        } else {
+            complete(transfer, code);
+        }
+        return;
+    }
+
+    if (transfer->write) {
+        handleDownload(transfer, data);
+    } else {
+        handleUpload(transfer, data);
+    }
+}
+
+void SdoClient::handleDownload(Transfer *transfer, const uint8_t *data)
+{
+    switch (transfer->state) {
+    case STATE_INITIATE:
+        if (data[0] != 0x60) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else if (transfer->length <= 4) {
+            transfer->offset = transfer->length;
+            complete(transfer, 0);
+        } else {
+            transfer->state = STATE_SEGMENT;
+            sendSegment(transfer);
+        }
+        break;
+    case STATE_SEGMENT:
+        if ((data[0] & 0xE0) != 0x20) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else if (((data[0] >> 4) & 1) != transfer->toggle) {
+            abort(transfer, SDO_ABORT_TOGGLE);
+        } else {
+            transfer->offset += min(transfer->length - transfer->offset, 7);
+            transfer->toggle ^= 1;
+            if (transfer->offset >= transfer->length) {
+                complete(transfer, 0);
+            } else {
+                sendSegment(transfer);
+            }
+        }
+        break;
+    case STATE_BLOCK_INITIATE:
+        if ((data[0] & 0xE3) != 0xA0 || data[4] == 0 || data[4] > 127) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else {
+            transfer->blockSize = data[4];
+            transfer->blockStart = 0;
+            transfer->sequence = 0;
+            transfer->state = STATE_BLOCK_SEND;
+            sendBlockSegments(transfer);
+        }
+        break;
+    case STATE_BLOCK_SEND: // the node may confirm early
+    case STATE_BLOCK_ACK:
+        if ((data[0] & 0xE3) != 0xA2 || data[1] > transfer->sequence || data[2] == 0 || data[2] > 127) {
+            abort(transfer, SDO_ABORT_SEQUENCE);
+        } else {
+            // continue after the last segment the node received correctly
+            transfer->offset = min(transfer->blockStart + data[1] * 7, transfer->length);
+            if (transfer->offset >= transfer->length) {
+                uint8_t crc[4] = { 0, 0, 0, 0 };
+                uint8_t unused = 7 - ((transfer->length - 1) % 7 + 1); // bytes of the last segment without data
+                uint8_t end[8] = { (uint8_t) (0xC1 | (unused << 2)), crc[0], crc[1], 0, 0, 0, 0, 0 };
+                sendFrame(transfer->nodeId, end);
+                transfer->state = STATE_BLOCK_END;
+            } else {
+                transfer->blockSize = data[2];
+                transfer->blockStart = transfer->offset;
+                transfer->sequence = 0;
+                transfer->state = STATE_BLOCK_SEND;
+                sendBlockSegments(transfer);
+            }
+        }
+        break;
+    case STATE_BLOCK_END:
+        if ((data[0] & 0xE3) != 0xA1) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else {
+            complete(transfer, 0);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void SdoClient::handleUpload(Transfer *transfer, const uint8_t *data)
+{
+    uint8_t ack[8] = { 0xA2, 0, CFG_SDO_BLOCK_SIZE, 0, 0, 0, 0, 0 };
+
+    switch (transfer->state) {
+    case STATE_INITIATE:
+        if ((data[0] & 0xE0) != 0x40) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else if (data[0] & 0x02) { // expedited
+            storeData(transfer, &data[4], (data[0] & 0x01) ? 4 - ((data[0] >> 2) & 0x03) : 4);
+            complete(transfer, transfer->length > transfer->maxLength ? SDO_ABORT_MEMORY : 0);
+        } else {
+            transfer->state = STATE_SEGMENT;
+            uint8_t request[8] = { (uint8_t) (0x60 | (transfer->toggle << 4)), 0, 0, 0, 0, 0, 0, 0 };
+            sendFrame(transfer->nodeId, request);
+        }
+        break;
+    case STATE_SEGMENT:
+        if ((data[0] & 0xE0) != 0x00) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else if (((data[0] >> 4) & 1) != transfer->toggle) {
+            abort(transfer, SDO_ABORT_TOGGLE);
+        } else {
+            storeData(transfer, &data[1], 7 - ((data[0] >> 1) & 0x07));
+            transfer->toggle ^= 1;
+            if (transfer->length > transfer->maxLength) {
+                abort(transfer, SDO_ABORT_MEMORY);
+            } else if (data[0] & 0x01) { // last segment
+                complete(transfer, 0);
+            } else {
+                uint8_t request[8] = { (uint8_t) (0x60 | (transfer->toggle << 4)), 0, 0, 0, 0, 0, 0, 0 };
+                sendFrame(transfer->nodeId, request);
+            }
+        }
+        break;
+    case STATE_BLOCK_INITIATE:
+        if ((data[0] & 0xE1) != 0xC0) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else {
+            uint8_t startUpload[8] = { 0xA3, 0, 0, 0, 0, 0, 0, 0 };
+            transfer->sequence = 0;
+            transfer->lastSegment = false;
+            transfer->state = STATE_BLOCK_RECEIVE;
+            sendFrame(transfer->nodeId, startUpload);
+        }
+        break;
+    case STATE_BLOCK_RECEIVE: {
+        uint8_t sequence = data[0] & 0x7F;
+        if (sequence == transfer->sequence + 1 && !transfer->lastSegment) {
+            storeData(transfer, &data[1], 7); // the unused bytes of the last segment are subtracted at the end
+            transfer->sequence = sequence;
+            transfer->lastSegment = (data[0] & 0x80);
+        }
+        if (transfer->length > transfer->maxLength + 7) {
+            abort(transfer, SDO_ABORT_MEMORY);
+        } else if (sequence >= CFG_SDO_BLOCK_SIZE || (data[0] & 0x80)) { // end of the block, confirm what we got
+            ack[1] = transfer->sequence;
+            sendFrame(transfer->nodeId, ack);
+            transfer->sequence = 0;
+            if (transfer->lastSegment) {
+                transfer->state = STATE_BLOCK_END;
+            }
+        }
+        break;
+    }
+    case STATE_BLOCK_END:
+        if ((data[0] & 0xE3) != 0xC1) {
+            abort(transfer, SDO_ABORT_COMMAND);
+        } else {
+            uint8_t end[8] = { 0xA1, 0, 0, 0, 0, 0, 0, 0 };
+            sendFrame(transfer->nodeId, end);
+            transfer->length -= (data[0] >> 2) & 0x07;
+            complete(transfer, transfer->length > transfer->maxLength ? SDO_ABORT_MEMORY : 0);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Send the next segment of a segmented download.
+ */
+void SdoClient::sendSegment(Transfer *transfer)
+{
+    uint8_t data[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    uint8_t count = min(transfer->length - transfer->offset, 7);
+    bool last = (transfer->offset + count >= transfer->length);
+
+    data[0] = (transfer->toggle << 4) | ((7 - count) << 1) | (last ? 1 : 0);
+    memcpy(&data[1], &transfer->source[transfer->offset], count);
+    sendFrame(transfer->nodeId, data);
+}
+
+/*
+ * Send segments of the current block of a block download. Limited to
+ * CFG_SDO_SEGMENTS_PER_TICK per call so the transmit queue isn't flooded,
+ * the rest is sent on the following ticks.
+ */
+void SdoClient::sendBlockSegments(Transfer *transfer)
+{
+    for (int n = 0; n < CFG_SDO_SEGMENTS_PER_TICK && transfer->state == STATE_BLOCK_SEND; n++) {
+        uint16_t offset = transfer->blockStart + transfer->sequence * 7;
+        uint8_t count = min(transfer->length - offset, 7);
+        bool last = (offset + count >= transfer->length);
+        uint8_t data[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        transfer->sequence++;
+        data[0] = transfer->sequence | (last ? 0x80 : 0);
+        memcpy(&data[1], &transfer->source[offset], count);
+        sendFrame(transfer->nodeId, data);
+
+        if (last || transfer->sequence >= transfer->blockSize) {
+            transfer->state = STATE_BLOCK_ACK;
+            transfer->timer = micros();
+        }
+    }
+}
+
+/*
+ * Copy received data to the buffer of an upload as far as it fits.
+ * The received length is counted completely so an overflow can be detected.
+ */
+void SdoClient::storeData(Transfer *transfer, const uint8_t *data, uint8_t count)
+{
+    for (int i = 0; i < count; i++) {
+        if (transfer->length < transfer->maxLength) {
+            transfer->destination[transfer->length] = data[i];
+        }
+        transfer->length++;
+    }
+}
+
+/*
+ * Send a frame with a command specifier followed by the multiplexer (index and sub-index).
+ */
+void SdoClient::sendRequest(Transfer *transfer, uint8_t command, const uint8_t *data, uint8_t count)
+{
+    uint8_t frame[8] = { command, (uint8_t) (transfer->index & 0xFF), (uint8_t) (transfer->index >> 8), transfer->subIndex, 0, 0, 0, 0 };
+    memcpy(&frame[4], data, count);
+    sendFrame(transfer->nodeId, frame);
+}
+
+void SdoClient::sendFrame(uint8_t nodeId, const uint8_t *data)
+{
+    CAN_FRAME frame;
+    canHandler->prepareOutputFrame(&frame, 0x600 + nodeId);
+    memcpy(frame.data.bytes, data, 8);
+    canHandler->sendFrame(frame);
+}
+
+/*
+ * Continue block downloads and check the timeouts of the transfers in progress.
+ * Only attached to the TickHandler while transfers are in progress.
+ */
+void SdoClient::handleTick()
+{
+    bool busy = false;
+    uint32_t now = micros();
+
+    for (int i = 0; i < CFG_SDO_QUEUE_SIZE; i++) {
+        Transfer *transfer = &transfers[i];
+        if (!transfer->used || transfer->state == STATE_QUEUED) {
+            continue;
+        }
+        if (transfer->state == STATE_BLOCK_SEND) {
+            transfer->timer = now;
+            sendBlockSegments(transfer);
+        } else if (now - transfer->timer > CFG_SDO_TIMEOUT) {
+            abort(transfer, SDO_ABORT_TIMEOUT);
+        }
+    }
+
+    for (int i = 0; i < CFG_SDO_QUEUE_SIZE; i++) {
+        if (transfers[i].used) {
+            busy = true;
+        }
+    }
+    if (!busy) {
+        tickHandler.detach(this);
+        tickAttached = false;
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * SdoClient.h
+ *
+ * Non-blocking CANopen SDO client. Reads and writes objects of any length
+ * with expedited, segmented or block transfers. Requests are queued per node
+ * and the next one is started as soon as the previous one completes, so
+ * configuring a node takes a few bus round trips instead of loop() iterations.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef SDO_CLIENT_H_
+#define SDO_CLIENT_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "TickHandler.h"
+#include "Logger.h"
+
+// CANopen SDO abort codes used by the client
+#define SDO_ABORT_TOGGLE        0x05030000 // toggle bit not alternated
+#define SDO_ABORT_TIMEOUT       0x05040000 // SDO protocol timed out
+#define SDO_ABORT_COMMAND       0x05040001 // client/server command specifier not valid or unknown
+#define SDO_ABORT_SEQUENCE      0x05040003 // invalid sequence number (block mode)
+#define SDO_ABORT_MEMORY        0x05040005 // out of memory
+#define SDO_ABORT_CANCELED      0x08000000 // general error
+
+class SdoClient : public CanObserver, public TickObserver {
+public:
+    SdoClient(CanHandler *canHandler);
+    bool read(uint8_t nodeId, uint16_t index, uint8_t subIndex, uint8_t *buffer, uint16_t maxLength, CanObserver *observer);
+    bool write(uint8_t nodeId, uint16_t index, uint8_t subIndex, const uint8_t *data, uint16_t length, CanObserver *observer);
+    bool isBusy(uint8_t nodeId);
+    void handleCanFrame(const CAN_FRAME *frame);
+    void handleTick();
+
+private:
+    enum State {
+        STATE_QUEUED,           // waiting for the previous transfer of the node to complete
+        STATE_INITIATE,         // initiate download/upload sent
+        STATE_SEGMENT,          // segment sent (download) or requested (upload)
+        STATE_BLOCK_INITIATE,   // initiate block download/upload sent
+        STATE_BLOCK_SEND,       // sending the segments of a block (download)
+        STATE_BLOCK_ACK,        // waiting for the confirmation of a block (download)
+        STATE_BLOCK_RECEIVE,    // receiving the segments of a block (upload)
+        STATE_BLOCK_END         // end of block transfer sent/expected
+    };
+    struct Transfer {
+        bool used;
+        State state;
+        uint32_t order;         // keeps the order of the requests of a node
+        uint8_t nodeId;
+        uint16_t index;
+        uint8_t subIndex;
+        bool write;
+        bool block;             // use a block transfer (falls back to segmented if the node doesn't support it)
+        const uint8_t *source;  // download: the data to send (must stay valid until completion if longer than 4 bytes)
+        uint8_t small[4];       // download: copy of expedited data
+        uint8_t *destination;   // upload: the receive buffer
+        uint16_t length;        // download: total length, upload: bytes received
+        uint16_t maxLength;     // upload: size of the receive buffer
+        uint16_t offset;        // next byte to send / store
+        uint8_t toggle;         // toggle bit of the segmented transfer
+        uint8_t blockSize;      // number of segments per block
+        uint8_t sequence;       // last sent / last correctly received sequence number of a block
+        uint16_t blockStart;    // offset of the first byte of the current block
+        bool lastSegment;       // upload: the segment with the last data was received
+        uint32_t timer;         // micros() of the last activity
+        CanObserver *observer;
+    };
+
+    CanHandler *canHandler;
+    Transfer transfers[CFG_SDO_QUEUE_SIZE];
+    uint32_t nextOrder;
+    bool canAttached;
+    bool tickAttached;
+
+    Transfer *enqueue(uint8_t nodeId, uint16_t index, uint8_t subIndex, CanObserver *observer);
+    Transfer *findActive(uint8_t nodeId);
+    void startNext(uint8_t nodeId);
+    void start(Transfer *transfer);
+    void complete(Transfer *transfer, uint32_t abortCode);
+    void abort(Transfer *transfer, uint32_t abortCode);
+    void handleDownload(Transfer *transfer, const uint8_t *data);
+    void handleUpload(Transfer *transfer, const uint8_t *data);
+    void sendSegment(Transfer *transfer);
+    void sendBlockSegments(Transfer *transfer);
+    void storeData(Transfer *transfer, const uint8_t *data, uint8_t count);
+    void sendRequest(Transfer *transfer, uint8_t command, const uint8_t *data, uint8_t count);
+    void sendFrame(uint8_t nodeId, const uint8_t *data);
+};
+
+extern SdoClient sdoClientEv;
+extern SdoClient sdoClientCar;
+
+#endif /* SDO_CLIENT_H_ */
@@ -0,0 +1,690 @@
+/*
+ * SdoServer.cpp
+ *
+ * CANopen SDO server (CiA 301 expedited and segmented transfers) for the
+ * configuration of the GEVCU over CAN.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "SdoServer.h"
+#include "PotThrottle.h"
+
+SdoServer sdoServer = SdoServer(&canHandlerEv);
+
+/*
+ * The values which are mapped into the object dictionary
+ */
+enum SdoParameter {
+    PARAM_COUNT,            // sub-index 0 of a record: number of parameters
+    PARAM_DEVICE_TYPE,
+    PARAM_DEVICE_NAME,
+    PARAM_SOFTWARE_VERSION,
+
+    ACC_NUMBER_POTS,
+    ACC_SUB_TYPE,
+    ACC_MIN_LEVEL1,
+    ACC_MAX_LEVEL1,
+    ACC_MIN_LEVEL2,
+    ACC_MAX_LEVEL2,
+    ACC_REGEN_MAX_POSITION,
+    ACC_REGEN_MIN_POSITION,
+    ACC_FORWARD_POSITION,
+    ACC_HALF_POWER_POSITION,
+    ACC_MIN_REGEN,
+    ACC_MAX_REGEN,
+    ACC_CREEP,
+    ACC_ADC_PIN1,
+    ACC_ADC_PIN2,
+
+    BRAKE_MIN_LEVEL,
+    BRAKE_MAX_LEVEL,
+    BRAKE_MIN_REGEN,
+    BRAKE_MAX_REGEN,
+    BRAKE_ADC_PIN,
+
+    MC_SPEED_MAX,
+    MC_TORQUE_MAX,
+    MC_REVERSE_PERCENT,
+    MC_PRECHARGE_CAPACITANCE,
+    MC_PRECHARGE_DELAY,
+    MC_NOMINAL_VOLT,
+    MC_PRECHARGE_RELAY,
+    MC_MAIN_CONTACTOR_RELAY,
+    MC_BRAKE_LIGHT,
+    MC_REVERSE_LIGHT,
+    MC_ENABLE_IN,
+    MC_REVERSE_IN,
+    MC_REGEN_TAPER_LOWER,
+    MC_REGEN_TAPER_UPPER,
+    MC_TORQUE_SLEW_RATE,
+    MC_SPEED_SLEW_RATE
+};
+
+/*
+ * The object dictionary, sorted by index and sub-index. The values of a record
+ * are packed into its block object in this order.
+ */
+static const SdoServer::Object objects[] = {
+    { 0x1000, 0, SdoServer::TYPE_UINT32, PARAM_DEVICE_TYPE, false, 0, 0 },
+    { 0x1008, 0, SdoServer::TYPE_STRING, PARAM_DEVICE_NAME, false, 0, 0 },
+    { 0x100A, 0, SdoServer::TYPE_STRING, PARAM_SOFTWARE_VERSION, false, 0, 0 },
+
+    { SDO_RECORD_ACCELERATOR, 0, SdoServer::TYPE_UINT8, PARAM_COUNT, false, 0, 0 },
+    { SDO_RECORD_ACCELERATOR, 1, SdoServer::TYPE_UINT8, ACC_NUMBER_POTS, true, 1, 3 },              // TPOT
+    { SDO_RECORD_ACCELERATOR, 2, SdoServer::TYPE_UINT8, ACC_SUB_TYPE, true, 0, 2 },                 // TTYPE
+    { SDO_RECORD_ACCELERATOR, 3, SdoServer::TYPE_INT16, ACC_MIN_LEVEL1, true, -32768, 32767 },      // T1MN
+    { SDO_RECORD_ACCELERATOR, 4, SdoServer::TYPE_INT16, ACC_MAX_LEVEL1, true, -32768, 32767 },      // T1MX
+    { SDO_RECORD_ACCELERATOR, 5, SdoServer::TYPE_INT16, ACC_MIN_LEVEL2, true, -32768, 32767 },      // T2MN
+    { SDO_RECORD_ACCELERATOR, 6, SdoServer::TYPE_INT16, ACC_MAX_LEVEL2, true, -32768, 32767 },      // T2MX
+    { SDO_RECORD_ACCELERATOR, 7, SdoServer::TYPE_UINT16, ACC_REGEN_MAX_POSITION, true, 0, 1000 },   // TRGNMAX
+    { SDO_RECORD_ACCELERATOR, 8, SdoServer::TYPE_UINT16, ACC_REGEN_MIN_POSITION, true, 0, 1000 },   // TRGNMIN
+    { SDO_RECORD_ACCELERATOR, 9, SdoServer::TYPE_UINT16, ACC_FORWARD_POSITION, true, 0, 1000 },     // TFWD
+    { SDO_RECORD_ACCELERATOR, 10, SdoServer::TYPE_UINT16, ACC_HALF_POWER_POSITION, true, 0, 1000 }, // TMAP
+    { SDO_RECORD_ACCELERATOR, 11, SdoServer::TYPE_UINT8, ACC_MIN_REGEN, true, 0, 100 },             // TMINRN
+    { SDO_RECORD_ACCELERATOR, 12, SdoServer::TYPE_UINT8, ACC_MAX_REGEN, true, 0, 100 },             // TMAXRN
+    { SDO_RECORD_ACCELERATOR, 13, SdoServer::TYPE_UINT8, ACC_CREEP, true, 0, 100 },                 // TCREEP
+    { SDO_RECORD_ACCELERATOR, 14, SdoServer::TYPE_UINT8, ACC_ADC_PIN1, true, 0, 255 },              // T1ADC
+    { SDO_RECORD_ACCELERATOR, 15, SdoServer::TYPE_UINT8, ACC_ADC_PIN2, true, 0, 255 },              // T2ADC
+
+    { SDO_RECORD_BRAKE, 0, SdoServer::TYPE_UINT8, PARAM_COUNT, false, 0, 0 },
+    { SDO_RECORD_BRAKE, 1, SdoServer::TYPE_INT16, BRAKE_MIN_LEVEL, true, -32768, 32767 },           // B1MN
+    { SDO_RECORD_BRAKE, 2, SdoServer::TYPE_INT16, BRAKE_MAX_LEVEL, true, -32768, 32767 },           // B1MX
+    { SDO_RECORD_BRAKE, 3, SdoServer::TYPE_UINT8, BRAKE_MIN_REGEN, true, 0, 100 },                  // BMINR
+    { SDO_RECORD_BRAKE, 4, SdoServer::TYPE_UINT8, BRAKE_MAX_REGEN, true, 0, 100 },                  // BMAXR
+    { SDO_RECORD_BRAKE, 5, SdoServer::TYPE_UINT8, BRAKE_ADC_PIN, true, 0, 255 },                    // B1ADC
+
+    { SDO_RECORD_MOTOR, 0, SdoServer::TYPE_UINT8, PARAM_COUNT, false, 0, 0 },
+    { SDO_RECORD_MOTOR, 1, SdoServer::TYPE_UINT16, MC_SPEED_MAX, true, 0, 65535 },                  // RPM
+    { SDO_RECORD_MOTOR, 2, SdoServer::TYPE_UINT16, MC_TORQUE_MAX, true, 0, 65535 },                 // TORQ
+    { SDO_RECORD_MOTOR, 3, SdoServer::TYPE_UINT8, MC_REVERSE_PERCENT, true, 0, 100 },               // REVLIM
+    { SDO_RECORD_MOTOR, 4, SdoServer::TYPE_UINT16, MC_PRECHARGE_CAPACITANCE, true, 0, 65535 },      // PREC
+    { SDO_RECORD_MOTOR, 5, SdoServer::TYPE_UINT16, MC_PRECHARGE_DELAY, true, 0, 65535 },            // PREDELAY
+    { SDO_RECORD_MOTOR, 6, SdoServer::TYPE_UINT16, MC_NOMINAL_VOLT, true, 0, 65535 },               // NOMV (in 0.1V)
+    { SDO_RECORD_MOTOR, 7, SdoServer::TYPE_UINT8, MC_PRECHARGE_RELAY, true, 0, 255 },               // PRELAY
+    { SDO_RECORD_MOTOR, 8, SdoServer::TYPE_UINT8, MC_MAIN_CONTACTOR_RELAY, true, 0, 255 },          // MRELAY
+    { SDO_RECORD_MOTOR, 9, SdoServer::TYPE_UINT8, MC_BRAKE_LIGHT, true, 0, 255 },                   // BRAKELT
+    { SDO_RECORD_MOTOR, 10, SdoServer::TYPE_UINT8, MC_REVERSE_LIGHT, true, 0, 255 },                // REVLT
+    { SDO_RECORD_MOTOR, 11, SdoServer::TYPE_UINT8, MC_ENABLE_IN, true, 0, 255 },                    // ENABLEIN
+    { SDO_RECORD_MOTOR, 12, SdoServer::TYPE_UINT8, MC_REVERSE_IN, true, 0, 255 },                   // REVIN
+    { SDO_RECORD_MOTOR, 13, SdoServer::TYPE_UINT16, MC_REGEN_TAPER_LOWER, true, 0, 10000 },         // TAPERLO
+    { SDO_RECORD_MOTOR, 14, SdoServer::TYPE_UINT16, MC_REGEN_TAPER_UPPER, true, 0, 10000 },         // TAPERHI
+    { SDO_RECORD_MOTOR, 15, SdoServer::TYPE_UINT16, MC_TORQUE_SLEW_RATE, true, 0, 65535 },
+    { SDO_RECORD_MOTOR, 16, SdoServer::TYPE_UINT16, MC_SPEED_SLEW_RATE, true, 0, 65535 },
+
+    { SDO_RECORD_ACCELERATOR + SDO_BLOCK_OFFSET, 0, SdoServer::TYPE_BLOCK, 0, true, 0, 0 },
+    { SDO_RECORD_BRAKE + SDO_BLOCK_OFFSET, 0, SdoServer::TYPE_BLOCK, 0, true, 0, 0 },
+    { SDO_RECORD_MOTOR + SDO_BLOCK_OFFSET, 0, SdoServer::TYPE_BLOCK, 0, true, 0, 0 }
+};
+
+#define SDO_NUM_OBJECTS (sizeof(objects) / sizeof(objects[0]))
+
+SdoServer::SdoServer(CanHandler *canHandler)
+{
+    this->canHandler = canHandler;
+    nodeId = 0;
+    state = STATE_IDLE;
+    object = NULL;
+    length = offset = toggle = 0;
+    timer = 0;
+}
+
+/*
+ * Listen to the SDO requests to our node id (the one of our heartbeat).
+ * The frames are received raw as the segments can't be decoded into SDO_FRAME.
+ */
+void SdoServer::setup()
+{
+    if (nodeId != 0) {
+        canHandler->detach(this, 0x600 + nodeId, 0x7ff);
+    }
+    nodeId = canHandler->getMasterID();
+    state = STATE_IDLE;
+    canHandler->attach(this, 0x600 + nodeId, 0x7ff, false);
+    Logger::info("SDO server on node %d", nodeId);
+}
+
+void SdoServer::handleCanFrame(const CAN_FRAME *frame)
+{
+    if (frame->length < 8) {
+        return;
+    }
+    const uint8_t *request = frame->data.bytes;
+
+    if (state != STATE_IDLE && micros() - timer > CFG_SDO_TIMEOUT) {
+        state = STATE_IDLE; // the client gave up, a new transfer may start with this request
+    }
+
+    switch (request[0] >> 5) { // client command specifier
+    case 0:
+        downloadSegment(request);
+        break;
+    case 1:
+        initiateDownload(request);
+        break;
+    case 2:
+        initiateUpload(request);
+        break;
+    case 3:
+        uploadSegment(request);
+        break;
+    case 4: // abort by the client
+        state = STATE_IDLE;
+        break;
+    default: // block transfers are not supported, the client falls back to segmented transfers
+        state = STATE_IDLE;
+        sendAbort(request[1] | (request[2] << 8), request[3], SDO_ABORT_COMMAND);
+        break;
+    }
+}
+
+/*
+ * Start a write. Values up to 4 bytes are contained in the request (expedited),
+ * longer ones are announced with their size and follow in segments.
+ */
+void SdoServer::initiateDownload(const uint8_t *request)
+{
+    uint16_t index = request[1] | (request[2] << 8);
+    uint8_t subIndex = request[3];
+    uint32_t abortCode = 0;
+
+    state = STATE_IDLE;
+    const Object *target = findObject(index, subIndex, abortCode);
+    if (target != NULL && !target->writable) {
+        abortCode = SDO_ABORT_READ_ONLY;
+    }
+    if (abortCode != 0) {
+        sendAbort(index, subIndex, abortCode);
+        return;
+    }
+
+    uint8_t size = objectSize(target);
+    if (request[0] & 0x02) { // expedited
+        if (size > 4 || ((request[0] & 0x01) && size != 4 - ((request[0] >> 2) & 0x03))) {
+            sendAbort(index, subIndex, SDO_ABORT_LENGTH);
+            return;
+        }
+        if (!writeObject(target, request + 4, size, abortCode)) {
+            sendAbort(index, subIndex, abortCode);
+            return;
+        }
+    } else {
+        uint32_t announced = request[4] | (request[5] << 8) | (request[6] << 16) | ((uint32_t) request[7] << 24);
+        if (!(request[0] & 0x01) || announced != size || size > CFG_SDO_SERVER_BUFFER_SIZE) {
+            sendAbort(index, subIndex, SDO_ABORT_LENGTH);
+            return;
+        }
+        object = target;
+        length = size;
+        offset = 0;
+        toggle = 0;
+        timer = micros();
+        state = STATE_DOWNLOAD;
+    }
+
+    uint8_t response[8] = { 0x60, request[1], request[2], request[3], 0, 0, 0, 0 };
+    sendResponse(response);
+}
+
+void SdoServer::downloadSegment(const uint8_t *request)
+{
+    if (state != STATE_DOWNLOAD) {
+        sendAbort(0, 0, SDO_ABORT_COMMAND);
+        return;
+    }
+    if ((request[0] & 0x10) != toggle) {
+        state = STATE_IDLE;
+        sendAbort(object->index, object->subIndex, SDO_ABORT_TOGGLE);
+        return;
+    }
+
+    uint8_t count = 7 - ((request[0] >> 1) & 0x07);
+    bool last = (request[0] & 0x01);
+    if (offset + count > length || (last && offset + count != length)) {
+        state = STATE_IDLE;
+        sendAbort(object->index, object->subIndex, SDO_ABORT_LENGTH);
+        return;
+    }
+    memcpy(buffer + offset, request + 1, count);
+    offset += count;
+    timer = micros();
+
+    if (last) {
+        uint32_t abortCode;
+        state = STATE_IDLE;
+        if (!writeObject(object, buffer, length, abortCode)) {
+            sendAbort(object->index, object->subIndex, abortCode);
+            return;
+        }
+    }
+    uint8_t response[8] = { (uint8_t) (0x20 | toggle), 0, 0, 0, 0, 0, 0, 0 };
+    sendResponse(response);
+    toggle ^= 0x10;
+}
+
+/*
+ * Start a read. The value is taken from the configuration in RAM, values up
+ * to 4 bytes are sent in the response, longer ones are buffered and sent in segments.
+ */
+void SdoServer::initiateUpload(const uint8_t *request)
+{
+    uint16_t index = request[1] | (request[2] << 8);
+    uint8_t subIndex = request[3];
+    uint32_t abortCode = 0;
+
+    state = STATE_IDLE;
+    const Object *target = findObject(index, subIndex, abortCode);
+    int16_t size = (target == NULL ? -1 : readObject(target, buffer, abortCode));
+    if (size < 0) {
+        sendAbort(index, subIndex, abortCode);
+        return;
+    }
+
+    uint8_t response[8] = { 0, request[1], request[2], request[3], 0, 0, 0, 0 };
+    if (size <= 4 && size > 0) {
+        response[0] = 0x43 | ((4 - size) << 2);
+        memcpy(response + 4, buffer, size);
+    } else {
+        response[0] = 0x41;
+        response[4] = size;
+        object = target;
+        length = size;
+        offset = 0;
+        toggle = 0;
+        timer = micros();
+        state = STATE_UPLOAD;
+    }
+    sendResponse(response);
+}
+
+void SdoServer::uploadSegment(const uint8_t *request)
+{
+    if (state != STATE_UPLOAD) {
+        sendAbort(0, 0, SDO_ABORT_COMMAND);
+        return;
+    }
+    if ((request[0] & 0x10) != toggle) {
+        state = STATE_IDLE;
+        sendAbort(object->index, object->subIndex, SDO_ABORT_TOGGLE);
+        return;
+    }
+
+    uint8_t count = min(length - offset, 7);
+    uint8_t response[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    response[0] = toggle | ((7 - count) << 1);
+    memcpy(response + 1, buffer + offset, count);
+    offset += count;
+    if (offset == length) {
+        response[0] |= 0x01;
+        state = STATE_IDLE;
+    }
+    timer = micros();
+    toggle ^= 0x10;
+    sendResponse(response);
+}
+
+/*
+ * Look up an object. The table is short, so a linear search is sufficient.
+ */
+const SdoServer::Object *SdoServer::findObject(uint16_t index, uint8_t subIndex, uint32_t &abortCode)
+{
+    bool indexFound = false;
+
+    for (uint8_t i = 0; i < SDO_NUM_OBJECTS; i++) {
+        if (objects[i].index == index) {
+            if (objects[i].subIndex == subIndex) {
+                return &objects[i];
+            }
+            indexFound = true;
+        }
+    }
+    abortCode = (indexFound ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT);
+    return NULL;
+}
+
+/*
+ * Size of the value of an object in bytes (for strings the current length).
+ */
+uint8_t SdoServer::objectSize(const Object *object)
+{
+    switch (object->type) {
+    case TYPE_UINT8:
+        return 1;
+    case TYPE_INT16:
+    case TYPE_UINT16:
+        return 2;
+    case TYPE_UINT32:
+        return 4;
+    case TYPE_STRING:
+        return strlen(object->parameter == PARAM_DEVICE_NAME ? "GEVCU" : CFG_VERSION);
+    case TYPE_BLOCK: {
+        uint8_t size = 0;
+        for (uint8_t i = 0; i < SDO_NUM_OBJECTS; i++) {
+            if (objects[i].index == object->index - SDO_BLOCK_OFFSET && objects[i].subIndex > 0) {
+                size += objectSize(&objects[i]);
+            }
+        }
+        return size;
+    }
+    }
+    return 0;
+}
+
+uint8_t SdoServer::countParameters(uint16_t record)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < SDO_NUM_OBJECTS; i++) {
+        if (objects[i].index == record && objects[i].subIndex > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Find the configuration value of a parameter and the device which stores it.
+ * Returns NULL if the device is not present (or doesn't have the parameter,
+ * e.g. the ADC settings of a CAN throttle).
+ */
+void *SdoServer::findParameter(uint8_t parameter, Device *&device)
+{
+    Throttle *accelerator = deviceManager.getAccelerator();
+    Throttle *brake = deviceManager.getBrake();
+    MotorController *motorController = deviceManager.getMotorController();
+
+    if (parameter >= ACC_NUMBER_POTS && parameter <= ACC_ADC_PIN2) {
+        if (accelerator == NULL) {
+            return NULL;
+        }
+        device = accelerator;
+        ThrottleConfiguration *config = (ThrottleConfiguration *) accelerator->getConfiguration();
+        PotThrottleConfiguration *potConfig = (accelerator->getId() == POTACCELPEDAL ? (PotThrottleConfiguration *) config : NULL);
+
+        switch (parameter) {
+        case ACC_REGEN_MAX_POSITION:
+            return &config->positionRegenMaximum;
+        case ACC_REGEN_MIN_POSITION:
+            return &config->positionRegenMinimum;
+        case ACC_FORWARD_POSITION:
+            return &config->positionForwardMotionStart;
+        case ACC_HALF_POWER_POSITION:
+            return &config->positionHalfPower;
+        case ACC_MIN_REGEN:
+            return &config->minimumRegen;
+        case ACC_MAX_REGEN:
+            return &config->maximumRegen;
+        case ACC_CREEP:
+            return &config->creep;
+        }
+        if (potConfig == NULL) {
+            return NULL;
+        }
+        switch (parameter) {
+        case ACC_NUMBER_POTS:
+            return &potConfig->numberPotMeters;
+        case ACC_SUB_TYPE:
+            return &potConfig->throttleSubType;
+        case ACC_MIN_LEVEL1:
+            return &potConfig->minimumLevel1;
+        case ACC_MAX_LEVEL1:
+            return &potConfig->maximumLevel1;
+        case ACC_MIN_LEVEL2:
+            return &potConfig->minimumLevel2;
+        case ACC_MAX_LEVEL2:
+            return &potConfig->maximumLevel2;
+        case ACC_ADC_PIN1:
+            return &potConfig->AdcPin1;
+        case ACC_ADC_PIN2:
+            return &potConfig->AdcPin2;
+        }
+        return NULL;
+    }
+
+    if (parameter >= BRAKE_MIN_LEVEL && parameter <= BRAKE_ADC_PIN) {
+        if (brake == NULL) {
+            return NULL;
+        }
+        device = brake;
+        ThrottleConfiguration *config = (ThrottleConfiguration *) brake->getConfiguration();
+        PotThrottleConfiguration *potConfig = (brake->getId() == POTBRAKEPEDAL ? (PotThrottleConfiguration *) config : NULL);
+
+        switch (parameter) {
+        case BRAKE_MIN_REGEN:
+            return &config->minimumRegen;
+        case BRAKE_MAX_REGEN:
+            return &config->maximumRegen;
+        }
+        if (potConfig == NULL) {
+            return NULL;
+        }
+        switch (parameter) {
+        case BRAKE_MIN_LEVEL:
+            return &potConfig->minimumLevel1;
+        case BRAKE_MAX_LEVEL:
+            return &potConfig->maximumLevel1;
+        case BRAKE_ADC_PIN:
+            return &potConfig->AdcPin1;
+        }
+        return NULL;
+    }
+
+    if (parameter >= MC_SPEED_MAX && parameter <= MC_SPEED_SLEW_RATE) {
+        if (motorController == NULL) {
+            return NULL;
+        }
+        device = motorController;
+        MotorControllerConfiguration *config = (MotorControllerConfiguration *) motorController->getConfiguration();
+
+        switch (parameter) {
+        case MC_SPEED_MAX:
+            return &config->speedMax;
+        case MC_TORQUE_MAX:
+            return &config->torqueMax;
+        case MC_REVERSE_PERCENT:
+            return &config->reversePercent;
+        case MC_PRECHARGE_CAPACITANCE:
+            return &config->kilowattHrs;
+        case MC_PRECHARGE_DELAY:
+            return &config->prechargeR;
+        case MC_NOMINAL_VOLT:
+            return &config->nominalVolt;
+        case MC_PRECHARGE_RELAY:
+            return &config->prechargeRelay;
+        case MC_MAIN_CONTACTOR_RELAY:
+            return &config->mainContactorRelay;
+        case MC_BRAKE_LIGHT:
+            return &config->brakeLight;
+        case MC_REVERSE_LIGHT:
+            return &config->revLight;
+        case MC_ENABLE_IN:
+            return &config->enableIn;
+        case MC_REVERSE_IN:
+            return &config->reverseIn;
+        case MC_REGEN_TAPER_LOWER:
+            return &config->regenTaperLower;
+        case MC_REGEN_TAPER_UPPER:
+            return &config->regenTaperUpper;
+        case MC_TORQUE_SLEW_RATE:
+            return &config->torqueSlewRate;
+        case MC_SPEED_SLEW_RATE:
+            return &config->speedSlewRate;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Copy the value of an object (little endian) into data.
+ *
+ * \retval the number of bytes or -1 if the value is not available (abortCode is set)
+ */
+int16_t SdoServer::readObject(const Object *object, uint8_t *data, uint32_t &abortCode)
+{
+    Device *device = NULL;
+    void *value;
+
+    switch (object->type) {
+    case TYPE_STRING: {
+        uint8_t size = objectSize(object);
+        memcpy(data, (object->parameter == PARAM_DEVICE_NAME ? "GEVCU" : CFG_VERSION), size);
+        return size;
+    }
+    case TYPE_BLOCK: { // parameters the device doesn't have are sent as 0
+        uint8_t size = 0;
+        bool available = false;
+        for (uint8_t i = 0; i < SDO_NUM_OBJECTS; i++) {
+            if (objects[i].index == object->index - SDO_BLOCK_OFFSET && objects[i].subIndex > 0) {
+                uint8_t count = objectSize(&objects[i]);
+                if (readObject(&objects[i], data + size, abortCode) < 0) {
+                    memset(data + size, 0, count);
+                } else {
+                    available = true;
+                }
+                size += count;
+            }
+        }
+        if (!available) {
+            abortCode = SDO_ABORT_NO_DATA;
+            return -1;
+        }
+        return size;
+    }
+    case TYPE_UINT32: // only the device type
+        memset(data, 0, 4);
+        return 4;
+    }
+
+    if (object->parameter == PARAM_COUNT) {
+        data[0] = countParameters(object->index);
+        return 1;
+    }
+    value = findParameter(object->parameter, device);
+    if (value == NULL) {
+        abortCode = SDO_ABORT_NO_DATA;
+        return -1;
+    }
+    uint8_t size = objectSize(object);
+    memcpy(data, value, size); // the Due is little endian, like CANopen
+    return size;
+}
+
+/*
+ * Check that a value can be written to a parameter: the device must be present
+ * and the value within the parameter's range.
+ */
+bool SdoServer::checkValue(const Object *object, const uint8_t *data, uint32_t &abortCode)
+{
+    Device *device = NULL;
+    int32_t value;
+
+    if (findParameter(object->parameter, device) == NULL) {
+        abortCode = SDO_ABORT_NO_DATA;
+        return false;
+    }
+    switch (object->type) {
+    case TYPE_UINT8:
+        value = data[0];
+        break;
+    case TYPE_INT16:
+        value = (int16_t) (data[0] | (data[1] << 8));
+        break;
+    default:
+        value = data[0] | (data[1] << 8);
+        break;
+    }
+    if (value < object->minimum || value > object->maximum) {
+        abortCode = SDO_ABORT_RANGE;
+        return false;
+    }
+    return true;
+}
+
+void SdoServer::storeValue(const Object *object, const uint8_t *data, Device *&device)
+{
+    void *value = findParameter(object->parameter, device);
+    if (value != NULL) {
+        memcpy(value, data, objectSize(object));
+    }
+}
+
+/*
+ * Write a parameter or all parameters of a record (block object) and store
+ * them in the EEPROM. A block is only written if all of its values are valid,
+ * the values of parameters which the device doesn't have are ignored.
+ */
+bool SdoServer::writeObject(const Object *object, const uint8_t *data, uint8_t size, uint32_t &abortCode)
+{
+    Device *device = NULL;
+
+    if (size != objectSize(object)) {
+        abortCode = SDO_ABORT_LENGTH;
+        return false;
+    }
+    if (object->type == TYPE_BLOCK) {
+        uint16_t record = object->index - SDO_BLOCK_OFFSET;
+        uint8_t position = 0;
+        for (uint8_t i = 0; i < SDO_NUM_OBJECTS; i++) {
+            if (objects[i].index == record && objects[i].subIndex > 0) {
+                if (!checkValue(&objects[i], data + position, abortCode) && abortCode != SDO_ABORT_NO_DATA) {
+                    return false;
+                }
+                position += objectSize(&objects[i]);
+            }
+        }
+        position = 0;
+        for (uint8_t i = 0; i < SDO_NUM_OBJECTS; i++) {
+            if (objects[i].index == record && objects[i].subIndex > 0) {
+                storeValue(&objects[i], data + position, device);
+                position += objectSize(&objects[i]);
+            }
+        }
+    } else {
+        if (!checkValue(object, data, abortCode)) {
+            return false;
+        }
+        storeValue(object, data, device);
+    }
+    if (device == NULL) {
+        abortCode = SDO_ABORT_NO_DATA;
+        return false;
+    }
+    device->saveConfiguration();
+    Logger::info("SDO server: %X.%d written", object->index, object->subIndex);
+    return true;
+}
+
+void SdoServer::sendAbort(uint16_t index, uint8_t subIndex, uint32_t abortCode)
+{
+    uint8_t response[8] = { 0x80, (uint8_t) (index & 0xFF), (uint8_t) (index >> 8), subIndex,
+            (uint8_t) (abortCode & 0xFF), (uint8_t) (abortCode >> 8), (uint8_t) (abortCode >> 16), (uint8_t) (abortCode >> 24) };
+    sendResponse(response);
+}
+
+void SdoServer::sendResponse(const uint8_t *data)
+{
+    CAN_FRAME frame;
+    canHandler->prepareOutputFrame(&frame, 0x580 + nodeId);
+    memcpy(frame.data.bytes, data, 8);
+    canHandler->sendFrame(frame);
+}
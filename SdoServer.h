@@ -0,0 +1,128 @@
+/*
+ * SdoServer.h
+ *
+ * CANopen SDO server on the EV bus. It exposes the EEPROM-backed parameters of
+ * the accelerator, the brake and the motor controller as an object dictionary,
+ * so end-of-line tools can commission a car over CAN instead of the serial console.
+ *
+ * Object dictionary (node id = the GEVCU's CANopen master id):
+ *   0x1000      device type (u32, read only)
+ *   0x1008      device name (string, read only)
+ *   0x100A      software version (string, read only)
+ *   0x2000 x    accelerator parameters (see objects[] in SdoServer.cpp)
+ *   0x2001 x    brake parameters
+ *   0x2002 x    motor controller parameters
+ *   0x2100-2102 all parameters of 0x2000-0x2002 as one block (domain, the values
+ *               packed little endian in the order of their sub-indices)
+ * Sub-index 0 of 0x2000-0x2002 holds the number of parameters.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef SDO_SERVER_H_
+#define SDO_SERVER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "CanHandler.h"
+#include "SdoClient.h"
+#include "DeviceManager.h"
+#include "Logger.h"
+
+// additional CANopen SDO abort codes used by the server
+#define SDO_ABORT_READ_ONLY     0x06010002 // attempt to write a read only object
+#define SDO_ABORT_NO_OBJECT     0x06020000 // object does not exist in the object dictionary
+#define SDO_ABORT_LENGTH        0x06070010 // data type does not match, length of service parameter does not match
+#define SDO_ABORT_NO_SUBINDEX   0x06090011 // sub-index does not exist
+#define SDO_ABORT_RANGE         0x06090030 // invalid value for parameter
+#define SDO_ABORT_NO_DATA       0x08000024 // no data available (the device is not present)
+
+#define SDO_RECORD_ACCELERATOR  0x2000
+#define SDO_RECORD_BRAKE        0x2001
+#define SDO_RECORD_MOTOR        0x2002
+#define SDO_BLOCK_OFFSET        0x0100 // index of the block object of a parameter record
+
+class SdoServer : public CanObserver {
+public:
+    enum ObjectType {
+        TYPE_UINT8,
+        TYPE_INT16,
+        TYPE_UINT16,
+        TYPE_UINT32,
+        TYPE_STRING,
+        TYPE_BLOCK
+    };
+
+    /*
+     * Entry of the object dictionary. The table lives in flash.
+     */
+    struct Object {
+        uint16_t index;
+        uint8_t subIndex;
+        uint8_t type;           // ObjectType
+        uint8_t parameter;      // the value which is mapped (see SdoParameter, not used by TYPE_BLOCK)
+        bool writable;
+        int32_t minimum;
+        int32_t maximum;
+    };
+
+    SdoServer(CanHandler *canHandler);
+    void setup();
+    void handleCanFrame(const CAN_FRAME *frame);
+
+private:
+    enum State {
+        STATE_IDLE,
+        STATE_DOWNLOAD,         // receiving the segments of a write
+        STATE_UPLOAD            // sending the segments of a read
+    };
+
+    CanHandler *canHandler;
+    uint8_t nodeId;
+    State state;
+    const Object *object;       // object of the segmented transfer in progress
+    uint8_t buffer[CFG_SDO_SERVER_BUFFER_SIZE]; // value of the object which is transferred
+    uint8_t length;             // bytes in buffer (upload) or expected bytes (download)
+    uint8_t offset;             // next byte to send / store
+    uint8_t toggle;
+    uint32_t timer;             // micros() of the last request of the segmented transfer
+
+    const Object *findObject(uint16_t index, uint8_t subIndex, uint32_t &abortCode);
+    uint8_t objectSize(const Object *object);
+    uint8_t countParameters(uint16_t record);
+    void *findParameter(uint8_t parameter, Device *&device);
+    int16_t readObject(const Object *object, uint8_t *data, uint32_t &abortCode);
+    bool writeObject(const Object *object, const uint8_t *data, uint8_t size, uint32_t &abortCode);
+    bool checkValue(const Object *object, const uint8_t *data, uint32_t &abortCode);
+    void storeValue(const Object *object, const uint8_t *data, Device *&device);
+    void initiateDownload(const uint8_t *request);
+    void downloadSegment(const uint8_t *request);
+    void initiateUpload(const uint8_t *request);
+    void uploadSegment(const uint8_t *request);
+    void sendAbort(uint16_t index, uint8_t subIndex, uint32_t abortCode);
+    void sendResponse(const uint8_t *data);
+};
+
+extern SdoServer sdoServer;
+
+#endif /* SDO_SERVER_H_ */
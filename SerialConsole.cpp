@@ -81,8 +81,17 @@ void SerialConsole::printMenu() {
    SerialUSB<<"GENERAL SYSTEM CONFIGURATION\n\n";
     SerialUSB.println("   E = dump system EEPROM values");
     SerialUSB.println("   h = help (displays this message)");
+    SerialUSB.println("   T = show TickHandler statistics and CPU load");
+    SerialUSB.println("   t = reset TickHandler and loop statistics");
+    SerialUSB.println("   C = show CAN bus receive and transmit statistics");
+    SerialUSB.println("   c = reset CAN bus receive and transmit statistics");
+    SerialUSB.println("   I = show CAN bus load, error counters and statistics per received id");
+    SerialUSB.println("   R = record a binary trace of all inputs to this port (send any character to stop)");
   
     Logger::console("   LOGLEVEL=%i - set log level (0=debug, 1=info, 2=warn, 3=error, 4=off)", Logger::getLogLevel());
+    SerialUSB.println("   GWRULE=bus,id,mask[,newid[,interval[,bytemap]]] - forward frames from bus 0 (EV) or 1 (car) to the other bus");
+    SerialUSB.println("      (interval in ms, bytemap e.g. 76543210 or 01xx: source byte per output byte, x = 0), GWRULE=clear removes all rules");
+    SerialUSB.println("   GVRETFILTER=id,mask - only stream matching frames to SavvyCAN (GVRETFILTER=0 streams all frames)");
 
    SerialUSB<<"\nDEVICE SELECTION AND ACTIVATION\n\n";
    SerialUSB.println("     a = Re-setup Adafruit BLE");
@@ -90,6 +99,7 @@ void SerialConsole::printMenu() {
    SerialUSB.println("     Q = Reinitialize device table");
    SerialUSB.println("     S = show possible device IDs");
    Logger::console("     NUKE=1 - Resets all device settings in EEPROM. You have been warned.");
+   Logger::console("     TICKINT=<device id>,<us> - override the tick interval of a device (0 = default, after power cycle)");
 
    deviceManager.printDeviceList();
     
@@ -210,6 +220,10 @@ void SerialConsole::printMenu() {
     Logger::console("   ADCPACKCOFF=%i - set pack current offset", val);
     sysPrefs->read(EESYS_ADC_PACKC_GAIN, &val);
     Logger::console("   ADCPACKCGAIN=%i - set pack current gain (1024 is 1 gain)", val);
+    sysPrefs->read(EESYS_CAN0_BAUD, &val);
+    Logger::console("   CAN0BAUD=%i - set CAN0 (EV) bit rate in kbit/s (0 = disabled, max %i)", val, CAN_MAX_SPEED_KBPS);
+    sysPrefs->read(EESYS_CAN1_BAUD, &val);
+    Logger::console("   CAN1BAUD=%i - set CAN1 (car) bit rate in kbit/s (0 = disabled, max %i)", val, CAN_MAX_SPEED_KBPS);
 
     
 
@@ -232,10 +246,28 @@ void SerialConsole::printMenu() {
  */
 void SerialConsole::serialEvent() {
     int incoming;
+
+    if (gvretStreamer.isActive()) { // binary mode, all input belongs to the streamer
+        while ((incoming = SerialUSB.read()) != -1) {
+            gvretStreamer.handleByte(incoming);
+        }
+        return;
+    }
+
     incoming = SerialUSB.read();
     if (incoming == -1) { //false alarm....
         return;
     }
+    if (traceRecorder.isRecording()) { // any input (except the line end of the command) ends the recording
+        if (incoming != 10 && incoming != 13) {
+            traceRecorder.stop();
+        }
+        return;
+    }
+    if (incoming == GVRET_START_BINARY && ptrBuffer == 0) { // SavvyCAN connects
+        gvretStreamer.start();
+        return;
+    }
 
     if (incoming == 10 || incoming == 13) { //command done. Parse it.
         handleConsoleCmd();
@@ -465,6 +497,15 @@ void SerialConsole::handleConfigCmd() {
         else {
             Logger::console("Invalid device ID (%X, %d)", newValue, newValue);
         }
+    } else if (cmdString == String("TICKINT")) {
+        char *separator = strchr((char *) (cmdBuffer + i), ',');
+        uint32_t interval = (separator ? strtoul(separator + 1, NULL, 0) : 0);
+        Device *device = deviceManager.getDeviceByID((DeviceId) newValue);
+        if (device && separator && (interval == 0 || (interval >= CFG_TIMER_BASE_INTERVAL && interval <= 10000000))) {
+            device->setTickIntervalOverride(interval);
+            Logger::console("Tick interval of %s set to %lus", device->getCommonName(), interval);
+        }
+        else Logger::console("Invalid device ID or interval. Enter TICKINT=<device id>,<0 or %d-10000000>", CFG_TIMER_BASE_INTERVAL);
     } else if (cmdString == String("SYSTYPE")) {
         if (newValue < 7 && newValue > 0) {
             sysPrefs->write(EESYS_SYSTEM_TYPE, (uint8_t)(newValue));
@@ -663,6 +704,70 @@ void SerialConsole::handleConfigCmd() {
 
 
 
+    } else if (cmdString == String("GWRULE")) {
+        char *next = (char *) (cmdBuffer + i);
+        uint8_t source = strtoul(next, &next, 0);
+        CanHandler::GatewayRule rule;
+        rule.newId = CAN_GATEWAY_KEEP_ID;
+        rule.minInterval = 0;
+        rule.remap = false;
+        rule.priority = CAN_TX_PRIORITY_NORMAL;
+        if (*next != ',') {
+            canHandlerEv.clearGatewayRules();
+            canHandlerCar.clearGatewayRules();
+            Logger::console("All gateway rules removed");
+        } else {
+            rule.id = strtoul(next + 1, &next, 0);
+            rule.mask = (*next == ',' ? strtoul(next + 1, &next, 0) : CAN_EXT_ID_MASK);
+            rule.extended = (rule.id > CAN_STD_ID_MASK);
+            if (*next == ',') {
+                rule.newId = strtoul(next + 1, &next, 0);
+            }
+            if (*next == ',') {
+                rule.minInterval = strtoul(next + 1, &next, 0) * 1000;
+            }
+            if (*next == ',') {
+                next++;
+                rule.remap = true;
+                for (int j = 0; j < 8; j++) {
+                    char c = *next;
+                    rule.byteMap[j] = (c >= '0' && c <= '7' ? c - '0' : CAN_GATEWAY_ZERO_BYTE);
+                    if (c != 0) {
+                        next++;
+                    }
+                }
+            }
+            if ((source == 0 ? canHandlerEv : canHandlerCar).addGatewayRule(rule) != -1) {
+                Logger::console("Forwarding id %X, mask %X from CAN%d to CAN%d", rule.id, rule.mask, (source == 0 ? 0 : 1), (source == 0 ? 1 : 0));
+            }
+        }
+        updateWifi = false;
+    } else if (cmdString == String("GVRETFILTER")) {
+        char *next;
+        uint32_t id = strtoul((char *) (cmdBuffer + i), &next, 0);
+        if (*next == ',') {
+            uint32_t mask = strtoul(next + 1, NULL, 0);
+            if (gvretStreamer.addFilter(id, mask)) {
+                Logger::console("Streaming frames with id %X, mask %X to SavvyCAN", id, mask);
+            } else {
+                Logger::console("All %i GVRET filters are in use, use GVRETFILTER=0 to clear them", CFG_GVRET_NUM_FILTERS);
+            }
+        } else {
+            gvretStreamer.clearFilters();
+            Logger::console("Streaming all frames to SavvyCAN");
+        }
+        updateWifi = false;
+    } else if (cmdString == String("CAN0BAUD") || cmdString == String("CAN1BAUD")) {
+        bool ev = (cmdString == String("CAN0BAUD"));
+        if (newValue >= 0 && newValue <= CAN_MAX_SPEED_KBPS) {
+            sysPrefs->write(ev ? EESYS_CAN0_BAUD : EESYS_CAN1_BAUD, (uint16_t)(newValue));
+            sysPrefs->saveChecksum();
+            sysPrefs->forceCacheWrite();
+            Logger::console("Setting CAN%i bit rate to %ik", (ev ? 0 : 1), newValue);
+            (ev ? canHandlerEv : canHandlerCar).setup(); //change takes immediate effect
+        }
+        else Logger::console("Invalid bit rate. Enter value from 0 (disabled) to %i (kbit/s)", CAN_MAX_SPEED_KBPS);
+        updateWifi = false;
     } else if (cmdString == String("NUKE")) {
         if (newValue == 1)
         {   //write zero to the checksum location of every device in the table.
@@ -715,6 +820,41 @@ void SerialConsole::handleShortCmd() {
             Logger::console("%d: %d", i, val);
         }
         break;
+    case 'T':
+        printTickStatistics();
+        break;
+    case 't':
+        tickHandler.resetStatistics();
+        loadMonitor.resetStatistics();
+#ifdef CFG_TIMER_USE_QUEUING
+        tickHandler.resetQueueStatistics();
+#endif
+        Logger::console("TickHandler statistics reset");
+        break;
+    case 'C':
+        printCanStatistics();
+        break;
+    case 'c':
+        canHandlerEv.resetRxStatistics();
+        canHandlerCar.resetRxStatistics();
+        canHandlerEv.resetTxStatistics();
+        canHandlerCar.resetTxStatistics();
+        canHandlerEv.resetCyclicStatistics();
+        canHandlerCar.resetCyclicStatistics();
+        canHandlerEv.resetBusStatistics();
+        canHandlerCar.resetBusStatistics();
+        canHandlerEv.resetGatewayStatistics();
+        canHandlerCar.resetGatewayStatistics();
+        Logger::console("CAN statistics reset");
+        break;
+    case 'R':
+        Logger::console("recording trace, send any character to stop");
+        traceRecorder.start();
+        break;
+    case 'I':
+        printCanIdStatistics(&canHandlerEv, "CAN0 (EV)");
+        printCanIdStatistics(&canHandlerCar, "CAN1 (car)");
+        break;
     case 'K': //set all outputs high
         for (int tout = 0; tout < NUM_OUTPUT; tout++) systemIO.setDigitalOutput(tout, true);
         Logger::console("all outputs: ON");
@@ -789,7 +929,129 @@ void SerialConsole::handleShortCmd() {
     }
 }
 
+void SerialConsole::printTickStatistics() {
+    TickHandler::TickStatistics stats[20];
+    uint8_t count = tickHandler.getStatistics(stats, 20);
+
+    Logger::console("CPU load: %f%%, max loop time: %lus", loadMonitor.getCpuLoad() / 10.0f, loadMonitor.getMaxIterationTime());
+    Logger::console("Tick observer execution times (us):");
+    for (int i = 0; i < count; i++) {
+        Device *device = deviceManager.getDeviceByTickObserver(stats[i].observer);
+        if (device) {
+            SerialUSB.print(device->getCommonName());
+        } else if (stats[i].observer == heartbeat) {
+            SerialUSB.print("Heartbeat");
+        } else if (stats[i].observer == memCache) {
+            SerialUSB.print("MemCache");
+        } else {
+            SerialUSB.print("0x");
+            SerialUSB.print((uint32_t) stats[i].observer, HEX);
+        }
+        Logger::console(" - interval: %l, phase: %l, priority: %s, calls: %l, min: %f, avg: %f, max: %f, overruns: %l", stats[i].interval, stats[i].phase,
+                (stats[i].priority == TICK_PRIORITY_CONTROL ? "control" : stats[i].priority == TICK_PRIORITY_IO ? "I/O" :
+                 stats[i].priority == TICK_PRIORITY_BACKGROUND ? "background" : "interrupt"), stats[i].calls,
+                (float) stats[i].minTime / TICK_PROFILE_UNITS_PER_US, (float) stats[i].avgTime / TICK_PROFILE_UNITS_PER_US,
+                (float) stats[i].maxTime / TICK_PROFILE_UNITS_PER_US, stats[i].overruns);
+        Logger::console("   jitter: avg: %f, max: %f", (float) stats[i].avgJitter / TICK_PROFILE_UNITS_PER_US,
+                (float) stats[i].maxJitter / TICK_PROFILE_UNITS_PER_US);
+    }
+
+    uint32_t periods = tickHandler.getLoadPeriods();
+    if (periods > 0) {
+        Logger::console("Load per base tick slot (average per period of %d slots):", CFG_TIMER_LOAD_SLOTS);
+        for (int i = 0; i < CFG_TIMER_LOAD_SLOTS; i++) {
+            Logger::console("   slot %d: %f us, %f ticks", i, (float) tickHandler.getSlotLoad(i) / periods, (float) tickHandler.getSlotCalls(i) / periods);
+        }
+    }
+#ifdef CFG_TIMER_USE_QUEUING
+    Logger::console("Tick queue: %l ticks coalesced, %l ticks lost to overflow, background deferred %l times", tickHandler.getCoalescedCount(),
+            tickHandler.getOverflowCount(), tickHandler.getDeferredCount());
+#else
+    Logger::console("Tick queuing is disabled (CFG_TIMER_USE_QUEUING)");
+#endif
+}
+
+void SerialConsole::printCanStatistics() {
+    Logger::console("CAN0 (EV) - received: %l, max waiting: %d, overruns: %l, mailboxes used: %d of %d", canHandlerEv.getRxFrameCount(),
+            canHandlerEv.getRxHighWater(), canHandlerEv.getRxOverrunCount(), canHandlerEv.getUsedMailboxes(), canHandlerEv.getNumRxMailboxes());
+    Logger::console("CAN1 (car) - received: %l, max waiting: %d, overruns: %l, mailboxes used: %d of %d", canHandlerCar.getRxFrameCount(),
+            canHandlerCar.getRxHighWater(), canHandlerCar.getRxOverrunCount(), canHandlerCar.getUsedMailboxes(), canHandlerCar.getNumRxMailboxes());
+    printCanTxStatistics(&canHandlerEv, "CAN0 (EV)");
+    printCanTxStatistics(&canHandlerCar, "CAN1 (car)");
+}
+
+void SerialConsole::printCanIdStatistics(CanHandler *canHandler, const char *name) {
+    CanHandler::BusStatistics bus;
+    canHandler->getBusStatistics(bus);
+
+    Logger::console("%s - load: %f%% (peak %f%%), tx/rx errors: %d/%d (max %d/%d), %s, bus-off: %l, error passive: %l", name,
+            (float) bus.load / 10.0f, (float) bus.peakLoad / 10.0f, bus.txErrors, bus.rxErrors, bus.maxTxErrors, bus.maxRxErrors,
+            (bus.busOff ? "BUS-OFF" : (bus.errorPassive ? "error passive" : "error active")), bus.busOffCount, bus.errorPassiveCount);
+
+    CanHandler::BitTiming timing;
+    if (canHandler->getBitTiming(timing)) {
+        Logger::console("%s - %l bit/s: %d tq of %d clocks (sync 1, prop %d, phase1 %d, phase2 %d, sjw %d), sample point %f%%%s", name,
+                timing.bitRate, timing.quanta, timing.prescaler, timing.propagation, timing.phase1, timing.phase2, timing.sjw,
+                (float) timing.samplePoint / 10.0f, (timing.tripleSample ? ", triple sampling" : ""));
+    } else {
+        Logger::console("%s - disabled", name);
+    }
+
+    CanHandler::IdStatistics stats[CFG_CAN_ID_STATS_SIZE];
+    uint8_t count = canHandler->getIdStatistics(stats, CFG_CAN_ID_STATS_SIZE);
+    Logger::console("        id   frames    rate/s   gap avg   gap max    jitter (us)  unchanged, untracked frames: %l", bus.untrackedFrames);
+    for (int i = 0; i < count; i++) {
+        SerialUSB.print(stats[i].extended ? "  " : "       ");
+        SerialUSB.print(stats[i].id, HEX);
+        printPadded(stats[i].count, 9);
+        if (stats[i].avgGap > 0) {
+            printPadded((uint32_t) (1000000.0f / stats[i].avgGap), 10);
+        } else {
+            printPadded(0, 10);
+        }
+        printPadded(stats[i].avgGap, 10);
+        printPadded(stats[i].maxGap, 10);
+        printPadded(stats[i].jitter, 10);
+        printPadded(stats[i].suppressed, 16);
+        SerialUSB.println();
+    }
+}
+
+/*
+ * Print a number right aligned in a column of the given width.
+ */
+void SerialConsole::printPadded(uint32_t value, uint8_t width) {
+    char buffer[12];
+    uint8_t length = snprintf(buffer, sizeof(buffer), "%lu", (unsigned long) value);
+    while (length++ < width) {
+        SerialUSB.print(' ');
+    }
+    SerialUSB.print(buffer);
+}
 
+void SerialConsole::printCanTxStatistics(CanHandler *canHandler, const char *name) {
+    CanHandler::TxStatistics stats[CAN_TX_STATS_SIZE];
+    uint8_t count = canHandler->getTxStatistics(stats, CAN_TX_STATS_SIZE);
 
+    Logger::console("%s transmit queue - max depth: %d, dropped: %l, queueing latency per id (us):", name, canHandler->getTxMaxDepth(),
+            canHandler->getTxDropCount());
+    for (int i = 0; i < count; i++) {
+        Logger::console("   id %X - sent: %l, avg: %l, max: %l", stats[i].id, stats[i].count, (uint32_t) (stats[i].totalLatency / stats[i].count),
+                stats[i].maxLatency);
+    }
 
+    CanHandler::CyclicStatistics cyclic[CFG_CAN_NUM_CYCLIC_MESSAGES];
+    count = canHandler->getCyclicStatistics(cyclic, CFG_CAN_NUM_CYCLIC_MESSAGES);
+    for (int i = 0; i < count; i++) {
+        Logger::console("   cyclic id %X - period: %l, sent: %l, jitter avg: %l, max: %l", cyclic[i].id, cyclic[i].period, cyclic[i].calls,
+                cyclic[i].avgJitter, cyclic[i].maxJitter);
+    }
 
+    CanHandler::GatewayStatistics gateway[CFG_CAN_GATEWAY_RULES];
+    count = canHandler->getGatewayStatistics(gateway, CFG_CAN_GATEWAY_RULES);
+    for (int i = 0; i < count; i++) {
+        Logger::console("   gateway id %X mask %X -> %X - forwarded: %l, rate limited: %l, dropped: %l, latency avg: %l, max: %l", gateway[i].id,
+                gateway[i].mask, (gateway[i].newId == CAN_GATEWAY_KEEP_ID ? gateway[i].id : gateway[i].newId), gateway[i].forwarded,
+                gateway[i].rateLimited, gateway[i].dropped, gateway[i].avgLatency, gateway[i].maxLatency);
+    }
+}
@@ -38,6 +38,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "MotorController.h"
 #include "DmocMotorController.h" //TODO: direct reference to dmoc must be removed
 #include "ThrottleDetector.h"
+#include "GvretStreamer.h"
+#include "InputTrace.h"
 
 class SerialConsole {
 public:
@@ -68,6 +70,11 @@ private:
     void handleConsoleCmd();
     void handleShortCmd();
     void handleConfigCmd();
+    void printTickStatistics();
+    void printCanStatistics();
+    void printCanTxStatistics(CanHandler *canHandler, const char *name);
+    void printCanIdStatistics(CanHandler *canHandler, const char *name);
+    void printPadded(uint32_t value, uint8_t width);
     void resetWiReachMini();
     void getResponse();
 };
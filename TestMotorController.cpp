@@ -49,7 +49,7 @@ void TestMotorController::setup() {
     setSelectedGear(DRIVE);
     setOpState(ENABLE);
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC), TICK_PRIORITY_CONTROL);
 }
 
 void TestMotorController::handleTick() {
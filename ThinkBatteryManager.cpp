@@ -43,14 +43,14 @@ void ThinkBatteryManager::setup() {
     BatteryManager::setup(); // run the parent class version of this function
 
     //Relevant BMS messages are 0x300 - 0x30F
-    canHandlerEv.attach(this, 0x300, 0x7f0, false);
+    canHandlerEv.attach(this, 0x300, 0x7f0, false, true); // the BMS repeats unchanged values, decode only the changes
 
-    tickHandler.attach(this, CFG_TICK_INTERVAL_BMS_THINK);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_BMS_THINK));
 }
 
 /*For all multibyte integers the format is MSB first, LSB last
 */
-void ThinkBatteryManager::handleCanFrame(CAN_FRAME *frame) {
+void ThinkBatteryManager::handleCanFrame(const CAN_FRAME *frame) {
     int temp;
     switch (frame->id) {
     case 0x300: //Start up message
@@ -3,10 +3,14 @@
  *
  * Class to which TickObserver objects can register to be triggered
  * on a certain interval.
- * TickObserver with the same interval are grouped to the same timer
- * and triggered in sequence per timer interrupt.
- *
- * NOTE: The initialize() method must be called before a observer is registered !
+ * Only one hardware timer is used. It fires every CFG_TIMER_BASE_INTERVAL
+ * microseconds and advances a hierarchical timer wheel which holds the
+ * absolute deadline of every registered observer. Inserting and expiring
+ * an observer is O(1) and as deadlines are advanced by the interval (and
+ * not re-calculated from the current time) they don't drift.
+ * Deadlines are aligned to multiples of the interval plus a phase offset which
+ * is chosen so that observers don't all fire in the same base tick.
+ * The execution time of every handleTick() call is profiled, see getStatistics().
  *
  Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
 
@@ -32,203 +36,616 @@
  */
 
 #include "TickHandler.h"
+#include "LoadMonitor.h"
 
 TickHandler::TickHandler() {
-    for (int i = 0; i < NUM_TIMERS; i++) {
-        timerEntry[i].interval = 0;
-        for (int j = 0; j < CFG_TIMER_NUM_OBSERVERS; j++) {
-            timerEntry[i].observer[j] = NULL;
-        }
+    for (int i = 0; i < TICK_WHEEL0_SIZE; i++) {
+        wheel0[i] = NULL;
+    }
+    for (int i = 0; i < TICK_WHEEL1_SIZE; i++) {
+        wheel1[i] = NULL;
     }
+    attachedEntries = NULL;
+    freeEntries = NULL;
+    currentTick = 0;
+    timerRunning = false;
+    for (int i = 0; i < CFG_TIMER_LOAD_SLOTS; i++) {
+        slotLoad[i] = 0;
+        slotCalls[i] = 0;
+    }
+    loadStartTick = 0;
 #ifdef CFG_TIMER_USE_QUEUING
-    bufferHead = bufferTail = 0;
+    for (int i = 0; i < TICK_NUM_PRIORITIES; i++) {
+        bufferHead[i] = bufferTail[i] = 0;
+    }
+    overflowCount = 0;
+    coalescedCount = 0;
+    deferredCount = 0;
+    dispatchMissedTicks = 0;
 #endif
 }
 
 /**
  * Register an observer to be triggered in a certain interval.
- * TickObservers with the same interval are grouped to one timer to save timers.
  * A TickObserver may be registered multiple times with different intervals.
  *
- * First a timer with the same interval is looked up. If none found, a free one is
- * used. Then a free TickObserver slot (of max CFG_MAX_TICK_OBSERVERS) is looked up. If all went
- * well, the timer is configured and (re)started.
- */
-void TickHandler::attach(TickObserver* observer, uint32_t interval) {
-    int timer = findTimer(interval);
-    if (timer == -1) {
-        timer = findTimer(0);	// no timer with given tick interval exist -> look for unused (interval == 0)
-        if (timer == -1) {
-            Logger::error("No free timer available for interval=%d", interval);
-            return;
-        }
-        timerEntry[timer].interval = interval;
+ * The interval (in microseconds) is rounded to a multiple of CFG_TIMER_BASE_INTERVAL.
+ * There is no limit on the number of observers per interval, entries are allocated
+ * on demand and re-used after a detach(). The hardware timer is started with the
+ * first registration.
+ * The priority class defines the order in which queued ticks are dispatched
+ * by process() (see TickPriority).
+ * The deadlines are at multiples of the interval plus the phase (in microseconds,
+ * rounded to base ticks). With TICK_PHASE_AUTO the phase with the fewest collisions
+ * with already attached observers is chosen, which spreads the load of observers
+ * with the same (or a related) interval evenly across the period.
+ */
+void TickHandler::attach(TickObserver* observer, uint32_t interval, TickPriority priority, uint32_t phase) {
+    uint32_t ticks = (interval + CFG_TIMER_BASE_INTERVAL / 2) / CFG_TIMER_BASE_INTERVAL;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    if (phase == TICK_PHASE_AUTO) {
+        phase = choosePhase(ticks);
+    } else {
+        phase = ((phase + CFG_TIMER_BASE_INTERVAL / 2) / CFG_TIMER_BASE_INTERVAL) % ticks;
     }
 
-    int observerIndex = findObserver(timer, 0);
-    if (observerIndex == -1) {
-        Logger::error("No free observer slot for timer %d with interval %d", timer, timerEntry[timer].interval);
+    TickEntry *entry = allocateEntry();
+    if (entry == NULL) {
+        Logger::error("Unable to allocate a tick entry for interval=%d", interval);
         return;
     }
-    timerEntry[timer].observer[observerIndex] = observer;
-    Logger::debug("attached TickObserver (%X) as number %d to timer %d, %dus interval", observer, observerIndex, timer, interval);
-
-    switch (timer) { // restarting a timer which would already be running is no problem (see DueTimer.cpp)
-    case 0:
-        Timer0.setPeriod(interval).attachInterrupt(timer0Interrupt).start();
-        break;
-    case 1:
-        Timer1.setPeriod(interval).attachInterrupt(timer1Interrupt).start();
-        break;
-    case 2:
-        Timer2.setPeriod(interval).attachInterrupt(timer2Interrupt).start();
-        break;
-    case 3:
-        Timer3.setPeriod(interval).attachInterrupt(timer3Interrupt).start();
-        break;
-    case 4:
-        Timer4.setPeriod(interval).attachInterrupt(timer4Interrupt).start();
-        break;
-    case 5:
-        Timer5.setPeriod(interval).attachInterrupt(timer5Interrupt).start();
-        break;
-    case 6:
-        Timer6.setPeriod(interval).attachInterrupt(timer6Interrupt).start();
-        break;
-    case 7:
-        Timer7.setPeriod(interval).attachInterrupt(timer7Interrupt).start();
-        break;
-    case 8:
-        Timer8.setPeriod(interval).attachInterrupt(timer8Interrupt).start();
-        break;
+
+    noInterrupts();
+    entry->observer = observer;
+    entry->interval = ticks;
+    entry->priority = priority;
+    uint32_t first = currentTick + 1;
+    entry->expires = first + (phase + ticks - first % ticks) % ticks; // first deadline which matches the phase
+    entry->nextAttached = attachedEntries;
+    attachedEntries = entry;
+    schedule(entry, currentTick);
+    interrupts();
+
+    Logger::debug("attached TickObserver (%X) with %dus interval (%d base ticks), phase %d, priority %d", observer, interval, ticks, phase, priority);
+
+    if (!timerRunning) {
+#if defined(__SAM3X8E__)
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // enable the DWT cycle counter for the profiler
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+        Timer0.setPeriod(CFG_TIMER_BASE_INTERVAL).attachInterrupt(timer0Interrupt).start();
+        timerRunning = true;
     }
 }
 
 /**
- * Remove an observer from all timers where it was registered.
+ * Remove an observer from all intervals where it was registered.
  */
 void TickHandler::detach(TickObserver* observer) {
-    for (int timer = 0; timer < NUM_TIMERS; timer++) {
-        for (int observerIndex = 0; observerIndex < CFG_TIMER_NUM_OBSERVERS; observerIndex++) {
-            if (timerEntry[timer].observer[observerIndex] == observer) {
-                Logger::debug("removing TickObserver (%X) as number %d from timer %d", observer, observerIndex, timer);
-                timerEntry[timer].observer[observerIndex] = NULL;
+    int removed = 0;
+    uint32_t primask = __get_PRIMASK(); // may be called from handleTick() when queuing is disabled
+    __disable_irq();
+
+    TickEntry **link = &attachedEntries;
+    while (*link != NULL) {
+        TickEntry *entry = *link;
+        if (entry->observer == observer) {
+            unschedule(entry);
+            *link = entry->nextAttached;
+            entry->observer = NULL;
+#ifdef CFG_TIMER_USE_QUEUING
+            if (!entry->pending) { // a queued entry is recycled by process() once it is taken from the queue
+                entry->nextAttached = freeEntries;
+                freeEntries = entry;
             }
+#else
+            entry->nextAttached = freeEntries;
+            freeEntries = entry;
+#endif
+            removed++;
+        } else {
+            link = &entry->nextAttached;
         }
     }
+
+    __set_PRIMASK(primask);
+
+    if (removed > 0) {
+        Logger::debug("removed TickObserver (%X) from %d interval(s)", observer, removed);
+    }
 }
 
-/**
- * Find a timer with a specified interval.
+/*
+ * Change the interval of all entries of an attached observer without detaching it
+ * (e.g. to run at a lower rate while idle). The phase is kept as far as possible
+ * (modulo the new interval) so observers which were staggered stay staggered when
+ * the intervals are multiples of each other. The next deadline is the first one
+ * on the new grid, so switching to a faster rate takes effect immediately.
+ * The profiler statistics are kept.
  */
-int TickHandler::findTimer(long interval) {
-    for (int i = 0; i < NUM_TIMERS; i++) {
-        if (timerEntry[i].interval == interval)
-            return i;
+void TickHandler::setInterval(TickObserver* observer, uint32_t interval) {
+    uint32_t ticks = (interval + CFG_TIMER_BASE_INTERVAL / 2) / CFG_TIMER_BASE_INTERVAL;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    uint32_t primask = __get_PRIMASK(); // may be called from handleTick() when queuing is disabled
+    __disable_irq();
+    for (TickEntry *entry = attachedEntries; entry != NULL; entry = entry->nextAttached) {
+        if (entry->observer == observer && entry->interval != ticks) {
+            uint32_t phase = (entry->expires % entry->interval) % ticks;
+            uint32_t first = currentTick + 1;
+            unschedule(entry);
+            entry->interval = ticks;
+            entry->expires = first + (phase + ticks - first % ticks) % ticks;
+            schedule(entry, currentTick);
+        }
     }
-    return -1;
+    __set_PRIMASK(primask);
 }
 
 /*
- * Find a TickObserver in the list of a specific timer.
+ * Return the number of base ticks (of CFG_TIMER_BASE_INTERVAL) which have elapsed
+ * since the timer was started.
  */
-int TickHandler::findObserver(int timer, TickObserver *observer) {
-    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
-        if (timerEntry[timer].observer[i] == observer)
-            return i;
+uint32_t TickHandler::getTickCount() {
+    return currentTick;
+}
+
+/*
+ * Find the phase (in base ticks) for a new entry with the given interval which
+ * collides with the fewest attached entries. Two entries with intervals a and b
+ * meet in the same base tick if their phases are equal modulo gcd(a, b).
+ * Among the phases with the fewest collisions, the one with the largest distance
+ * to the nearest deadline of another entry is taken.
+ * The list of entries is only modified from the main loop, so it is read with
+ * interrupts enabled (the phase of an entry doesn't change when the interrupt
+ * advances its deadline).
+ */
+uint32_t TickHandler::choosePhase(uint32_t interval) {
+    uint32_t bestPhase = 0, bestCollisions = 0xFFFFFFFF, bestDistance = 0;
+
+    for (uint32_t phase = 0; phase < interval; phase++) {
+        uint32_t collisions = 0, distance = 0xFFFFFFFF;
+
+        for (TickEntry *entry = attachedEntries; entry != NULL; entry = entry->nextAttached) {
+            uint32_t a = interval, b = entry->interval;
+            while (b != 0) {
+                uint32_t t = a % b;
+                a = b;
+                b = t;
+            }
+            uint32_t offset = (phase + a - entry->expires % a) % a; // a = gcd of both intervals
+            if (offset > a - offset) {
+                offset = a - offset;
+            }
+            if (offset == 0) {
+                collisions++;
+            }
+            if (offset < distance) {
+                distance = offset;
+            }
+        }
+        if (collisions < bestCollisions || (collisions == bestCollisions && distance > bestDistance)) {
+            bestPhase = phase;
+            bestCollisions = collisions;
+            bestDistance = distance;
+        }
     }
-    return -1;
+    return bestPhase;
 }
 
+/*
+ * Take an entry from the list of free entries or allocate a new one.
+ */
+TickHandler::TickEntry *TickHandler::allocateEntry() {
+    TickEntry *entry;
+
+    noInterrupts();
+    entry = freeEntries;
+    if (entry != NULL) {
+        freeEntries = entry->nextAttached;
+    }
+    interrupts();
+
+    if (entry == NULL) {
+        entry = new TickEntry();
+    }
+    if (entry != NULL) {
+        entry->next = NULL;
+        entry->pprev = NULL;
+        entry->nextAttached = NULL;
+        clearStatistics(entry);
 #ifdef CFG_TIMER_USE_QUEUING
+        entry->pending = false;
+        entry->missedTicks = 0;
+#endif
+    }
+    return entry;
+}
+
 /*
- * Check if a tick is available, forward it to registered observers.
+ * Copy the execution time statistics of all attached entries to the provided array.
+ * Returns the number of entries which were copied.
  */
-void TickHandler::process() {
-    while (bufferHead != bufferTail) {
-        tickBuffer[bufferTail]->handleTick();
-        bufferTail = (bufferTail + 1) % CFG_TIMER_BUFFER_SIZE;
-        //Logger::debug("process, bufferHead=%d bufferTail=%d", bufferHead, bufferTail);
+uint8_t TickHandler::getStatistics(TickStatistics *statistics, uint8_t maxEntries) {
+    uint8_t count = 0;
+
+    noInterrupts();
+    for (TickEntry *entry = attachedEntries; entry != NULL && count < maxEntries; entry = entry->nextAttached) {
+        TickStatistics *stats = &statistics[count++];
+        stats->observer = entry->observer;
+        stats->interval = entry->interval * CFG_TIMER_BASE_INTERVAL;
+        stats->phase = (entry->expires % entry->interval) * CFG_TIMER_BASE_INTERVAL;
+        stats->priority = entry->priority;
+        stats->calls = entry->calls;
+        stats->minTime = (entry->calls > 0 ? entry->minTime : 0);
+        stats->maxTime = entry->maxTime;
+        stats->avgTime = (entry->calls > 0 ? entry->totalTime / entry->calls : 0);
+        stats->overruns = entry->overruns;
+        stats->maxJitter = entry->maxJitter;
+        stats->avgJitter = (entry->calls > 1 ? entry->totalJitter / (entry->calls - 1) : 0);
     }
+    interrupts();
+
+    return count;
 }
 
-void TickHandler::cleanBuffer() {
-    bufferHead = bufferTail = 0;
+/*
+ * Clear the execution time statistics of all attached entries.
+ */
+void TickHandler::resetStatistics() {
+    noInterrupts();
+    for (TickEntry *entry = attachedEntries; entry != NULL; entry = entry->nextAttached) {
+        clearStatistics(entry);
+    }
+    for (int i = 0; i < CFG_TIMER_LOAD_SLOTS; i++) {
+        slotLoad[i] = 0;
+        slotCalls[i] = 0;
+    }
+    loadStartTick = currentTick;
+    interrupts();
 }
 
-#endif //CFG_TIMER_USE_QUEUING
+/*
+ * Execution time (in microseconds) of all ticks whose deadline was in the given
+ * slot (base tick modulo CFG_TIMER_LOAD_SLOTS) since the last reset.
+ */
+uint32_t TickHandler::getSlotLoad(uint8_t slot) {
+    return slotLoad[slot % CFG_TIMER_LOAD_SLOTS];
+}
+
+/*
+ * Number of ticks whose deadline was in the given slot since the last reset.
+ */
+uint32_t TickHandler::getSlotCalls(uint8_t slot) {
+    return slotCalls[slot % CFG_TIMER_LOAD_SLOTS];
+}
+
+/*
+ * Number of complete periods of CFG_TIMER_LOAD_SLOTS base ticks since the last reset.
+ */
+uint32_t TickHandler::getLoadPeriods() {
+    return (currentTick - loadStartTick) / CFG_TIMER_LOAD_SLOTS;
+}
+
+void TickHandler::clearStatistics(TickEntry *entry) {
+    entry->calls = 0;
+    entry->overruns = 0;
+    entry->minTime = 0xFFFFFFFF;
+    entry->maxTime = 0;
+    entry->totalTime = 0;
+    entry->maxJitter = 0;
+    entry->totalJitter = 0;
+}
+
+/*
+ * Call the observer's handleTick() and record its execution time.
+ * An overrun is counted if the call completes more than one interval after
+ * the deadline which triggered it (e.g. because it waited in the queue behind
+ * slow observers or because the observer itself is too slow).
+ * The jitter is the deviation of the time between the start of two calls from
+ * the interval (times the number of coalesced deadlines).
+ */
+void TickHandler::dispatch(TickEntry *entry, TickObserver *observer, uint16_t missedTicks) {
+    uint32_t start = tickProfileTimestamp();
+    observer->handleTick();
+    uint32_t end = tickProfileTimestamp();
+
+    if (entry->observer != observer) { // detached (and maybe re-used) by handleTick()
+        return;
+    }
+
+    uint32_t intervalTime = entry->interval * CFG_TIMER_BASE_INTERVAL * TICK_PROFILE_UNITS_PER_US;
+    if (entry->calls > 0) {
+        uint32_t period = start - entry->lastStart;
+        uint32_t expected = intervalTime * (1 + missedTicks);
+        uint32_t jitter = (period > expected ? period - expected : expected - period);
+        entry->totalJitter += jitter;
+        if (jitter > entry->maxJitter) {
+            entry->maxJitter = jitter;
+        }
+    }
+    entry->lastStart = start;
+
+    uint32_t time = end - start;
+    entry->calls++;
+    entry->totalTime += time;
+    if (time < entry->minTime) {
+        entry->minTime = time;
+    }
+    if (time > entry->maxTime) {
+        entry->maxTime = time;
+    }
+    uint8_t slot = entry->triggerTick % CFG_TIMER_LOAD_SLOTS;
+    uint32_t primask = __get_PRIMASK(); // the slots are shared with the dispatch from the timer interrupt
+    __disable_irq();
+    slotLoad[slot] += time / TICK_PROFILE_UNITS_PER_US;
+    slotCalls[slot]++;
+    __set_PRIMASK(primask);
+    if (end - entry->triggerTime > intervalTime) {
+        entry->overruns++;
+    }
+}
+
+/*
+ * Insert an entry into the wheel slot which matches its deadline.
+ * Deadlines within the next 256 base ticks go to the first level, the ones further
+ * away to the second level from where they are cascaded down when their block of
+ * 256 ticks is reached. Interrupts must be disabled by the caller.
+ *
+ * \param now - the base tick which is currently (or next) being processed
+ */
+void TickHandler::schedule(TickEntry *entry, uint32_t now) {
+    uint32_t delta = entry->expires - now;
+    TickEntry **slot;
+
+    if (delta < TICK_WHEEL0_SIZE) {
+        slot = &wheel0[entry->expires & TICK_WHEEL0_MASK];
+    } else if (delta < TICK_WHEEL_RANGE) {
+        slot = &wheel1[(entry->expires >> TICK_WHEEL0_BITS) & TICK_WHEEL1_MASK];
+    } else { // too far away, park it in the slot which is cascaded last and re-schedule it from there
+        slot = &wheel1[((now >> TICK_WHEEL0_BITS) + TICK_WHEEL1_MASK) & TICK_WHEEL1_MASK];
+    }
+
+    entry->next = *slot;
+    if (entry->next != NULL) {
+        entry->next->pprev = &entry->next;
+    }
+    entry->pprev = slot;
+    *slot = entry;
+}
+
+/*
+ * Remove an entry from its wheel slot. Interrupts must be disabled by the caller.
+ */
+void TickHandler::unschedule(TickEntry *entry) {
+    if (entry->pprev == NULL) {
+        return;
+    }
+    *entry->pprev = entry->next;
+    if (entry->next != NULL) {
+        entry->next->pprev = entry->pprev;
+    }
+    entry->next = NULL;
+    entry->pprev = NULL;
+}
+
+/*
+ * Move all entries of a second level slot to the slots matching their deadline.
+ */
+void TickHandler::cascade(uint8_t slot, uint32_t now) {
+    TickEntry *entry = wheel1[slot];
+    wheel1[slot] = NULL;
+
+    while (entry != NULL) {
+        TickEntry *next = entry->next;
+        schedule(entry, now);
+        entry = next;
+    }
+}
 
 /*
- * Handle the interrupt of any timer.
- * All the registered TickObservers of the timer are called.
+ * Trigger an observer whose deadline has been reached.
+ *
+ * With queuing, an entry is in the queue at most once. If its previous tick
+ * was not processed yet (e.g. loop() stalled), the deadline is only counted
+ * as missed and the observer receives one coalesced tick instead of a burst
+ * of stale ones. As every entry occupies at most one slot, the queue only
+ * overflows if it is smaller than the number of attached entries of that
+ * priority class.
  */
-void TickHandler::handleInterrupt(int timerNumber) {
-    for (int i = 0; i < CFG_TIMER_NUM_OBSERVERS; i++) {
-        if (timerEntry[timerNumber].observer[i] != NULL) {
+void TickHandler::trigger(TickEntry *entry) {
 #ifdef CFG_TIMER_USE_QUEUING
-            tickBuffer[bufferHead] = timerEntry[timerNumber].observer[i];
-            bufferHead = (bufferHead + 1) % CFG_TIMER_BUFFER_SIZE;
-//Logger::debug("bufferHead=%d, bufferTail=%d, observer=%d", bufferHead, bufferTail, timerEntry[timerNumber].observer[i]);
+    if (entry->priority == TICK_PRIORITY_INTERRUPT) {
+        entry->triggerTime = tickProfileTimestamp();
+        entry->triggerTick = currentTick;
+        dispatch(entry, entry->observer, 0);
+        return;
+    }
+    if (entry->pending) {
+        entry->missedTicks++;
+        coalescedCount++;
+        return;
+    }
+
+    uint8_t priority = entry->priority;
+    uint16_t next = (bufferHead[priority] + 1) % CFG_TIMER_BUFFER_SIZE;
+    if (next == bufferTail[priority]) {
+        entry->missedTicks++; // delivered with the next deadline which finds space in the queue
+        overflowCount++;
+        return;
+    }
+
+    entry->pending = true;
+    entry->triggerTime = tickProfileTimestamp();
+    entry->triggerTick = currentTick;
+    tickBuffer[priority][bufferHead[priority]] = entry;
+    __DMB(); // the entry must be visible before the consumer sees the new head
+    bufferHead[priority] = next;
+    loadMonitor.setEvent(EVENT_TICK);
 #else
-            timerEntry[timerNumber].observer[i]->handleTick();
+    entry->triggerTime = tickProfileTimestamp();
+    entry->triggerTick = currentTick;
+    dispatch(entry, entry->observer, 0);
 #endif //CFG_TIMER_USE_QUEUING
-        }
-    }
 }
 
+#ifdef CFG_TIMER_USE_QUEUING
 /*
- * Interrupt function for Timer0
+ * Take the next tick of a priority class from its queue, returns NULL if it's empty.
  */
-void timer0Interrupt() {
-    tickHandler.handleInterrupt(0);
+TickHandler::TickEntry *TickHandler::dequeue(uint8_t priority) {
+    if (bufferHead[priority] == bufferTail[priority]) {
+        return NULL;
+    }
+    TickEntry *entry = tickBuffer[priority][bufferTail[priority]];
+    __DMB();
+    bufferTail[priority] = (bufferTail[priority] + 1) % CFG_TIMER_BUFFER_SIZE;
+    return entry;
 }
+
 /*
- * Interrupt function for Timer1
+ * Check if ticks are available, forward them to registered observers.
+ * Before every dispatch, pending control ticks are taken first, then I/O ticks.
+ * Background ticks are only dispatched until CFG_TIMER_BACKGROUND_BUDGET
+ * microseconds were spent on them, the remaining ones stay queued for the next call.
+ * While handleTick() runs, getMissedTicks() returns the number of deadlines
+ * which were coalesced into this tick.
  */
-void timer1Interrupt() {
-    tickHandler.handleInterrupt(1);
+void TickHandler::process() {
+    uint32_t backgroundTime = 0;
+
+    while (true) {
+        TickEntry *entry = dequeue(TICK_PRIORITY_CONTROL);
+        if (entry == NULL) {
+            entry = dequeue(TICK_PRIORITY_IO);
+        }
+        bool background = false;
+        if (entry == NULL) {
+            if (bufferHead[TICK_PRIORITY_BACKGROUND] == bufferTail[TICK_PRIORITY_BACKGROUND]) {
+                break;
+            }
+            if (backgroundTime >= CFG_TIMER_BACKGROUND_BUDGET) {
+                deferredCount++;
+                loadMonitor.setEvent(EVENT_TICK); // continue in the next loop iteration
+                break;
+            }
+            entry = dequeue(TICK_PRIORITY_BACKGROUND);
+            background = true;
+        }
+
+        noInterrupts();
+        dispatchMissedTicks = entry->missedTicks;
+        entry->missedTicks = 0;
+        entry->pending = false;
+        TickObserver *observer = entry->observer;
+        if (observer == NULL) { // detached while it was queued, recycle it now
+            entry->nextAttached = freeEntries;
+            freeEntries = entry;
+        }
+        interrupts();
+
+        if (observer != NULL) {
+            uint32_t start = micros();
+            dispatch(entry, observer, dispatchMissedTicks);
+            if (background) {
+                backgroundTime += micros() - start;
+            }
+        }
+        dispatchMissedTicks = 0;
+    }
 }
+
 /*
- * Interrupt function for Timer2
+ * Drop all queued ticks.
  */
-void timer2Interrupt() {
-    tickHandler.handleInterrupt(2);
+void TickHandler::cleanBuffer() {
+    for (uint8_t priority = 0; priority < TICK_NUM_PRIORITIES; priority++) {
+        TickEntry *entry;
+        while ((entry = dequeue(priority)) != NULL) {
+            noInterrupts();
+            entry->pending = false;
+            entry->missedTicks = 0;
+            if (entry->observer == NULL) {
+                entry->nextAttached = freeEntries;
+                freeEntries = entry;
+            }
+            interrupts();
+        }
+    }
 }
+
 /*
- * Interrupt function for Timer3
+ * Number of deadlines which were coalesced into the tick that is currently
+ * being dispatched (only valid while handleTick() is executed).
  */
-void timer3Interrupt() {
-    tickHandler.handleInterrupt(3);
+uint16_t TickHandler::getMissedTicks() {
+    return dispatchMissedTicks;
 }
+
 /*
- * Interrupt function for Timer4
+ * Number of ticks which were lost because the queue was full.
  */
-void timer4Interrupt() {
-    tickHandler.handleInterrupt(4);
+uint32_t TickHandler::getOverflowCount() {
+    return overflowCount;
 }
+
 /*
- * Interrupt function for Timer5
+ * Number of ticks which were merged into an already pending tick.
  */
-void timer5Interrupt() {
-    tickHandler.handleInterrupt(5);
+uint32_t TickHandler::getCoalescedCount() {
+    return coalescedCount;
 }
+
 /*
- * Interrupt function for Timer6
+ * Number of process() calls which deferred background ticks to the next call
+ * because CFG_TIMER_BACKGROUND_BUDGET was used up.
  */
-void timer6Interrupt() {
-    tickHandler.handleInterrupt(6);
+uint32_t TickHandler::getDeferredCount() {
+    return deferredCount;
 }
+
+void TickHandler::resetQueueStatistics() {
+    overflowCount = 0;
+    coalescedCount = 0;
+    deferredCount = 0;
+}
+
+#endif //CFG_TIMER_USE_QUEUING
+
 /*
- * Interrupt function for Timer7
+ * Handle the interrupt of the base timer.
+ * Advance the timer wheel by one base tick and trigger all observers
+ * whose deadline is reached.
  */
-void timer7Interrupt() {
-    tickHandler.handleInterrupt(7);
+void TickHandler::handleInterrupt() {
+    uint32_t now = currentTick;
+    uint8_t slot = now & TICK_WHEEL0_MASK;
+
+    if (slot == 0) {
+        cascade((now >> TICK_WHEEL0_BITS) & TICK_WHEEL1_MASK, now);
+    }
+
+    // entries are taken one by one from the head as handleTick() might detach an observer
+    TickEntry *entry;
+    while ((entry = wheel0[slot]) != NULL) {
+        unschedule(entry);
+        entry->expires += entry->interval; // absolute deadlines, no drift
+        schedule(entry, now);
+        trigger(entry);
+    }
+
+    currentTick = now + 1;
 }
+
 /*
- * Interrupt function for Timer8
+ * Interrupt function for Timer0 (the base timer)
  */
-void timer8Interrupt() {
-    tickHandler.handleInterrupt(8);
+void timer0Interrupt() {
+    tickHandler.handleInterrupt();
 }
 
 /*
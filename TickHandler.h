@@ -4,6 +4,10 @@
  * Class where TickObservers can register to be triggered
  * on a certain interval.
  *
+ * All observers are driven from a single hardware timer which
+ * runs at CFG_TIMER_BASE_INTERVAL. The deadlines of the observers
+ * are kept in a two level hierarchical timer wheel.
+ *
 Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
 
 Permission is hereby granted, free of charge, to any person obtaining
@@ -34,7 +38,43 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <DueTimer.h>
 #include "Logger.h"
 
-#define NUM_TIMERS 9
+#define TICK_WHEEL0_BITS    8   // first level: one slot per base tick (256 slots)
+#define TICK_WHEEL1_BITS    6   // second level: one slot per 256 base ticks (64 slots)
+#define TICK_WHEEL0_SIZE    (1 << TICK_WHEEL0_BITS)
+#define TICK_WHEEL1_SIZE    (1 << TICK_WHEEL1_BITS)
+#define TICK_WHEEL0_MASK    (TICK_WHEEL0_SIZE - 1)
+#define TICK_WHEEL1_MASK    (TICK_WHEEL1_SIZE - 1)
+#define TICK_WHEEL_RANGE    (1UL << (TICK_WHEEL0_BITS + TICK_WHEEL1_BITS)) // deadlines further away get re-cascaded
+
+/*
+ * Time base of the execution time profiler. On the Due the DWT cycle counter
+ * of the Cortex-M3 is used, other platforms (e.g. a host build) fall back to micros().
+ */
+#if defined(__SAM3X8E__)
+#define TICK_PROFILE_UNITS_PER_US   (F_CPU / 1000000) // CPU cycles per microsecond
+#else
+#define TICK_PROFILE_UNITS_PER_US   1
+#endif
+
+/*
+ * Priority class of an attached observer. With queuing, process() always
+ * dispatches all pending control ticks first, then I/O ticks. Background
+ * ticks only get CFG_TIMER_BACKGROUND_BUDGET microseconds per call, the
+ * rest is deferred to the next call.
+ * Observers of the interrupt class bypass the queues, their handleTick() is
+ * called directly from the timer interrupt. This is only meant for short,
+ * bounded handlers (e.g. sending a pre-calculated CAN frame) which exchange
+ * data with the rest of the code through a TickMailbox.
+ */
+enum TickPriority {
+    TICK_PRIORITY_CONTROL,      // e.g. motor controller commands and throttle sampling
+    TICK_PRIORITY_IO,           // e.g. BMS, DC-DC, memory cache
+    TICK_PRIORITY_BACKGROUND,   // e.g. heartbeat, BLE, wifi
+    TICK_PRIORITY_INTERRUPT     // called from the timer interrupt, not queued
+};
+#define TICK_NUM_PRIORITIES 3 // number of queued priority classes
+
+#define TICK_PHASE_AUTO     0xFFFFFFFF // let attach() choose the phase with the least collisions
 
 class TickObserver {
 public:
@@ -44,41 +84,154 @@ public:
 
 class TickHandler {
 public:
+    /*
+     * Execution time statistics of one attached observer/interval.
+     * All times are in units of the profiler (see TICK_PROFILE_UNITS_PER_US).
+     */
+    struct TickStatistics {
+        TickObserver *observer;
+        uint32_t interval;  // interval in microseconds
+        uint32_t phase;     // offset of the deadlines in microseconds (relative to multiples of the interval)
+        TickPriority priority;
+        uint32_t calls;     // number of handleTick() calls
+        uint32_t minTime;   // shortest execution time of handleTick()
+        uint32_t maxTime;   // longest execution time of handleTick()
+        uint32_t avgTime;   // average execution time of handleTick()
+        uint32_t overruns;  // handleTick() finished later than one interval after its deadline
+        uint32_t maxJitter; // largest deviation of the time between two calls from the interval
+        uint32_t avgJitter; // average deviation of the time between two calls from the interval
+    };
+
     TickHandler();
-    void attach(TickObserver *observer, uint32_t interval);
+    void attach(TickObserver *observer, uint32_t interval, TickPriority priority = TICK_PRIORITY_IO, uint32_t phase = TICK_PHASE_AUTO);
     void detach(TickObserver *observer);
-    void handleInterrupt(int timerNumber); // must be public when from the non-class functions
+    void setInterval(TickObserver *observer, uint32_t interval);
+    void handleInterrupt(); // must be public when from the non-class functions
+    uint32_t getTickCount();
+    uint8_t getStatistics(TickStatistics *statistics, uint8_t maxEntries);
+    void resetStatistics();
+    uint32_t getSlotLoad(uint8_t slot);
+    uint32_t getSlotCalls(uint8_t slot);
+    uint32_t getLoadPeriods();
 #ifdef CFG_TIMER_USE_QUEUING
     void cleanBuffer();
     void process();
+    uint16_t getMissedTicks();
+    uint32_t getOverflowCount();
+    uint32_t getCoalescedCount();
+    uint32_t getDeferredCount();
+    void resetQueueStatistics();
 #endif
 
 protected:
 
 private:
-    struct TimerEntry {
-        long interval; // interval of timer
-        TickObserver *observer[CFG_TIMER_NUM_OBSERVERS]; // array of pointers to observers with this interval
+    struct TickEntry {
+        TickObserver *observer; // the observer to trigger
+        uint32_t interval;      // interval in base ticks
+        TickPriority priority;  // selects the queue the ticks are put in
+        uint32_t expires;       // absolute base tick of the next deadline
+        TickEntry *next;        // next entry in the same wheel slot
+        TickEntry **pprev;      // the link pointing to this entry, allows O(1) removal from a slot
+        TickEntry *nextAttached; // chain of all attached entries
+        uint32_t triggerTime;   // profiler timestamp of the last reached deadline
+        uint32_t triggerTick;   // base tick of the last reached deadline
+        uint32_t calls;         // profiler: number of dispatched ticks
+        uint32_t overruns;      // profiler: ticks which completed later than one interval after the deadline
+        uint32_t minTime;       // profiler: shortest execution time
+        uint32_t maxTime;       // profiler: longest execution time
+        uint64_t totalTime;     // profiler: sum of all execution times
+        uint32_t lastStart;     // profiler timestamp of the last call
+        uint32_t maxJitter;     // profiler: largest deviation of the period from the interval
+        uint64_t totalJitter;   // profiler: sum of all period deviations
+#ifdef CFG_TIMER_USE_QUEUING
+        volatile bool pending;  // a tick of this entry is in the queue and not yet processed
+        volatile uint16_t missedTicks; // deadlines which were coalesced into the pending tick
+#endif
     };
-    TimerEntry timerEntry[NUM_TIMERS]; // array of timer entries (9 as there are 9 timers)
+    TickEntry *wheel0[TICK_WHEEL0_SIZE]; // slots for deadlines within the next 256 base ticks
+    TickEntry *wheel1[TICK_WHEEL1_SIZE]; // slots for deadlines further away
+    TickEntry *attachedEntries; // all entries which are currently attached
+    TickEntry *freeEntries; // detached entries which can be re-used
+    volatile uint32_t currentTick; // the next base tick to be processed by the interrupt
+    bool timerRunning;
+    uint32_t slotLoad[CFG_TIMER_LOAD_SLOTS]; // execution time (microseconds) of ticks by deadline modulo CFG_TIMER_LOAD_SLOTS
+    uint32_t slotCalls[CFG_TIMER_LOAD_SLOTS]; // number of ticks by deadline modulo CFG_TIMER_LOAD_SLOTS
+    uint32_t loadStartTick; // base tick at which the slot load measurement was (re)started
 #ifdef CFG_TIMER_USE_QUEUING
-    TickObserver *tickBuffer[CFG_TIMER_BUFFER_SIZE];
-    volatile uint16_t bufferHead, bufferTail;
+    TickEntry *tickBuffer[TICK_NUM_PRIORITIES][CFG_TIMER_BUFFER_SIZE]; // per priority a single producer (interrupt), single consumer (process()) ring
+    volatile uint16_t bufferHead[TICK_NUM_PRIORITIES], bufferTail[TICK_NUM_PRIORITIES];
+    volatile uint32_t overflowCount; // ticks which found the queue full
+    volatile uint32_t coalescedCount; // ticks which were merged into an already pending tick
+    uint32_t deferredCount; // process() calls which left background ticks queued because the budget was used up
+    uint16_t dispatchMissedTicks; // missed ticks of the observer which is currently dispatched
+#endif
+
+    TickEntry *allocateEntry();
+    uint32_t choosePhase(uint32_t interval);
+    void clearStatistics(TickEntry *entry);
+    void dispatch(TickEntry *entry, TickObserver *observer, uint16_t missedTicks);
+    void schedule(TickEntry *entry, uint32_t now);
+    void unschedule(TickEntry *entry);
+    void cascade(uint8_t slot, uint32_t now);
+    void trigger(TickEntry *entry);
+#ifdef CFG_TIMER_USE_QUEUING
+    TickEntry *dequeue(uint8_t priority);
 #endif
-    
-    int findTimer(long interval);
-    int findObserver(int timerNumber, TickObserver *observer);
 };
 
 void timer0Interrupt();
-void timer1Interrupt();
-void timer2Interrupt();
-void timer3Interrupt();
-void timer4Interrupt();
-void timer5Interrupt();
-void timer6Interrupt();
-void timer7Interrupt();
-void timer8Interrupt();
+
+/*
+ * Hands over data between a TickObserver running in the timer interrupt and
+ * the code running in loop() (in either direction) without disabling interrupts.
+ * The writer fills the buffer which is currently not published and then flips
+ * the sequence number. A reader in loop() retries if the interrupt published
+ * new data while it was copying, a reader in the interrupt can't be interrupted
+ * by the writer and therefore always gets a consistent copy.
+ * There must be only one writer.
+ */
+template<class T> class TickMailbox {
+public:
+    TickMailbox() {
+        sequence = 0;
+    }
+
+    void write(const T &value) {
+        buffer[(sequence + 1) & 1] = value;
+        __DMB(); // the data must be complete before it's published
+        sequence++;
+    }
+
+    /*
+     * Copy the most recently published data. Returns false if nothing was written yet.
+     */
+    bool read(T &value) {
+        uint32_t seq;
+        do {
+            seq = sequence;
+            __DMB();
+            value = buffer[seq & 1];
+            __DMB();
+        } while (seq != sequence);
+        return seq != 0;
+    }
+
+private:
+    T buffer[2];
+    volatile uint32_t sequence;
+};
+
+/*
+ * Current timestamp of the execution time profiler.
+ */
+inline uint32_t tickProfileTimestamp() {
+#if defined(__SAM3X8E__)
+    return DWT->CYCCNT;
+#else
+    return micros();
+#endif
+}
 
 extern TickHandler tickHandler;
 
@@ -192,7 +192,7 @@ void ADAFRUITBLE::setup() {
     resetTime = millis();
     didResetInit = false;
     
-    tickHandler.attach(this, CFG_TICK_INTERVAL_BLE);
+    tickHandler.attach(this, loadTickInterval(CFG_TICK_INTERVAL_BLE), TICK_PRIORITY_BACKGROUND);
     
     attachInterrupt(digitalPinToInterrupt(27), BLEInterrupt, RISING);
 }
@@ -53,14 +53,18 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * TIMER INTERVALS
  *
  * specify the intervals (microseconds) at which each device type should be "ticked"
- * try to use the same numbers for several devices because then they will share
- * the same timer (out of a limited number of 9 timers).
+ * All intervals are driven by one hardware timer which runs at CFG_TIMER_BASE_INTERVAL,
+ * so any interval may be used. It is rounded to a multiple of the base interval.
  */
+#define CFG_TIMER_BASE_INTERVAL                     1000 // resolution of the TickHandler timer wheel
+#define CFG_TICK_INTERVAL_IDLE                      200000 // throttles while the motor controller is disabled or in neutral
 #define CFG_TICK_INTERVAL_HEARTBEAT                 2000000
 #define CFG_TICK_INTERVAL_POT_THROTTLE              40000
 #define CFG_TICK_INTERVAL_CAN_THROTTLE              40000
 #define CFG_TICK_INTERVAL_MOTOR_CONTROLLER          40000
 #define CFG_TICK_INTERVAL_MOTOR_CONTROLLER_DMOC     40000
+//#define CFG_DMOC_COMMANDS_IN_INTERRUPT // if defined, the DMOC command frames are sent directly from the timer interrupt
+#define CFG_DMOC_COMMAND_MAX_AGE                    3 // intervals after which the interrupt stops re-sending DMOC commands which weren't updated
 #define CFG_TICK_INTERVAL_MOTOR_CONTROLLER_CODAUQM  10000
 #define CFG_TICK_INTERVAL_MOTOR_CONTROLLER_BRUSA    20000
 #define CFG_TICK_INTERVAL_MEM_CACHE                 40000
@@ -70,21 +74,68 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CFG_TICK_INTERVAL_DCDC                      200000
 #define CFG_TICK_INTERVAL_EVIC                      100000
 #define CFG_TICK_INTERVAL_VEHICLE                   100000
+#define CFG_TICK_INTERVAL_ISOTP                     1000 // only while an ISO-TP transfer is in progress
+#define CFG_TICK_INTERVAL_SDO                       1000 // only while an SDO transfer is in progress
+#define CFG_TICK_INTERVAL_GVRET                     5000 // only while frames are streamed to SavvyCAN
+#define CFG_TICK_INTERVAL_TRACE                     5000 // only while a trace is recorded
+#define CFG_TICK_INTERVAL_CAN_WATCH                 10000 // resolution of the timeouts of watched CAN frames
+#define CFG_TICK_INTERVAL_CAN_MONITOR               100000 // polling of the CAN error state, the bus load window closes up to this late
+#define CFG_TICK_INTERVAL_FWUPDATE                  1000 // only while a firmware update is in progress
 
 /*
  * CAN BUS CONFIGURATION
  */
-#define CFG_CAN0_SPEED CAN_BPS_500K // specify the speed of the CAN0 bus (EV)
-#define CFG_CAN1_SPEED CAN_BPS_500K // specify the speed of the CAN1 bus (Car)
-#define CFG_CAN0_NUM_RX_MAILBOXES 9 // amount of CAN bus receive mailboxes for CAN0
-#define CFG_CAN1_NUM_RX_MAILBOXES 9 // amount of CAN bus receive mailboxes for CAN1
+#define CFG_CAN0_SPEED CAN_BPS_500K // speed of the CAN0 bus (EV) if EESYS_CAN0_BAUD holds no valid value
+#define CFG_CAN1_SPEED CAN_BPS_500K // speed of the CAN1 bus (Car) if EESYS_CAN1_BAUD holds no valid value
+#define CFG_CAN0_NUM_RX_MAILBOXES 6 // amount of CAN bus receive mailboxes for CAN0 (of 8, the rest is used for transmission)
+#define CFG_CAN1_NUM_RX_MAILBOXES 6 // amount of CAN bus receive mailboxes for CAN1 (of 8, the rest is used for transmission)
+#define CFG_CAN_RX_BUFFER_SIZE 32 // number of received frames per bus which can be buffered between the CAN interrupt and loop()
+#define CFG_CAN_NUM_CYCLIC_MESSAGES 8 // max number of cyclic messages per bus (see CanHandler::addCyclicMessage())
+#define CFG_CAN_TX_QUEUE_SIZE 16 // number of frames per bus which can wait for a free transmit mailbox
+#define CFG_CAN_NUM_WATCHES 8 // max number of watched ids per bus (see CanHandler::watchFrames())
+#define CFG_CAN_GATEWAY_RULES 8 // max number of gateway rules per source bus (see CanHandler::addGatewayRule())
+#define CFG_ISOTP_NUM_SESSIONS 4 // max number of concurrent ISO-TP sessions per bus
+#define CFG_ISOTP_BUFFER_SIZE 128 // max length of an ISO-TP message (per session and direction)
+#define CFG_ISOTP_BLOCK_SIZE 0 // consecutive frames we accept before sending another flow control frame (0 = all)
+#define CFG_ISOTP_STMIN 0 // minimum separation time (ms) between consecutive frames we request from a sender
+#define CFG_ISOTP_TIMEOUT 1000000 // microseconds to wait for a flow control or consecutive frame (N_Bs / N_Cr)
+#define CFG_ISOTP_FRAMES_PER_TICK 4 // max consecutive frames queued per tick when the receiver allows no separation time
+#define CFG_ISOTP_PADDING 0xAA // value of unused bytes in ISO-TP frames
+#define CFG_SDO_QUEUE_SIZE 16 // number of SDO transfers per bus which can be in progress or queued (all nodes)
+#define CFG_SDO_TIMEOUT 500000 // microseconds to wait for the response of a node before a transfer is aborted
+#define CFG_SDO_BLOCK_SIZE 32 // segments per block we accept in block uploads (1-127)
+#define CFG_SDO_BLOCK_MIN_LENGTH 28 // transfers longer than this (bytes) use block instead of segmented transfers
+#define CFG_SDO_SEGMENTS_PER_TICK 4 // max segments of a block download queued per tick
+#define CFG_SDO_SERVER_BUFFER_SIZE 64 // bytes of the largest object of the SDO server (strings and parameter blocks)
+#define CFG_FWUPDATE_PAGE_BUFFERS 4 // flash pages (256 bytes) of a firmware update which can wait to be programmed
+#define CFG_FWUPDATE_CREDIT_1M 24 // frames a firmware update host may send ahead at 1Mbps (must fit into CFG_CAN_RX_BUFFER_SIZE)
+#define CFG_FWUPDATE_CREDIT_500K 16 // frames a firmware update host may send ahead at 500kbps
+#define CFG_FWUPDATE_CREDIT_SLOW 8 // frames a firmware update host may send ahead below 500kbps
+#define CFG_FWUPDATE_TIMEOUT 2000000 // microseconds without a frame from the host after which a firmware update is aborted
+#define CFG_FWUPDATE_VERIFY_CHUNK 4096 // bytes of the received image which are checked per tick
+#define CFG_FWUPDATE_SUPPLY_THRESHOLD 0xB // supply monitor threshold (1.9V + 0.1V steps, 0xB = 3.0V), a firmware update isn't installed after a drop below it
+#define CFG_CAN_ID_STATS_SIZE 64 // number of can id's per bus for which receive statistics are kept (power of 2)
+#define CFG_CAN_HW_TIMESTAMPS // if defined, the timestamps of the CAN controller (one tick per bit) are used for the gaps between frames
+#define CFG_GVRET_BUFFER_SIZE 8192 // bytes of encoded frames which can wait for the USB port (about 25ms of two fully loaded buses)
+#define CFG_GVRET_PACKET_SIZE 512 // bytes written to the USB port at once
+#define CFG_GVRET_FLUSH_INTERVAL 5000 // max microseconds a partial packet waits before it's written
+#define CFG_GVRET_TIMEOUT 5000000 // microseconds without a message from the host after which streaming stops
+#define CFG_GVRET_NUM_FILTERS 4 // max number of id filters for streaming
+#define CFG_TRACE_BUFFER_SIZE 4096 // bytes of recorded inputs which can wait for the USB port
+#define CFG_TRACE_PACKET_SIZE 512 // bytes of a trace written to the USB port at once
+#define CFG_TRACE_FLUSH_INTERVAL 5000 // max microseconds a partial packet of a trace waits before it's written
+#define CFG_CAN_RX_BATCH 16 // maximum number of received frames per bus which are processed in one loop() iteration
 #define CFG_CANTHROTTLE_MAX_NUM_LOST_MSG 3 // maximum number of lost messages allowed
+#define CFG_MOTORCTRL_RX_TIMEOUT 2000000 // microseconds without frames from an inverter after which it's no longer running
+#define CFG_EVIC_JLD505_TIMEOUT 2000000 // microseconds without frames from the JLD505 after which the EVIC uses the motor controller's values
 
 /*
  * MISCELLANEOUS
  *
  */
 #define CFG_THROTTLE_TOLERANCE  150 //the max that things can go over or under the min/max without fault - 1/10% each #
+#define CFG_PID_VIN "00000000000000000" //17 character VIN reported in OBD-II mode 9 (e.g. the one of the donor vehicle)
+#define CFG_PID_ECU_NAME "VCU\0-GEVCU" //ECU name reported in OBD-II mode 9 (4 character acronym, dash, name; max 20 characters)
 
 
 /*
@@ -147,10 +198,12 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * These values should normally not be changed.
  */
 #define CFG_DEV_MGR_MAX_DEVICES 30 // the maximum number of devices supported by the DeviceManager
-#define CFG_CAN_NUM_OBSERVERS	7 // maximum number of device subscriptions per CAN bus
-#define CFG_TIMER_NUM_OBSERVERS	7 // the maximum number of supported observers per timer
+#define CFG_CAN_NUM_OBSERVERS	12 // maximum number of device subscriptions per CAN bus
 #define CFG_TIMER_USE_QUEUING	// if defined, TickHandler uses a queuing buffer instead of direct calls from interrupts
-#define CFG_TIMER_BUFFER_SIZE	100 // the size of the queuing buffer for TickHandler
+#define CFG_TIMER_BUFFER_SIZE	50 // the size of each queuing buffer (one per priority class) for TickHandler
+#define CFG_TIMER_BACKGROUND_BUDGET	2000 // microseconds per TickHandler::process() call for background priority ticks
+#define CFG_LOOP_USE_WFI	// if defined, loop() puts the CPU to sleep (WFI) while no events are pending
+#define CFG_TIMER_LOAD_SLOTS	40 // number of base ticks over which TickHandler reports the load per slot (one slot per base tick)
 #define CFG_FAULT_HISTORY_SIZE	50 //number of faults to store in eeprom. A circular buffer so the last 50 faults are always stored.
 
 /*
@@ -55,6 +55,7 @@ SystemIO::SystemIO()
     numAnaOut = 0;
     
     sysioState = SYSSTATE_UNINIT;
+    replay = false;
     adc2Initialized = false;
     adc3Initialized = false;
     lastInitAttempt = 0;
@@ -62,7 +63,7 @@ SystemIO::SystemIO()
 
 bool SystemIO::isInitialized()
 {
-    if (sysioState == SYSSTATE_INITIALIZED) return true;
+    if (sysioState == SYSSTATE_INITIALIZED || replay) return true;
     return false;
 }
 
@@ -278,6 +279,7 @@ bool SystemIO::setupSPIADC()
         return true;
         break;
     }
+    return (sysioState == SYSSTATE_INITIALIZED);
 }
 
 void SystemIO::installExtendedIO(CANIODevice *device)
@@ -537,7 +539,13 @@ int32_t SystemIO::getPackLowReading()
 boolean SystemIO::getDigitalIn(uint8_t which) {
     if (which >= numDigIn) return false;
     
-    if (which < NUM_DIGITAL) return !(digitalRead(dig[which]));
+    if (which < NUM_DIGITAL)
+    {
+        if (replay) return (replayedDigitalInputs & (1 << which)) != 0;
+        boolean active = !(digitalRead(dig[which]));
+        if (traceRecorder.isRecording()) traceRecorder.recordDigitalInput(which, active);
+        return active;
+    }
     else
     {
         CANIODevice *dev;
@@ -587,6 +595,7 @@ int32_t SystemIO::getSPIADCReading(int CS, int sensor)
     int32_t result;
     int32_t byt;
     
+    if (replay) return replayedAdc[getAdcChannel(CS, sensor)];
     if (!isInitialized()) return 0;
     
     //Logger::debug("SPI Read CS: %i Sensor: %i", CS, sensor);
@@ -605,9 +614,38 @@ int32_t SystemIO::getSPIADCReading(int CS, int sensor)
     if (result & (1 << 23)) result |= (255 << 24);
     digitalWrite(CS, HIGH);
     SPI.endTransaction();
+    if (traceRecorder.isRecording()) traceRecorder.recordAdc(getAdcChannel(CS, sensor), result);
     return result;
 }
 
+/*
+ * Number of an ADE7913 channel in traces (0-8).
+ */
+uint8_t SystemIO::getAdcChannel(int CS, int sensor)
+{
+    return ((CS - CS1) / 2) * 3 + sensor;
+}
+
+/*
+ * Take the analog and digital inputs from a trace (see TracePlayer) instead of the hardware.
+ */
+void SystemIO::setReplay(bool enable)
+{
+    replay = enable;
+    replayedDigitalInputs = 0;
+    for (int i = 0; i < TRACE_ADC_CHANNELS; i++) replayedAdc[i] = 0;
+}
+
+void SystemIO::setReplayedAdc(uint8_t channel, int32_t value)
+{
+    if (channel < TRACE_ADC_CHANNELS) replayedAdc[channel] = value;
+}
+
+void SystemIO::setReplayedDigitalInputs(uint8_t inputs)
+{
+    replayedDigitalInputs = inputs;
+}
+
 /*
  * adc is the adc port to calibrate, update if true will write the new value to EEPROM automatically
  */
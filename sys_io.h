@@ -36,6 +36,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "eeprom_layout.h"
 #include "PrefHandler.h"
 #include "Logger.h"
+#include "InputTrace.h"
 
 class CANIODevice;
 
@@ -123,11 +124,15 @@ public:
     bool calibrateADCOffset(int, bool);
     bool isInitialized();
     void pollInitialization();
+    void setReplay(bool enable);
+    void setReplayedAdc(uint8_t channel, int32_t value);
+    void setReplayedDigitalInputs(uint8_t inputs);
 
 private:
     int32_t getSPIADCReading(int CS, int sensor);
     int16_t getRawADC(uint8_t which);
     bool setupSPIADC();
+    uint8_t getAdcChannel(int CS, int sensor);
 
     uint8_t dig[NUM_DIGITAL];
     uint8_t adc[NUM_ANALOG][2];
@@ -141,6 +146,9 @@ private:
     bool adc2Initialized;
     bool adc3Initialized;
     SYSIO_STATE sysioState;
+    bool replay; // inputs are fed from a trace instead of the hardware
+    int32_t replayedAdc[TRACE_ADC_CHANNELS];
+    uint8_t replayedDigitalInputs;
     uint32_t lastInitAttempt;
     
     int numDigIn;
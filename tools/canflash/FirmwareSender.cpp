@@ -0,0 +1,277 @@
+/*
+ * FirmwareSender.cpp
+ *
+ * State machine of the host side of the CAN firmware update.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include "FirmwareSender.h"
+
+FirmwareSender::FirmwareSender(FirmwareSenderPort *port)
+{
+    this->port = port;
+    state = STATE_IDLE;
+    status = FWUPDATE_OK;
+    image = 0;
+    size = 0;
+    totalFrames = 0;
+    nextFrame = 0;
+    ackedFrames = 0;
+    limit = 0;
+    retransmissions = 0;
+    retries = 0;
+    timer = 0;
+    pendingCommand = false;
+}
+
+/*
+ * Start the update with an image. The image must stay valid until the
+ * update is done or failed.
+ */
+bool FirmwareSender::start(const uint8_t *image, uint32_t size, uint32_t now)
+{
+    if (size == 0 || size > FWUPDATE_MAX_IMAGE_SIZE) {
+        return false;
+    }
+    this->image = image;
+    this->size = size;
+    totalFrames = (size + FWUPDATE_FRAME_SIZE - 1) / FWUPDATE_FRAME_SIZE;
+    nextFrame = 0;
+    ackedFrames = 0;
+    limit = 0;
+    retransmissions = 0;
+    retries = 0;
+    status = FWUPDATE_OK;
+    state = STATE_STARTING;
+    timer = now;
+    pendingCommand = !sendCommand(FWUPDATE_START);
+    return true;
+}
+
+void FirmwareSender::abort()
+{
+    if (state != STATE_IDLE && state != STATE_DONE && state != STATE_FAILED) {
+        sendCommand(FWUPDATE_ABORT);
+        fail(FWUPDATE_ERR_ABORTED);
+    }
+}
+
+/*
+ * Process a frame received from the bus, frames of other ids are ignored.
+ */
+void FirmwareSender::handleFrame(uint32_t id, const uint8_t *data, uint8_t length, uint32_t now)
+{
+    if (id != FWUPDATE_RESPONSE_ID || length < 2 || state == STATE_IDLE || state == STATE_DONE || state == STATE_FAILED) {
+        return;
+    }
+    uint32_t count = (length >= 3 ? data[1] | (data[2] << 8) : 0);
+
+    switch (data[0]) {
+    case FWUPDATE_STARTED:
+        if (state != STATE_STARTING || length < 3) {
+            return;
+        }
+        if (data[1] != FWUPDATE_OK) {
+            fail(data[1]);
+            return;
+        }
+        state = STATE_SENDING;
+        limit = data[2];
+        break;
+
+    case FWUPDATE_ACK:
+        if (state != STATE_SENDING || length < 4 || count > totalFrames) {
+            return;
+        }
+        ackedFrames = count;
+        if (nextFrame < count) {
+            nextFrame = count;
+        }
+        limit = count + data[3];
+        if (ackedFrames == totalFrames) {
+            state = STATE_VERIFYING;
+        }
+        break;
+
+    case FWUPDATE_NACK: // go back to the frame the GEVCU expects (or forward if an ACK was lost)
+        if (state != STATE_SENDING || length < 4 || count > totalFrames) {
+            return;
+        }
+        if (nextFrame > count) {
+            retransmissions += nextFrame - count;
+        }
+        nextFrame = count;
+        ackedFrames = count;
+        limit = count + data[3];
+        break;
+
+    case FWUPDATE_RESULT:
+        if (data[1] != FWUPDATE_OK) {
+            fail(data[1]);
+            return;
+        }
+        if (state != STATE_SENDING && state != STATE_VERIFYING) {
+            return;
+        }
+        ackedFrames = totalFrames; // the last ACK may have been lost
+        state = STATE_COMMITTING;
+        pendingCommand = !sendCommand(FWUPDATE_COMMIT);
+        break;
+
+    case FWUPDATE_COMMITTED:
+        if (state != STATE_COMMITTING) {
+            return;
+        }
+        if (data[1] != FWUPDATE_OK) {
+            fail(data[1]);
+            return;
+        }
+        state = STATE_DONE;
+        break;
+
+    default:
+        return;
+    }
+    timer = now;
+    retries = 0;
+}
+
+/*
+ * Send as many data frames as the credit allows and handle timeouts. Call
+ * this whenever the port may accept frames again and at least every few ms.
+ */
+void FirmwareSender::poll(uint32_t now)
+{
+    if (pendingCommand) {
+        pendingCommand = !sendCommand(state == STATE_STARTING ? FWUPDATE_START : FWUPDATE_COMMIT);
+        if (pendingCommand) {
+            return;
+        }
+        timer = now;
+    }
+
+    switch (state) {
+    case STATE_STARTING:
+    case STATE_COMMITTING:
+        if (now - timer > FWSENDER_RESPONSE_TIMEOUT) {
+            if (++retries > FWSENDER_MAX_RETRIES) {
+                fail(FWUPDATE_ERR_TIMEOUT);
+                return;
+            }
+            timer = now;
+            pendingCommand = !sendCommand(state == STATE_STARTING ? FWUPDATE_START : FWUPDATE_COMMIT);
+        }
+        break;
+
+    case STATE_SENDING:
+        while (nextFrame < limit && nextFrame < totalFrames && sendData(nextFrame)) {
+            nextFrame++;
+        }
+        if (now - timer > FWSENDER_RESPONSE_TIMEOUT) { // the ACK or NACK got lost, go back to the last confirmed frame
+            if (++retries > FWSENDER_MAX_RETRIES) {
+                fail(FWUPDATE_ERR_TIMEOUT);
+                return;
+            }
+            retransmissions += nextFrame - ackedFrames;
+            nextFrame = ackedFrames;
+            timer = now;
+        }
+        break;
+
+    case STATE_VERIFYING:
+        if (now - timer > FWSENDER_RESULT_TIMEOUT) {
+            fail(FWUPDATE_ERR_TIMEOUT);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+FirmwareSender::State FirmwareSender::getState() const
+{
+    return state;
+}
+
+uint8_t FirmwareSender::getStatus() const
+{
+    return status;
+}
+
+uint32_t FirmwareSender::getTotalFrames() const
+{
+    return totalFrames;
+}
+
+uint32_t FirmwareSender::getAckedFrames() const
+{
+    return ackedFrames;
+}
+
+uint32_t FirmwareSender::getRetransmissions() const
+{
+    return retransmissions;
+}
+
+bool FirmwareSender::sendCommand(uint8_t command)
+{
+    uint8_t data[8];
+
+    data[0] = command;
+    if (command != FWUPDATE_START) {
+        return port->sendFrame(FWUPDATE_CMD_ID, data, 1);
+    }
+
+    uint32_t crc = fwUpdateCrc32(0, image, size);
+    data[1] = size & 0xFF;
+    data[2] = (size >> 8) & 0xFF;
+    data[3] = (size >> 16) & 0xFF;
+    data[4] = crc & 0xFF;
+    data[5] = (crc >> 8) & 0xFF;
+    data[6] = (crc >> 16) & 0xFF;
+    data[7] = (crc >> 24) & 0xFF;
+    return port->sendFrame(FWUPDATE_CMD_ID, data, 8);
+}
+
+/*
+ * Send one frame of the image, the last one is padded with 0xFF.
+ */
+bool FirmwareSender::sendData(uint32_t index)
+{
+    uint8_t data[FWUPDATE_FRAME_SIZE];
+    uint32_t offset = index * FWUPDATE_FRAME_SIZE;
+
+    for (uint8_t i = 0; i < FWUPDATE_FRAME_SIZE; i++) {
+        data[i] = (offset + i < size ? image[offset + i] : 0xFF);
+    }
+    return port->sendFrame(FWUPDATE_DATA_ID + (index & FWUPDATE_SEQ_MASK), data, FWUPDATE_FRAME_SIZE);
+}
+
+void FirmwareSender::fail(uint8_t error)
+{
+    status = error;
+    state = STATE_FAILED;
+    pendingCommand = false;
+}
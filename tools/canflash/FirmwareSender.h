@@ -0,0 +1,100 @@
+/*
+ * FirmwareSender.h
+ *
+ * Host side of the CAN firmware update (see FirmwareProtocol.h). The state
+ * machine does no I/O itself: frames go out through a FirmwareSenderPort,
+ * received frames and the time are passed in by the caller. This way it runs
+ * on top of SocketCAN (canflash.cpp) as well as against a simulated GEVCU
+ * (canflashsim.cpp).
+ *
+ * Build on Linux (from this directory):
+ *   g++ -O2 -Wall -Wextra -I../.. -o canflash canflash.cpp FirmwareSender.cpp
+ *   g++ -O2 -Wall -Wextra -I../.. -o canflashsim canflashsim.cpp FirmwareSender.cpp
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef FIRMWARE_SENDER_H_
+#define FIRMWARE_SENDER_H_
+
+#include <stdint.h>
+#include "FirmwareProtocol.h"
+
+#define FWSENDER_RESPONSE_TIMEOUT   200000  // microseconds without a response after which the frames since the last ACK are re-sent
+#define FWSENDER_RESULT_TIMEOUT     5000000 // microseconds to wait for the verification and the commit
+#define FWSENDER_MAX_RETRIES        5
+
+class FirmwareSenderPort {
+public:
+    virtual ~FirmwareSenderPort() {}
+    /*
+     * Queue a frame, return false if it can't be queued right now (it's offered again with the next poll()).
+     */
+    virtual bool sendFrame(uint32_t id, const uint8_t *data, uint8_t length) = 0;
+};
+
+class FirmwareSender {
+public:
+    enum State {
+        STATE_IDLE,
+        STATE_STARTING,         // START sent, waiting for STARTED
+        STATE_SENDING,          // sending data frames within the credit of the GEVCU
+        STATE_VERIFYING,        // all frames acknowledged, waiting for the RESULT
+        STATE_COMMITTING,       // COMMIT sent, waiting for the confirmation
+        STATE_DONE,             // the GEVCU installs the image and resets
+        STATE_FAILED
+    };
+
+    FirmwareSender(FirmwareSenderPort *port);
+    bool start(const uint8_t *image, uint32_t size, uint32_t now);
+    void abort();
+    void handleFrame(uint32_t id, const uint8_t *data, uint8_t length, uint32_t now);
+    void poll(uint32_t now);
+
+    State getState() const;
+    uint8_t getStatus() const;
+    uint32_t getTotalFrames() const;
+    uint32_t getAckedFrames() const;
+    uint32_t getRetransmissions() const;
+
+private:
+    FirmwareSenderPort *port;
+    State state;
+    uint8_t status;             // FWUPDATE_OK or the error which made the update fail
+    const uint8_t *image;
+    uint32_t size;
+    uint32_t totalFrames;
+    uint32_t nextFrame;         // next data frame to send
+    uint32_t ackedFrames;       // frames confirmed by the GEVCU
+    uint32_t limit;             // frames up to (excluding) this index may be sent
+    uint32_t retransmissions;
+    uint8_t retries;
+    uint32_t timer;             // time of the last response or command
+    bool pendingCommand;        // the command of the current state couldn't be queued yet
+
+    bool sendCommand(uint8_t command);
+    bool sendData(uint32_t index);
+    void fail(uint8_t error);
+};
+
+#endif /* FIRMWARE_SENDER_H_ */
@@ -0,0 +1,199 @@
+/*
+ * canflash.cpp
+ *
+ * Updates the firmware of a GEVCU over a SocketCAN interface.
+ *
+ * Usage: canflash <interface> <firmware.bin>
+ * e.g.   canflash can0 GEVCU6.ino.bin
+ *
+ * The bus speed is set up with ip link (e.g. "ip link set can0 up type can
+ * bitrate 500000"), the GEVCU picks the window size for it. Use a larger txqueuelen
+ * ("ip link set can0 txqueuelen 64") so a full window can be queued at once.
+ *
+ * Keep the GEVCU powered until it has reset with the new firmware. If the
+ * power fails while it copies the image to its boot flash, it doesn't boot
+ * any more and can only be recovered by flashing it with SAM-BA over USB
+ * (erase jumper, bossac). It refuses to install the image (status 8) if its
+ * supply dropped during the transfer.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "FirmwareSender.h"
+
+class SocketCanPort : public FirmwareSenderPort {
+public:
+    SocketCanPort(int socket) : socket(socket) {}
+
+    bool sendFrame(uint32_t id, const uint8_t *data, uint8_t length)
+    {
+        struct can_frame frame;
+
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = id;
+        frame.can_dlc = length;
+        memcpy(frame.data, data, length);
+        return (write(socket, &frame, sizeof(frame)) == sizeof(frame)); // ENOBUFS/EAGAIN: the tx queue is full
+    }
+
+private:
+    int socket;
+};
+
+static uint32_t micros()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int openSocket(const char *interface)
+{
+    int s = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+    if (s < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+        perror(interface);
+        close(s);
+        return -1;
+    }
+
+    struct can_filter filter;
+    filter.can_id = FWUPDATE_RESPONSE_ID;
+    filter.can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static uint8_t *readImage(const char *fileName, uint32_t &size)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL) {
+        perror(fileName);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (length <= 0 || length > FWUPDATE_MAX_IMAGE_SIZE) {
+        fprintf(stderr, "%s: invalid size %ld (max %d bytes)\n", fileName, length, FWUPDATE_MAX_IMAGE_SIZE);
+        fclose(file);
+        return NULL;
+    }
+
+    uint8_t *image = (uint8_t *) malloc(length);
+    if (image == NULL || fread(image, 1, length, file) != (size_t) length) {
+        fprintf(stderr, "%s: read failed\n", fileName);
+        free(image);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    size = length;
+    return image;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <interface> <firmware.bin>\n", argv[0]);
+        return 2;
+    }
+
+    uint32_t size;
+    uint8_t *image = readImage(argv[2], size);
+    if (image == NULL) {
+        return 1;
+    }
+    int s = openSocket(argv[1]);
+    if (s < 0) {
+        return 1;
+    }
+
+    SocketCanPort port(s);
+    FirmwareSender sender(&port);
+    uint32_t startTime = micros();
+    uint32_t lastReport = 0;
+
+    printf("do not switch off the GEVCU until it has reset, a power loss while installing requires a recovery over USB\n");
+    sender.start(image, size, startTime);
+    while (sender.getState() != FirmwareSender::STATE_DONE && sender.getState() != FirmwareSender::STATE_FAILED) {
+        struct pollfd pfd;
+        pfd.fd = s;
+        pfd.events = POLLIN;
+        poll(&pfd, 1, 1);
+
+        struct can_frame frame;
+        while (read(s, &frame, sizeof(frame)) == sizeof(frame)) {
+            sender.handleFrame(frame.can_id & CAN_EFF_MASK, frame.data, frame.can_dlc, micros());
+        }
+        sender.poll(micros());
+
+        if (micros() - lastReport > 500000) {
+            lastReport = micros();
+            printf("\r%u / %u frames, %u re-sent", sender.getAckedFrames(), sender.getTotalFrames(), sender.getRetransmissions());
+            fflush(stdout);
+        }
+    }
+
+    double seconds = (micros() - startTime) / 1000000.0;
+    printf("\r%u / %u frames, %u re-sent\n", sender.getAckedFrames(), sender.getTotalFrames(), sender.getRetransmissions());
+    close(s);
+    free(image);
+
+    if (sender.getState() == FirmwareSender::STATE_FAILED) {
+        fprintf(stderr, "update failed, status %d\n", sender.getStatus());
+        return 1;
+    }
+    printf("%u bytes in %.1fs (%.1f kB/s), the GEVCU installs the firmware and resets\n", size, seconds, size / seconds / 1000);
+    return 0;
+}
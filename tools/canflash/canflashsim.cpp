@@ -0,0 +1,570 @@
+/*
+ * canflashsim.cpp
+ *
+ * Runs the FirmwareSender against a simulated GEVCU to test the update
+ * protocol on Linux. The simulated receiver applies the same ACK/NACK and
+ * credit rules as FirmwareUpdater. The bus between the two can drop data
+ * frames and responses, the flash and loop() of the GEVCU can be slowed down
+ * so the page buffers fill up. Every scenario must end with the image staged
+ * and its CRC verified (or with the expected error) within its time budget,
+ * so a recovery which only works through the timeouts is caught as well.
+ *
+ * Build and run on Linux (from this directory):
+ *   g++ -O2 -Wall -Wextra -I../.. -o canflashsim canflashsim.cpp FirmwareSender.cpp
+ *   ./canflashsim
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FirmwareSender.h"
+
+// the same values as in config.h (which needs the Arduino environment)
+#define CFG_FWUPDATE_PAGE_BUFFERS   4
+#define CFG_FWUPDATE_CREDIT_500K    16
+#define CFG_FWUPDATE_TIMEOUT        2000000
+#define CFG_TICK_INTERVAL_FWUPDATE  1000
+#define CFG_CAN_RX_BUFFER_SIZE      32
+
+#define SIM_PAGE_SIZE       256      // IFLASH1_PAGE_SIZE
+#define SIM_FRAME_TIME      260      // microseconds of a frame with 8 data bytes at 500kbps (with stuff bits)
+#define SIM_HOST_QUEUE      64       // txqueuelen of the SocketCAN interface
+#define SIM_QUEUE_SIZE      128
+
+struct SimFrame {
+    uint32_t id;
+    uint8_t data[8];
+    uint8_t length;
+};
+
+/*
+ * A fifo of CAN frames.
+ */
+class SimQueue {
+public:
+    SimQueue() : head(0), tail(0), count(0) {}
+
+    bool push(uint32_t id, const uint8_t *data, uint8_t length)
+    {
+        if (count == SIM_QUEUE_SIZE) {
+            return false;
+        }
+        frames[head].id = id;
+        frames[head].length = length;
+        memcpy(frames[head].data, data, length);
+        head = (head + 1) % SIM_QUEUE_SIZE;
+        count++;
+        return true;
+    }
+
+    bool pop(SimFrame &frame)
+    {
+        if (count == 0) {
+            return false;
+        }
+        frame = frames[tail];
+        tail = (tail + 1) % SIM_QUEUE_SIZE;
+        count--;
+        return true;
+    }
+
+    const SimFrame *front() const
+    {
+        return (count > 0 ? &frames[tail] : NULL);
+    }
+
+    uint16_t size() const
+    {
+        return count;
+    }
+
+private:
+    SimFrame frames[SIM_QUEUE_SIZE];
+    uint16_t head, tail, count;
+};
+
+/*
+ * The SocketCAN transmit queue of the host.
+ */
+class SimHostPort : public FirmwareSenderPort {
+public:
+    bool sendFrame(uint32_t id, const uint8_t *data, uint8_t length)
+    {
+        if (queue.size() >= SIM_HOST_QUEUE) {
+            return false;
+        }
+        return queue.push(id, data, length);
+    }
+
+    SimQueue queue;
+};
+
+/*
+ * The receiving part of FirmwareUpdater with bank 1 replaced by a buffer and
+ * the flash controller by a timer. Safety and supply checks always pass.
+ */
+class SimulatedGevcu {
+public:
+    SimulatedGevcu(uint32_t flashPageTime)
+    {
+        this->flashPageTime = flashPageTime;
+        state = STATE_IDLE;
+        imageSize = 0;
+        imageCrc = 0;
+        totalFrames = 0;
+        frameIndex = 0;
+        ackedFrames = 0;
+        creditLimit = 0;
+        window = CFG_FWUPDATE_CREDIT_500K;
+        nackSent = false;
+        pageHead = 0;
+        pageTail = 0;
+        pagesFull = 0;
+        fill = 0;
+        flashPage = 0;
+        programming = false;
+        flashReady = 0;
+        timer = 0;
+        now = 0;
+        nacks = 0;
+    }
+
+    void handleCanFrame(const SimFrame &frame, uint32_t now)
+    {
+        this->now = now;
+        if (frame.id == FWUPDATE_CMD_ID) {
+            handleCommand(frame);
+        } else if ((frame.id & FWUPDATE_DATA_MASK) == FWUPDATE_DATA_ID && state == STATE_RECEIVING) {
+            handleData(frame);
+        }
+    }
+
+    void handleTick(uint32_t now)
+    {
+        this->now = now;
+        switch (state) {
+        case STATE_RECEIVING:
+            programPages();
+            if (now - timer > CFG_FWUPDATE_TIMEOUT) {
+                stop(FWUPDATE_ERR_TIMEOUT);
+            } else if (frameIndex != ackedFrames || (frameIndex >= creditLimit && credit() > 0)) {
+                sendAck();
+            }
+            break;
+
+        case STATE_VERIFYING:
+            verify();
+            break;
+
+        case STATE_VERIFIED:
+            if (now - timer > CFG_FWUPDATE_TIMEOUT) {
+                stop(FWUPDATE_ERR_TIMEOUT);
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    bool isCommitted() const
+    {
+        return (state == STATE_COMMITTED);
+    }
+
+    const uint8_t *getStagedImage() const
+    {
+        return staged;
+    }
+
+    uint32_t getNacks() const
+    {
+        return nacks;
+    }
+
+    SimQueue responses;
+
+private:
+    enum State {
+        STATE_IDLE,
+        STATE_RECEIVING,
+        STATE_VERIFYING,
+        STATE_VERIFIED,
+        STATE_COMMITTED     // instead of installing the image and resetting
+    };
+
+    State state;
+    uint32_t imageSize;
+    uint32_t imageCrc;
+    uint16_t totalFrames;
+    uint16_t frameIndex;
+    uint16_t ackedFrames;
+    uint16_t creditLimit;
+    uint8_t window;
+    bool nackSent;
+    uint8_t pages[CFG_FWUPDATE_PAGE_BUFFERS][SIM_PAGE_SIZE];
+    uint8_t pageHead;
+    uint8_t pageTail;
+    uint8_t pagesFull;
+    uint16_t fill;
+    uint16_t flashPage;
+    bool programming;
+    uint32_t flashPageTime;     // microseconds the flash controller needs for one page
+    uint32_t flashReady;        // time when the page being programmed is done
+    uint32_t timer;
+    uint32_t now;
+    uint32_t nacks;
+    uint8_t staged[FWUPDATE_MAX_IMAGE_SIZE]; // flash bank 1
+
+    void handleCommand(const SimFrame &frame)
+    {
+        if (frame.length < 1) {
+            return;
+        }
+        switch (frame.data[0]) {
+        case FWUPDATE_START:
+            if (frame.length == 8) {
+                start(frame.data);
+            }
+            break;
+        case FWUPDATE_COMMIT:
+            commit();
+            break;
+        case FWUPDATE_ABORT:
+            if (state != STATE_IDLE) {
+                stop(FWUPDATE_ERR_ABORTED);
+            }
+            break;
+        }
+    }
+
+    void handleData(const SimFrame &frame)
+    {
+        uint32_t offset = (uint32_t) frameIndex * FWUPDATE_FRAME_SIZE;
+        uint8_t length = (imageSize - offset < FWUPDATE_FRAME_SIZE ? imageSize - offset : FWUPDATE_FRAME_SIZE);
+
+        timer = now;
+        if ((frame.id & FWUPDATE_SEQ_MASK) != (frameIndex & FWUPDATE_SEQ_MASK) || frame.length < length
+                || pagesFull == CFG_FWUPDATE_PAGE_BUFFERS) {
+            if (!nackSent) {
+                sendNack();
+                nackSent = true;
+            }
+            return;
+        }
+        nackSent = false;
+
+        uint8_t *page = pages[pageHead];
+        for (uint8_t i = 0; i < FWUPDATE_FRAME_SIZE; i++) {
+            page[fill++] = (i < length ? frame.data[i] : 0xFF);
+        }
+        if (fill == SIM_PAGE_SIZE) {
+            pushPage();
+        }
+        frameIndex++;
+
+        if (frameIndex == totalFrames) {
+            if (fill > 0) {
+                while (fill < SIM_PAGE_SIZE) {
+                    page[fill++] = 0xFF;
+                }
+                pushPage();
+            }
+            state = STATE_VERIFYING;
+            sendAck();
+        } else if (frameIndex - ackedFrames >= window / 2) {
+            sendAck();
+        }
+        programPages();
+    }
+
+    void start(const uint8_t *data)
+    {
+        uint32_t size = data[1] | (data[2] << 8) | (data[3] << 16);
+
+        while (pollFlash() > 0) {
+            now += flashPageTime; // the real one busy-waits
+        }
+        if (size == 0 || size > FWUPDATE_MAX_IMAGE_SIZE) {
+            if (state != STATE_IDLE) {
+                stop(FWUPDATE_ERR_SIZE);
+            }
+            sendResponse(FWUPDATE_STARTED, FWUPDATE_ERR_SIZE);
+            return;
+        }
+
+        imageSize = size;
+        imageCrc = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t) data[7] << 24);
+        totalFrames = (size + FWUPDATE_FRAME_SIZE - 1) / FWUPDATE_FRAME_SIZE;
+        frameIndex = 0;
+        ackedFrames = 0;
+        nackSent = false;
+        pageHead = 0;
+        pageTail = 0;
+        pagesFull = 0;
+        fill = 0;
+        flashPage = 0;
+        timer = now;
+        memset(staged, 0xFF, sizeof(staged));
+        state = STATE_RECEIVING;
+
+        uint8_t initialCredit = credit();
+        creditLimit = initialCredit;
+        sendResponse(FWUPDATE_STARTED, FWUPDATE_OK, initialCredit);
+    }
+
+    void commit()
+    {
+        if (state != STATE_VERIFIED) {
+            sendResponse(FWUPDATE_COMMITTED, FWUPDATE_ERR_STATE);
+            return;
+        }
+        sendResponse(FWUPDATE_COMMITTED, FWUPDATE_OK);
+        state = STATE_COMMITTED;
+    }
+
+    void stop(uint8_t status)
+    {
+        state = STATE_IDLE;
+        sendResponse(FWUPDATE_RESULT, status);
+    }
+
+    void pushPage()
+    {
+        pageHead = (pageHead + 1) % CFG_FWUPDATE_PAGE_BUFFERS;
+        pagesFull++;
+        fill = 0;
+    }
+
+    void programPages()
+    {
+        while (pagesFull > 0 && pollFlash() == 0) {
+            memcpy(staged + (uint32_t) flashPage * SIM_PAGE_SIZE, pages[pageTail], SIM_PAGE_SIZE);
+            programming = true;
+            flashReady = now + flashPageTime;
+            flashPage++;
+            pageTail = (pageTail + 1) % CFG_FWUPDATE_PAGE_BUFFERS;
+            pagesFull--;
+        }
+    }
+
+    int8_t pollFlash()
+    {
+        if (!programming) {
+            return 0;
+        }
+        if ((int32_t) (now - flashReady) < 0) {
+            return 1;
+        }
+        programming = false;
+        return 0;
+    }
+
+    void verify()
+    {
+        programPages();
+        if (pagesFull > 0 || pollFlash() > 0) {
+            return;
+        }
+        if (fwUpdateCrc32(0, staged, imageSize) != imageCrc) {
+            stop(FWUPDATE_ERR_CRC);
+            return;
+        }
+        state = STATE_VERIFIED;
+        timer = now;
+        sendResponse(FWUPDATE_RESULT, FWUPDATE_OK);
+    }
+
+    uint8_t credit()
+    {
+        uint32_t frames = ((CFG_FWUPDATE_PAGE_BUFFERS - pagesFull) * SIM_PAGE_SIZE - fill) / FWUPDATE_FRAME_SIZE;
+
+        if (frames > window) {
+            frames = window;
+        }
+        if (frames > (uint32_t) (totalFrames - frameIndex)) {
+            frames = totalFrames - frameIndex;
+        }
+        return frames;
+    }
+
+    void sendAck()
+    {
+        sendFlowControl(FWUPDATE_ACK);
+    }
+
+    void sendNack()
+    {
+        sendFlowControl(FWUPDATE_NACK);
+        nacks++;
+    }
+
+    void sendFlowControl(uint8_t type)
+    {
+        uint8_t frames = credit();
+        uint8_t data[4] = { type, (uint8_t) (frameIndex & 0xFF), (uint8_t) (frameIndex >> 8), frames };
+
+        responses.push(FWUPDATE_RESPONSE_ID, data, 4);
+        ackedFrames = frameIndex;
+        creditLimit = frameIndex + frames;
+    }
+
+    void sendResponse(uint8_t type, uint8_t status, uint8_t value = 0)
+    {
+        uint8_t data[3] = { type, status, value };
+
+        responses.push(FWUPDATE_RESPONSE_ID, data, (type == FWUPDATE_STARTED ? 3 : 2));
+    }
+};
+
+struct Scenario {
+    const char *name;
+    uint32_t size;
+    uint16_t dropDataEvery;     // drop every n-th data frame on its way to the GEVCU (0 = none)
+    uint16_t dropFlowEvery;     // drop every n-th ACK/NACK on its way to the host (0 = none)
+    uint32_t flashPageTime;     // microseconds to program one page
+    uint32_t loopTime;          // microseconds between two passes of loop() on the GEVCU
+    int32_t corruptFrame;       // the n-th data frame sent is altered on the bus (-1 = none)
+    uint8_t expectedStatus;
+    uint32_t maxTime;           // simulated microseconds the update may take
+};
+
+static const Scenario scenarios[] = {
+    { "clean transfer",               200000,  0,  0,  4000,  200,  -1, FWUPDATE_OK,       15000000 },
+    { "image not a multiple of 8",      1001,  0,  0,  4000,  200,  -1, FWUPDATE_OK,        1000000 },
+    { "full flash bank",     FWUPDATE_MAX_IMAGE_SIZE, 0, 0, 4000, 200, -1, FWUPDATE_OK,    20000000 },
+    { "dropped data frames",          200000, 37,  0,  4000,  200,  -1, FWUPDATE_OK,       25000000 },
+    { "dropped ACKs",                 100000,  0,  3,  4000,  200,  -1, FWUPDATE_OK,       10000000 },
+    { "dropped data and ACKs",        100000, 23,  4,  4000,  200,  -1, FWUPDATE_OK,       60000000 },
+    { "full page buffers",             50000,  0,  0, 30000,  200,  -1, FWUPDATE_OK,       10000000 },
+    { "slow loop",                     50000,  0,  0,  4000, 5000,  -1, FWUPDATE_OK,        5000000 },
+    { "slow flash and losses",         50000, 11,  5, 20000, 2000,  -1, FWUPDATE_OK,       90000000 },
+    { "corrupted frame",               10000,  0,  0,  4000,  200, 100, FWUPDATE_ERR_CRC,   1000000 },
+};
+
+/*
+ * Run one scenario, the bus carries one frame per SIM_FRAME_TIME and the
+ * lower id wins the arbitration.
+ */
+static bool runScenario(const Scenario &scenario)
+{
+    uint8_t *image = (uint8_t *) malloc(scenario.size);
+    SimulatedGevcu *gevcu = new SimulatedGevcu(scenario.flashPageTime);
+    SimHostPort port;
+    FirmwareSender sender(&port);
+    SimQueue rxRing;            // CanHandler receive ring of the GEVCU
+    uint32_t dataFrames = 0, flowFrames = 0, droppedData = 0, droppedFlow = 0, overruns = 0;
+    uint32_t lastLoop = 0, lastTick = 0;
+    uint32_t now = 0;
+
+    srand(scenario.size);
+    for (uint32_t i = 0; i < scenario.size; i++) {
+        image[i] = rand();
+    }
+    sender.start(image, scenario.size, now);
+
+    while (sender.getState() != FirmwareSender::STATE_DONE && sender.getState() != FirmwareSender::STATE_FAILED
+            && now <= scenario.maxTime) {
+        now += SIM_FRAME_TIME;
+
+        const SimFrame *hostFrame = port.queue.front();
+        const SimFrame *gevcuFrame = gevcu->responses.front();
+        SimFrame frame;
+        if (hostFrame != NULL && (gevcuFrame == NULL || hostFrame->id < gevcuFrame->id)) {
+            port.queue.pop(frame);
+            bool drop = false;
+            if ((frame.id & FWUPDATE_DATA_MASK) == FWUPDATE_DATA_ID) {
+                dataFrames++;
+                drop = (scenario.dropDataEvery > 0 && dataFrames % scenario.dropDataEvery == 0);
+                if ((int32_t) dataFrames == scenario.corruptFrame) {
+                    frame.data[0] ^= 0x01;
+                }
+            }
+            if (drop) {
+                droppedData++;
+            } else if (rxRing.size() >= CFG_CAN_RX_BUFFER_SIZE) {
+                overruns++;
+            } else {
+                rxRing.push(frame.id, frame.data, frame.length);
+            }
+        } else if (gevcuFrame != NULL) {
+            gevcu->responses.pop(frame);
+            bool drop = false;
+            if (frame.data[0] == FWUPDATE_ACK || frame.data[0] == FWUPDATE_NACK) {
+                flowFrames++;
+                drop = (scenario.dropFlowEvery > 0 && flowFrames % scenario.dropFlowEvery == 0);
+            }
+            if (drop) {
+                droppedFlow++;
+            } else {
+                sender.handleFrame(frame.id, frame.data, frame.length, now);
+            }
+        }
+
+        if (now - lastLoop >= scenario.loopTime) {
+            lastLoop = now;
+            while (rxRing.pop(frame)) {
+                gevcu->handleCanFrame(frame, now);
+            }
+            if (now - lastTick >= CFG_TICK_INTERVAL_FWUPDATE) {
+                lastTick = now;
+                gevcu->handleTick(now);
+            }
+        }
+        sender.poll(now);
+    }
+
+    uint8_t status = (sender.getState() == FirmwareSender::STATE_DONE ? FWUPDATE_OK : sender.getStatus());
+    bool passed = (status == scenario.expectedStatus && now <= scenario.maxTime);
+    if (passed && status == FWUPDATE_OK) {
+        passed = gevcu->isCommitted() && memcmp(gevcu->getStagedImage(), image, scenario.size) == 0
+                && fwUpdateCrc32(0, gevcu->getStagedImage(), scenario.size) == fwUpdateCrc32(0, image, scenario.size);
+    }
+
+    printf("%-28s %s  status %d, %6.2fs, %u data frames (%u dropped, %u overruns), %u re-sent, %u NACKs, %u ACK/NACKs dropped\n",
+            scenario.name, (passed ? "ok  " : "FAIL"), status, now / 1000000.0, dataFrames, droppedData, overruns,
+            sender.getRetransmissions(), gevcu->getNacks(), droppedFlow);
+
+    delete gevcu;
+    free(image);
+    return passed;
+}
+
+int main()
+{
+    int failed = 0;
+
+    for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (!runScenario(scenarios[i])) {
+            failed++;
+        }
+    }
+    if (failed > 0) {
+        printf("%d scenario(s) failed\n", failed);
+        return 1;
+    }
+    printf("all scenarios passed\n");
+    return 0;
+}
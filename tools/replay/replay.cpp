@@ -0,0 +1,236 @@
+/*
+ * replay.cpp
+ *
+ * Runs a trace recorded with the console's trace command (see InputTrace.h)
+ * through the firmware on a Linux host. The firmware modules are built
+ * against a minimal Arduino/due_can shim (shim/) whose millis() and micros()
+ * return the virtual clock of the TracePlayer. Before each iteration of the
+ * main loop the player injects the recorded frames and ADC/digital inputs up
+ * to the next record or TickHandler base tick, whichever comes first.
+ *
+ * The frames sent by the firmware are written to stdout with their virtual
+ * time, the log and console output goes to stderr, so the outputs of two
+ * firmware versions for the same trace can be compared with diff.
+ *
+ * GEVCU6.ino can't be compiled on the host (it pulls in the BLE, WiFi and
+ * serial console modules), setup() and loop() below mirror it for the modules
+ * which take part in the replay: the throttles, brakes and the DMOC645. Which
+ * of them is enabled comes from the EEPROM image (a dump of the recording
+ * GEVCU), an erased EEPROM enables the devices listed in AUTO_ENABLE_DEVx.
+ *
+ * Build on Linux (from this directory): make
+ * Run: ./replay [-e eeprom.bin] [-l loglevel] trace.bin
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include <DueTimer.h>
+#include <due_wire.h>
+#include "config.h"
+#include "eeprom_layout.h"
+#include "Logger.h"
+#include "MemCache.h"
+#include "PrefHandler.h"
+#include "TickHandler.h"
+#include "CanHandler.h"
+#include "InputTrace.h"
+#include "sys_io.h"
+#include "DeviceManager.h"
+#include "FaultHandler.h"
+#include "PotThrottle.h"
+#include "PotBrake.h"
+#include "CanThrottle.h"
+#include "CanBrake.h"
+#include "DmocMotorController.h"
+
+// globals of GEVCU6.ino
+PrefHandler *sysPrefs;
+MemCache *memCache;
+
+static const uint8_t traceMagic[] = { 'G', 'T', 'R', 'C' };
+
+/*
+ * Read the trace. A capture of the USB port starts with the console's confirmation
+ * of the trace command, so everything before the header is skipped.
+ */
+static uint8_t *readTrace(const char *fileName, uint32_t &length)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL) {
+        perror(fileName);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = (size >= 0 ? (uint8_t *) malloc(size + 1) : NULL);
+    if (data == NULL || fread(data, 1, size, file) != (size_t) size) {
+        fprintf(stderr, "%s: read error\n", fileName);
+        fclose(file);
+        free(data);
+        return NULL;
+    }
+    fclose(file);
+
+    for (long i = 0; i + (long) sizeof(traceMagic) <= size; i++) {
+        if (memcmp(&data[i], traceMagic, sizeof(traceMagic)) == 0) {
+            length = size - i;
+            memmove(data, &data[i], length);
+            return data;
+        }
+    }
+    fprintf(stderr, "%s: no trace header found\n", fileName);
+    free(data);
+    return NULL;
+}
+
+/*
+ * The defaults of initSysEEPROM() in GEVCU6.ino.
+ */
+static void initSysEEPROM()
+{
+    sysPrefs->write(EESYS_SYSTEM_TYPE, (uint8_t) 6);
+    sysPrefs->write(EESYS_ADC0_GAIN, (uint16_t) 1024);
+    sysPrefs->write(EESYS_ADC1_GAIN, (uint16_t) 1024);
+    sysPrefs->write(EESYS_ADC2_GAIN, (uint16_t) 1024);
+    sysPrefs->write(EESYS_ADC3_GAIN, (uint16_t) 1024);
+    sysPrefs->write(EESYS_ADC0_OFFSET, (uint16_t) 0);
+    sysPrefs->write(EESYS_ADC1_OFFSET, (uint16_t) 0);
+    sysPrefs->write(EESYS_ADC2_OFFSET, (uint16_t) 0);
+    sysPrefs->write(EESYS_ADC3_OFFSET, (uint16_t) 0);
+    sysPrefs->write(EESYS_CAN0_BAUD, (uint16_t) 500);
+    sysPrefs->write(EESYS_CAN1_BAUD, (uint16_t) 500);
+    sysPrefs->write(EESYS_LOG_LEVEL, (uint8_t) 3);
+    sysPrefs->saveChecksum();
+}
+
+static void setup(int logLevel)
+{
+    Wire.begin();
+    memCache = new MemCache();
+    memCache->setup();
+    sysPrefs = new PrefHandler(SYSTEM);
+    if (!sysPrefs->checksumValid()) {
+        initSysEEPROM();
+    }
+
+    uint8_t loglevel;
+    sysPrefs->read(EESYS_LOG_LEVEL, &loglevel);
+    Logger::setLoglevel((Logger::LogLevel) (logLevel >= 0 ? logLevel : loglevel));
+    systemIO.setup();
+    canHandlerEv.setup();
+    canHandlerCar.setup();
+
+    faultHandler.setup();
+    new PotThrottle();
+    new CanThrottle();
+    new PotBrake();
+    new CanBrake();
+    new DmocMotorController();
+    deviceManager.sendMessage(DEVICE_ANY, INVALID, MSG_STARTUP, NULL);
+}
+
+/*
+ * The handlers of loop() in GEVCU6.ino. There is no need to wait for events
+ * as the virtual clock stands still until the next call.
+ */
+static void loop()
+{
+    do {
+        tickHandler.process();
+        CanHandler::processAll();
+    } while (canHandlerEv.isFrameAvailable() || canHandlerCar.isFrameAvailable());
+    systemIO.pollInitialization();
+}
+
+int main(int argc, char **argv)
+{
+    const char *eepromImage = NULL;
+    int logLevel = -1;
+    int option;
+
+    while ((option = getopt(argc, argv, "e:l:")) != -1) {
+        switch (option) {
+        case 'e':
+            eepromImage = optarg;
+            break;
+        case 'l':
+            logLevel = atoi(optarg);
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-e eeprom.bin] [-l loglevel] <trace.bin>\n", argv[0]);
+        return 2;
+    }
+    if (eepromImage != NULL && !Wire.loadImage(eepromImage)) {
+        perror(eepromImage);
+        return 1;
+    }
+    uint32_t length;
+    uint8_t *trace = readTrace(argv[optind], length);
+    if (trace == NULL) {
+        return 1;
+    }
+
+    // the player's clock starts at 0 with the trace, the GEVCU runs setup() at the same time
+    if (!tracePlayer.begin(trace, length)) {
+        free(trace);
+        return 1;
+    }
+    setup(logLevel);
+
+    uint32_t nextTick = Timer0.getPeriod();
+    bool playing = true;
+    while (playing) {
+        uint32_t now = tracePlayer.getMicros();
+        uint32_t next = tracePlayer.getNextTime();
+        bool tick = false;
+
+        if ((int32_t) (next - now) < 0) { // frames are stamped when received and may be older than the previous record
+            next = now;
+        }
+        if (Timer0.isRunning() && (int32_t) (nextTick - next) <= 0) {
+            next = nextTick;
+            tick = true;
+        }
+        playing = tracePlayer.replayUntil(next);
+        if (tick) {
+            Timer0.fire();
+            nextTick += Timer0.getPeriod();
+        }
+        loop();
+    }
+    fprintf(stderr, "replayed %u ms\n", tracePlayer.getMillis());
+    tracePlayer.end();
+    free(trace);
+    return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * Arduino.cpp
+ *
+ * Host implementation of the Arduino core functions used by the replayed
+ * firmware modules.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <Arduino.h>
+#include "InputTrace.h"
+
+Serial_ SerialUSB;
+Serial_ Serial;
+
+static DWT_Type dwt;
+static CoreDebug_Type coreDebug;
+DWT_Type *DWT = &dwt;
+CoreDebug_Type *CoreDebug = &coreDebug;
+
+/*
+ * The clock only advances with the replayed trace.
+ */
+uint32_t millis()
+{
+    return tracePlayer.getMillis();
+}
+
+uint32_t micros()
+{
+    return tracePlayer.getMicros();
+}
+
+/*
+ * Waiting would never end as nothing advances the virtual clock meanwhile.
+ */
+void delay(uint32_t ms)
+{
+    (void) ms;
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    (void) us;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+void pinMode(uint32_t pin, uint32_t mode)
+{
+    (void) pin;
+    (void) mode;
+}
+
+void digitalWrite(uint32_t pin, uint32_t value)
+{
+    (void) pin;
+    (void) value;
+}
+
+/*
+ * The digital inputs are taken from the trace by SystemIO, other pins read low.
+ */
+int digitalRead(uint32_t pin)
+{
+    (void) pin;
+    return LOW;
+}
+
+uint32_t analogRead(uint32_t pin)
+{
+    (void) pin;
+    return 0;
+}
+
+void watchdogReset()
+{
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+uint32_t __get_PRIMASK()
+{
+    return 0;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+    (void) primask;
+}
+
+void __disable_irq()
+{
+}
+
+void __enable_irq()
+{
+}
+
+void __WFI()
+{
+}
+
+void __DMB()
+{
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::print(const char *s)
+{
+    return write((const uint8_t *) s, strlen(s));
+}
+
+size_t Print::print(char c)
+{
+    return write((uint8_t) c);
+}
+
+size_t Print::print(unsigned char n, int base)
+{
+    return print((unsigned long) n, base);
+}
+
+size_t Print::print(int n, int base)
+{
+    return print((long) n, base);
+}
+
+size_t Print::print(unsigned int n, int base)
+{
+    return print((unsigned long) n, base);
+}
+
+/*
+ * Like on the Due, negative numbers are only printed with a sign in decimal,
+ * otherwise as their 32-bit two's complement.
+ */
+size_t Print::print(long n, int base)
+{
+    if (base == DEC && n < 0) {
+        return print('-') + printNumber(-n, DEC);
+    }
+    return printNumber((uint32_t) n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+    return print(buffer);
+}
+
+size_t Print::println()
+{
+    return print("\r\n");
+}
+
+size_t Print::println(const char *s)
+{
+    return print(s) + println();
+}
+
+size_t Print::println(char c)
+{
+    return print(c) + println();
+}
+
+size_t Print::println(int n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t Print::println(unsigned int n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t Print::println(long n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t Print::println(unsigned long n, int base)
+{
+    return print(n, base) + println();
+}
+
+size_t Print::println(double n, int digits)
+{
+    return print(n, digits) + println();
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+    char buffer[8 * sizeof(long) + 1];
+    char *s = &buffer[sizeof(buffer) - 1];
+
+    if (base < 2) {
+        base = 10;
+    }
+    *s = 0;
+    do {
+        uint8_t digit = n % base;
+        *--s = (digit < 10 ? '0' + digit : 'A' + digit - 10);
+        n /= base;
+    } while (n);
+    return print(s);
+}
+
+int Stream::available()
+{
+    return 0;
+}
+
+int Stream::read()
+{
+    return -1;
+}
+
+int Stream::peek()
+{
+    return -1;
+}
+
+void Stream::flush()
+{
+}
+
+void Serial_::begin(uint32_t baud)
+{
+    (void) baud;
+}
+
+size_t Serial_::write(uint8_t c)
+{
+    return fputc(c, stderr) == EOF ? 0 : 1;
+}
+
+size_t Serial_::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stderr);
+}
+
+int Serial_::availableForWrite()
+{
+    return 512;
+}
+
+Serial_::operator bool()
+{
+    return true;
+}
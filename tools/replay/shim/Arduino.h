@@ -0,0 +1,154 @@
+/*
+ * Arduino.h
+ *
+ * Minimal host replacement of the Arduino core for the trace replay (see
+ * tools/replay/replay.cpp). Only what the replayed firmware modules use is
+ * provided. millis() and micros() return the virtual clock of the TracePlayer,
+ * interrupts don't exist so disabling them is a no-op.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef REPLAY_ARDUINO_H_
+#define REPLAY_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include "variant.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint8_t U8;
+typedef uint16_t U16;
+typedef uint32_t U32;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+#define DEC     10
+#define HEX     16
+#define OCT     8
+#define BIN     2
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+uint32_t analogRead(uint32_t pin);
+void watchdogReset();
+
+void noInterrupts();
+void interrupts();
+uint32_t __get_PRIMASK();
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq();
+void __enable_irq();
+void __WFI();
+void __DMB();
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t print(const char *s);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println();
+    size_t println(const char *s);
+    size_t println(char c);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+
+private:
+    size_t printNumber(unsigned long n, uint8_t base);
+};
+
+class Stream : public Print {
+public:
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual void flush();
+};
+
+/*
+ * The USB and UART ports write to stderr, so stdout only carries the
+ * frames which the firmware sends.
+ */
+class Serial_ : public Stream {
+public:
+    void begin(uint32_t baud);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    int availableForWrite();
+    operator bool();
+};
+
+extern Serial_ SerialUSB;
+extern Serial_ Serial;
+
+/*
+ * Cycle counter of the profiler. TickHandler only uses it on the SAM3X.
+ */
+struct DWT_Type {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+};
+struct CoreDebug_Type {
+    volatile uint32_t DEMCR;
+};
+extern DWT_Type *DWT;
+extern CoreDebug_Type *CoreDebug;
+#define DWT_CTRL_CYCCNTENA_Msk      (1ul << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1ul << 24)
+
+#endif /* REPLAY_ARDUINO_H_ */
@@ -0,0 +1,85 @@
+/*
+ * DueTimer.cpp
+ *
+ * Host implementation of the DueTimer library for the trace replay.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <DueTimer.h>
+
+DueTimer Timer0;
+
+DueTimer::DueTimer()
+{
+    callback = NULL;
+    period = 0;
+    running = false;
+}
+
+DueTimer& DueTimer::setPeriod(double microseconds)
+{
+    period = microseconds;
+    return *this;
+}
+
+DueTimer& DueTimer::attachInterrupt(void (*isr)())
+{
+    callback = isr;
+    return *this;
+}
+
+DueTimer& DueTimer::start(double microseconds)
+{
+    if (microseconds > 0) {
+        period = microseconds;
+    }
+    running = true;
+    return *this;
+}
+
+DueTimer& DueTimer::stop()
+{
+    running = false;
+    return *this;
+}
+
+bool DueTimer::isRunning()
+{
+    return running && callback != NULL && period >= 1;
+}
+
+uint32_t DueTimer::getPeriod()
+{
+    return (uint32_t) period;
+}
+
+/*
+ * Run the interrupt handler once, called by the replay driver when a period elapsed.
+ */
+void DueTimer::fire()
+{
+    if (isRunning()) {
+        callback();
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * DueTimer.h
+ *
+ * Host replacement of the DueTimer library for the trace replay. The timer
+ * doesn't run on its own, the replay driver calls fire() for every period
+ * which has elapsed on the virtual clock.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef REPLAY_DUETIMER_H_
+#define REPLAY_DUETIMER_H_
+
+#include <Arduino.h>
+
+class DueTimer
+{
+public:
+    DueTimer();
+    DueTimer& setPeriod(double microseconds);
+    DueTimer& attachInterrupt(void (*isr)());
+    DueTimer& start(double microseconds = -1);
+    DueTimer& stop();
+    bool isRunning();
+    uint32_t getPeriod();
+    void fire();
+
+private:
+    void (*callback)();
+    double period;
+    bool running;
+};
+
+extern DueTimer Timer0;
+
+#endif /* REPLAY_DUETIMER_H_ */
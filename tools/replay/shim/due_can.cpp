@@ -0,0 +1,160 @@
+/*
+ * due_can.cpp
+ *
+ * Host implementation of the due_can library for the trace replay.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <due_can.h>
+
+static Can can0Registers;
+static Can can1Registers;
+Can *CAN0 = &can0Registers;
+Can *CAN1 = &can1Registers;
+
+CANRaw CAN(CAN0, 0);
+CANRaw CAN2(CAN1, 1);
+
+CAN_FRAME::CAN_FRAME()
+{
+    id = 0;
+    fid = 0;
+    rtr = 0;
+    priority = 15;
+    extended = false;
+    time = 0;
+    length = 0;
+    data.value = 0;
+}
+
+CANRaw::CANRaw(Can *regs, uint8_t busNumber)
+{
+    this->regs = regs;
+    this->busNumber = busNumber;
+    enabled = false;
+}
+
+/*
+ * Store a bit timing for the rate in the baud rate register like the real
+ * controller, CanHandler::getBitTiming() reads it from there. The quanta are
+ * split into propagation and two equal phase segments of at most 8 quanta each.
+ *
+ * \retval 0 if the rate can't be derived from the master clock
+ */
+uint32_t CANRaw::begin(uint32_t baudrate, uint8_t enablePin)
+{
+    (void) enablePin;
+    for (uint32_t quanta = 25; quanta >= 8; quanta--) {
+        uint32_t prescaler = VARIANT_MCK / (baudrate * quanta);
+        uint32_t phase = (quanta - 1) / 3;
+        uint32_t propagation = quanta - 1 - 2 * phase;
+
+        if (prescaler == 0 || prescaler > 128 || VARIANT_MCK % (baudrate * quanta) != 0 || phase > 8
+                || propagation > 8) {
+            continue;
+        }
+        regs->CAN_BR = ((prescaler - 1) << CAN_BR_BRP_Pos) | (0 << CAN_BR_SJW_Pos)
+                | ((propagation - 1) << CAN_BR_PROPAG_Pos) | ((phase - 1) << CAN_BR_PHASE1_Pos)
+                | ((phase - 1) << CAN_BR_PHASE2_Pos);
+        enabled = true;
+        return 1;
+    }
+    return 0;
+}
+
+void CANRaw::disable()
+{
+    enabled = false;
+}
+
+void CANRaw::setNumTXBoxes(int txboxes)
+{
+    (void) txboxes;
+}
+
+/*
+ * Received frames don't come from an interrupt but are injected by the TracePlayer.
+ */
+void CANRaw::setGeneralCallback(void (*callback)(CAN_FRAME *))
+{
+    (void) callback;
+}
+
+void CANRaw::mailbox_set_mode(uint8_t mailbox, uint8_t mode)
+{
+    (void) mailbox;
+    (void) mode;
+}
+
+/*
+ * A sent frame leaves the mailbox immediately.
+ */
+uint32_t CANRaw::mailbox_get_status(uint8_t mailbox)
+{
+    (void) mailbox;
+    return CAN_MSR_MRDY;
+}
+
+int CANRaw::setRXFilter(uint8_t mailbox, uint32_t id, uint32_t mask, bool extended)
+{
+    (void) id;
+    (void) mask;
+    (void) extended;
+    return mailbox;
+}
+
+/*
+ * Write the frame as "<time in us> <bus> <id> <length> <data bytes>" to stdout.
+ */
+bool CANRaw::sendFrame(CAN_FRAME &frame)
+{
+    if (!enabled) {
+        return false;
+    }
+    printf("%10u %d %*X %d", micros(), busNumber, frame.extended ? 8 : 3, frame.id, frame.length);
+    if (frame.rtr) {
+        printf(" R");
+    } else {
+        for (int i = 0; i < frame.length && i < 8; i++) {
+            printf(" %02X", frame.data.bytes[i]);
+        }
+    }
+    printf("\n");
+    return true;
+}
+
+uint32_t CANRaw::get_status()
+{
+    return 0;
+}
+
+uint8_t CANRaw::get_tx_error_cnt()
+{
+    return 0;
+}
+
+uint8_t CANRaw::get_rx_error_cnt()
+{
+    return 0;
+}
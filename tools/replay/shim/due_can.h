@@ -0,0 +1,113 @@
+/*
+ * due_can.h
+ *
+ * Host replacement of the due_can library for the trace replay. Received
+ * frames are injected by the TracePlayer, sent frames are written to stdout
+ * as "<time in us> <bus> <id> <length> <data>" so two runs can be compared
+ * with diff.
+ * The transmit mailboxes are always ready and the controller never reports
+ * errors.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef REPLAY_DUE_CAN_H_
+#define REPLAY_DUE_CAN_H_
+
+#include <Arduino.h>
+
+#define CAN_BPS_1000K       1000000
+#define CAN_BPS_800K        800000
+#define CAN_BPS_500K        500000
+#define CAN_BPS_250K        250000
+#define CAN_BPS_125K        125000
+#define CAN_BPS_50K         50000
+#define CAN_BPS_33333       33333
+#define CAN_BPS_25K         25000
+
+#define CANMB_NUMBER        8
+#define CAN_MB_DISABLE_MODE 0
+#define CAN_MB_RX_MODE      1
+#define CAN_MB_TX_MODE      3
+
+#define CAN_MSR_MRDY        (1u << 23)
+#define CAN_SR_WARN         (1u << 17)
+#define CAN_SR_ERRP         (1u << 18)
+#define CAN_SR_BOFF         (1u << 19)
+
+typedef union {
+    uint64_t value;
+    struct {
+        uint32_t low;
+        uint32_t high;
+    };
+    struct {
+        uint16_t s0;
+        uint16_t s1;
+        uint16_t s2;
+        uint16_t s3;
+    };
+    uint8_t bytes[8];
+    uint8_t byte[8];
+} BytesUnion;
+
+class CAN_FRAME
+{
+public:
+    CAN_FRAME();
+    BytesUnion data;
+    uint32_t id;
+    uint32_t fid;
+    uint8_t rtr;
+    uint8_t priority;
+    uint8_t extended;
+    uint16_t time;
+    uint8_t length;
+};
+
+class CANRaw
+{
+public:
+    CANRaw(Can *regs, uint8_t busNumber);
+    uint32_t begin(uint32_t baudrate, uint8_t enablePin);
+    void disable();
+    void setNumTXBoxes(int txboxes);
+    void setGeneralCallback(void (*callback)(CAN_FRAME *));
+    void mailbox_set_mode(uint8_t mailbox, uint8_t mode);
+    uint32_t mailbox_get_status(uint8_t mailbox);
+    int setRXFilter(uint8_t mailbox, uint32_t id, uint32_t mask, bool extended);
+    bool sendFrame(CAN_FRAME &frame);
+    uint32_t get_status();
+    uint8_t get_tx_error_cnt();
+    uint8_t get_rx_error_cnt();
+
+private:
+    Can *regs;
+    uint8_t busNumber;
+    bool enabled;
+};
+
+extern CANRaw CAN;
+extern CANRaw CAN2;
+
+#endif /* REPLAY_DUE_CAN_H_ */
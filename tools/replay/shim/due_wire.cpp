@@ -0,0 +1,129 @@
+/*
+ * due_wire.cpp
+ *
+ * Host implementation of the due_wire library for the trace replay.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#include <due_wire.h>
+
+TwoWire Wire;
+
+TwoWire::TwoWire()
+{
+    memset(image, 0xFF, sizeof(image));
+    bank = 0;
+    txLength = 0;
+    readAddress = 0;
+    readRemaining = 0;
+}
+
+void TwoWire::begin()
+{
+}
+
+/*
+ * The two lowest bits of the device address select the 64kB bank of the EEPROM.
+ */
+void TwoWire::beginTransmission(int address)
+{
+    bank = (address & 0x03) << 16;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if (txLength >= sizeof(txBuffer)) {
+        return 0;
+    }
+    txBuffer[txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity)
+{
+    size_t n = 0;
+    while (n < quantity && write(data[n])) {
+        n++;
+    }
+    return n;
+}
+
+/*
+ * The first two bytes of a transmission set the address, the following ones
+ * are written to the EEPROM. Without a stop condition only the address is set
+ * for a following requestFrom().
+ */
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+    if (txLength < 2) {
+        return 2; // NACK on the address
+    }
+    readAddress = bank | (txBuffer[0] << 8) | txBuffer[1];
+    if (sendStop) {
+        for (size_t i = 2; i < txLength; i++) {
+            image[(readAddress + i - 2) % EEPROM_IMAGE_SIZE] = txBuffer[i];
+        }
+    }
+    txLength = 0;
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity)
+{
+    (void) address;
+    readRemaining = quantity;
+    return 0;
+}
+
+int TwoWire::available()
+{
+    return readRemaining;
+}
+
+int TwoWire::read()
+{
+    if (readRemaining <= 0) {
+        return -1;
+    }
+    readRemaining--;
+    return image[readAddress++ % EEPROM_IMAGE_SIZE];
+}
+
+/*
+ * Load the EEPROM content, e.g. a dump of the configuration of the recording GEVCU.
+ */
+bool TwoWire::loadImage(const char *fileName)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    size_t length = fread(image, 1, sizeof(image), file);
+    fclose(file);
+    if (length < sizeof(image)) {
+        memset(&image[length], 0xFF, sizeof(image) - length);
+    }
+    return true;
+}
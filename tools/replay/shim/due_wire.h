@@ -0,0 +1,65 @@
+/*
+ * due_wire.h
+ *
+ * Host replacement of the due_wire library for the trace replay. It emulates
+ * the 256kB I2C EEPROM used by MemCache (device addresses 0x50 to 0x53, two
+ * address bytes followed by the data). The content starts erased and can be
+ * loaded from an image file by the replay driver.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef REPLAY_DUE_WIRE_H_
+#define REPLAY_DUE_WIRE_H_
+
+#include <Arduino.h>
+
+#define EEPROM_IMAGE_SIZE   (256 * 1024)
+
+class TwoWire
+{
+public:
+    TwoWire();
+    void begin();
+    void beginTransmission(int address);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(int address, int quantity);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t quantity);
+    int available();
+    int read();
+
+    bool loadImage(const char *fileName);
+
+private:
+    uint8_t image[EEPROM_IMAGE_SIZE];
+    uint32_t bank;      // upper address bits from the device address
+    uint8_t txBuffer[260];
+    size_t txLength;
+    uint32_t readAddress;
+    int readRemaining;
+};
+
+extern TwoWire Wire;
+
+#endif /* REPLAY_DUE_WIRE_H_ */
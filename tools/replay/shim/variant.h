@@ -0,0 +1,57 @@
+/*
+ * variant.h
+ *
+ * Host replacement of the Arduino Due variant for the trace replay: the master
+ * clock and the registers of the CAN controllers which the firmware reads directly.
+ *
+Copyright (c) 2013 Collin Kidder, Michael Neuweiler, Charles Galpin
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef REPLAY_VARIANT_H_
+#define REPLAY_VARIANT_H_
+
+#include <stdint.h>
+
+#define VARIANT_MCK         84000000
+
+#define CAN_BR_PHASE2_Pos   0
+#define CAN_BR_PHASE2_Msk   (0x7u << CAN_BR_PHASE2_Pos)
+#define CAN_BR_PHASE1_Pos   4
+#define CAN_BR_PHASE1_Msk   (0x7u << CAN_BR_PHASE1_Pos)
+#define CAN_BR_PROPAG_Pos   8
+#define CAN_BR_PROPAG_Msk   (0x7u << CAN_BR_PROPAG_Pos)
+#define CAN_BR_SJW_Pos      12
+#define CAN_BR_SJW_Msk      (0x3u << CAN_BR_SJW_Pos)
+#define CAN_BR_BRP_Pos      16
+#define CAN_BR_BRP_Msk      (0x7fu << CAN_BR_BRP_Pos)
+#define CAN_BR_SMP          (0x1u << 24)
+
+typedef struct {
+    volatile uint32_t CAN_MR;
+    volatile uint32_t CAN_BR;
+} Can;
+
+extern Can *CAN0;
+extern Can *CAN1;
+
+#endif /* REPLAY_VARIANT_H_ */